@@ -0,0 +1,399 @@
+// Benchmarks for editing operations on large synthetic documents.
+//
+// Operations are driven through FakeVimHandler::handleInput() like key
+// presses, and files are opened and saved through WolfEdit::addTab() and
+// Tab::save(). Each sample is the time until the editor is idle again, i.e.
+// including the events posted by the operation (layout, highlighting).
+//
+// Results are written as JSON so they can be compared between commits:
+//
+//   wolfedit_bench --lines 10000,1000000 --output results.json
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include "src/WolfEdit.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+
+namespace {
+
+enum class Variant { Code, Short, Long };
+
+struct Document {
+  Variant variant;
+  QString name;
+  int lines;
+};
+
+// Text used for the document variants:
+//  - code: C-like lines of about 40 characters with nested blocks,
+//  - short: many lines of a few characters,
+//  - long: one hundredth of the lines, each about 4000 characters.
+// Every variant contains the word "needle" on roughly one line in a thousand.
+QString generateText(const Document &document) {
+  QString text;
+  switch (document.variant) {
+  case Variant::Code: {
+    text.reserve(document.lines * 40);
+    int depth = 0;
+    for (int i = 0; i < document.lines; ++i) {
+      const QString indent(depth * 4, ' ');
+      if (i % 10 == 0) {
+        text +=
+            indent + QStringLiteral("if (value%1 > limit) {\n").arg(i % 997);
+        ++depth;
+      } else if (i % 10 == 9 && depth > 0) {
+        --depth;
+        text += QString(depth * 4, ' ') + QStringLiteral("}\n");
+      } else if (i % 1000 == 500) {
+        text += indent + QStringLiteral("find(needle, %1);\n").arg(i);
+      } else {
+        text += indent +
+                QStringLiteral("int foo%1 = compute(bar, %2);\n")
+                    .arg(i % 9973)
+                    .arg((i * 7919) % 10007);
+      }
+    }
+    break;
+  }
+  case Variant::Short:
+    text.reserve(document.lines * 6);
+    for (int i = 0; i < document.lines; ++i) {
+      text += i % 1000 == 500 ? QStringLiteral("needle\n")
+                              : QStringLiteral("foo%1\n").arg(i % 97);
+    }
+    break;
+  case Variant::Long: {
+    const int lines = std::max(1, document.lines / 100);
+    text.reserve(lines * 4100);
+    for (int i = 0; i < lines; ++i) {
+      for (int j = 0; j < 400; ++j) {
+        text += (i * 400 + j) % 100000 == 50000
+                    ? QStringLiteral("needle ")
+                    : QStringLiteral("foo%1 bar ").arg((i + j) % 10);
+      }
+      text += '\n';
+    }
+    break;
+  }
+  }
+  return text;
+}
+
+struct Statistics {
+  double min = 0;
+  double mean = 0;
+  double p50 = 0;
+  double p90 = 0;
+  double p99 = 0;
+  double max = 0;
+};
+
+// Nearest-rank percentiles of samples in milliseconds.
+Statistics statistics(QVector<double> samples) {
+  Statistics result;
+  if (samples.isEmpty()) {
+    return result;
+  }
+  std::sort(samples.begin(), samples.end());
+  const auto percentile = [&samples](double p) {
+    const int rank = int(std::ceil(p / 100.0 * samples.size()));
+    return samples[qBound(0, rank - 1, samples.size() - 1)];
+  };
+  result.min = samples.first();
+  result.max = samples.last();
+  result.mean = std::accumulate(samples.begin(), samples.end(), 0.0) /
+                samples.size();
+  result.p50 = percentile(50);
+  result.p90 = percentile(90);
+  result.p99 = percentile(99);
+  return result;
+}
+
+class Benchmark {
+public:
+  Benchmark(int iterations, const QRegularExpression &filter)
+      : m_iterations(iterations), m_filter(filter) {}
+
+  QJsonArray results() const { return m_results; }
+
+  void run(const Document &document, const QString &directory) {
+    const QString text = generateText(document);
+    m_document = document;
+    m_lineCount = text.count('\n');
+    qInfo().noquote() << QStringLiteral("%1 document, %2 lines")
+                             .arg(document.name)
+                             .arg(m_lineCount);
+
+    WolfEdit::WolfEdit window;
+    window.show();
+
+    VimEditor editor;
+    editor.resize(800, 600);
+    editor.show();
+    m_handler = editor.handler;
+    m_textEdit = editor.textEdit;
+    m_undoJournal = editor.undoJournal;
+    // The C-like document is highlighted as it would be in a .cpp file.
+    if (document.variant == Variant::Code) {
+      editor.syntaxHighlighter->setLexer(WolfEdit::Lexer::forName(QStringLiteral("cpp")));
+    }
+
+    reset(text);
+    const int middle = m_lineCount / 2;
+
+    measure("insert", m_iterations * 10,
+            [&] { keys(QStringLiteral("<ESC>%1Gi").arg(middle)); },
+            [&] { keys("x"); }, [&] { keys("<ESC>u"); });
+    measure("dd", m_iterations,
+            [&] { keys(QStringLiteral("<ESC>%1G").arg(middle)); },
+            [&] { keys("dd"); }, [&] { keys("u"); });
+    measure("p", m_iterations,
+            [&] { keys(QStringLiteral("<ESC>%1Gyy").arg(middle)); },
+            [&] { keys("p"); }, [&] { keys("u"); });
+    measure("search", m_iterations, [&] { keys("<ESC>gg"); },
+            [&] { keys("/needle<CR>"); }, [] {});
+    measure("search-next", m_iterations * 10,
+            [&] { keys("<ESC>gg/needle<CR>"); }, [&] { keys("n"); }, [] {});
+    measure("substitute", m_iterations, [&] { keys("<ESC>gg"); },
+            [&] { keys(":%s/foo/baz/g<CR>"); }, [&] { keys("u"); });
+    measure("undo", m_iterations, [&] { keys("<ESC>:%s/foo/baz/g<CR>"); },
+            [&] { keys("u"); }, [] {});
+    measure("redo", m_iterations, [&] { keys("<ESC>:%s/foo/baz/g<CR>u"); },
+            [&] { keys("<C-R>"); }, [&] { keys("u"); });
+    measure("global", m_iterations, [&] { keys("<ESC>gg"); },
+            [&] { keys(":g/needle/d<CR>"); }, [&] { keys("u"); });
+    measure("sort", m_iterations, [&] { keys("<ESC>gg"); },
+            [&] { keys(":sort<CR>"); }, [&] { keys("u"); });
+    measure("indent", m_iterations, [&] { keys("<ESC>gg"); },
+            [&] { keys("=G"); }, [&] { keys("u"); });
+    measure("normal", m_iterations, [&] { keys("<ESC>gg"); },
+            [&] { keys(":%normal A;<CR>"); }, [&] { keys("u"); });
+    measure("macro", m_iterations, [&] { keys("<ESC>ggqqA;<ESC>jq"); },
+            [&] { keys("1000@q"); }, [&] { keys("uu"); });
+    measure("scroll", m_iterations * 10, [&] { keys("<ESC>gg"); },
+            [&] { keys("<C-f>"); }, [] {});
+    measure("zt", m_iterations * 10,
+            [&] { keys(QStringLiteral("<ESC>%1Gzb").arg(middle)); },
+            [&] { keys("zt"); }, [] {});
+    // Like dragging the window border; lines are wrapped again only once the
+    // width stops changing.
+    int width = editor.width();
+    measure("resize", m_iterations * 10, [] {},
+            [&] {
+              width = width == 800 ? 700 : 800;
+              editor.resize(width, 600);
+              QApplication::processEvents();
+            },
+            [] {});
+
+    m_handler = nullptr;
+    m_textEdit = nullptr;
+    m_undoJournal = nullptr;
+
+    const QString fileName = directory + QStringLiteral("/%1-%2.txt")
+                                             .arg(document.name)
+                                             .arg(document.lines);
+    writeFile(fileName, text);
+
+    WolfEdit::Tab *tab = nullptr;
+    measure(
+        "open", m_iterations, [] {},
+        [&] {
+          tab = window.addTab(fileName);
+          while (tab->isLoading()) {
+            QApplication::processEvents(QEventLoop::WaitForMoreEvents);
+          }
+        },
+        [&] { delete tab; });
+
+    QString decoded;
+    measure("read", m_iterations, [] {},
+            [&] { WolfEdit::FileLoader::read(fileName, &decoded); },
+            [&] { decoded.clear(); });
+
+    tab = window.addTab(fileName);
+    while (tab->isLoading()) {
+      QApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    measure("save", m_iterations, [] {},
+            [&] {
+              tab->save();
+              tab->waitForSave();
+            },
+            [] {});
+    delete tab;
+  }
+
+private:
+  void keys(const QString &input) {
+    m_handler->handleInput(input);
+    QApplication::processEvents();
+  }
+
+  void reset(const QString &text) {
+    m_textEdit->setPlainText(text);
+    m_undoJournal->clear();
+    QApplication::processEvents();
+  }
+
+  static void writeFile(const QString &fileName, const QString &text) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+      qFatal("Cannot write \"%s\"", qPrintable(fileName));
+    }
+    file.write(text.toUtf8());
+  }
+
+  void measure(const QString &name, int iterations,
+               const std::function<void()> &setUp,
+               const std::function<void()> &operation,
+               const std::function<void()> &tearDown) {
+    if (!m_filter.match(name).hasMatch()) {
+      return;
+    }
+
+    QVector<double> samples;
+    samples.reserve(iterations);
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+      setUp();
+      timer.start();
+      operation();
+      samples.append(timer.nsecsElapsed() / 1e6);
+      tearDown();
+    }
+
+    const Statistics s = statistics(samples);
+    qInfo().noquote() << QStringLiteral("  %1: p50 %2 ms, p99 %3 ms")
+                             .arg(name, -12)
+                             .arg(s.p50, 0, 'f', 3)
+                             .arg(s.p99, 0, 'f', 3);
+    m_results.append(QJsonObject{
+        {"name", name},
+        {"document", m_document.name},
+        {"lines", m_lineCount},
+        {"iterations", iterations},
+        {"unit", "ms"},
+        {"min", s.min},
+        {"mean", s.mean},
+        {"p50", s.p50},
+        {"p90", s.p90},
+        {"p99", s.p99},
+        {"max", s.max},
+    });
+  }
+
+  int m_iterations;
+  QRegularExpression m_filter;
+  QJsonArray m_results;
+  Document m_document;
+  int m_lineCount = 0;
+  FakeVim::Internal::FakeVimHandler *m_handler = nullptr;
+  QPlainTextEdit *m_textEdit = nullptr;
+  FakeVim::Internal::UndoJournal *m_undoJournal = nullptr;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  // Run without a display unless a platform was requested explicitly.
+  if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+
+  QApplication app(argc, argv);
+  QApplication::setApplicationName("wolfedit_bench");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      "Measures editing operations on large synthetic documents.");
+  parser.addHelpOption();
+  parser.addOption({"lines", "Comma-separated document sizes in lines.",
+                    "sizes", "10000,100000,1000000"});
+  parser.addOption({"documents",
+                    "Comma-separated document variants (code, short, long).",
+                    "variants", "code,short,long"});
+  parser.addOption({"iterations", "Samples per operation.", "count", "10"});
+  parser.addOption(
+      {"filter", "Run only operations matching the pattern.", "regexp", "."});
+  parser.addOption({"label", "Label stored with the results, e.g. a commit.",
+                    "label"});
+  parser.addOption(
+      {"output", "Write JSON results to a file instead of stdout.", "file"});
+  parser.process(app);
+
+  const QMap<QString, Variant> variants = {
+      {"code", Variant::Code},
+      {"short", Variant::Short},
+      {"long", Variant::Long},
+  };
+
+  QList<Document> documents;
+  for (const QString &lines : parser.value("lines").split(',')) {
+    bool ok = false;
+    const int count = lines.toInt(&ok);
+    if (!ok || count <= 0) {
+      qCritical().noquote() << "Invalid document size:" << lines;
+      return 2;
+    }
+    for (const QString &name : parser.value("documents").split(',')) {
+      if (!variants.contains(name)) {
+        qCritical().noquote() << "Unknown document variant:" << name;
+        return 2;
+      }
+      documents.append({variants[name], name, count});
+    }
+  }
+
+  const int iterations = qMax(1, parser.value("iterations").toInt());
+  const QRegularExpression filter(parser.value("filter"));
+  if (!filter.isValid()) {
+    qCritical().noquote() << "Invalid filter:" << filter.errorString();
+    return 2;
+  }
+
+  // Keep user's vimrc from affecting the results.
+  QTemporaryDir directory;
+  qputenv("HOME", directory.path().toLocal8Bit());
+
+  Benchmark benchmark(iterations, filter);
+  for (const Document &document : documents) {
+    benchmark.run(document, directory.path());
+  }
+
+  const QJsonObject output{
+      {"label", parser.value("label")},
+      {"timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+      {"qt", qVersion()},
+      {"results", benchmark.results()},
+  };
+  const QByteArray json = QJsonDocument(output).toJson();
+
+  if (parser.isSet("output")) {
+    QFile file(parser.value("output"));
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+      qCritical().noquote() << "Cannot write" << file.fileName() << ":"
+                            << file.errorString();
+      return 1;
+    }
+  } else {
+    QTextStream(stdout) << json;
+  }
+
+  return 0;
+}
@@ -1,13 +1,66 @@
-
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
 #include <QObject>
 
+#include <cstring>
+
 #include "src/WolfEdit.h"
+#include "src/batchserver.h"
+
+// Expands wildcards in the file name part of the arguments (shells on Windows
+// don't do that). Arguments without matches are kept so they open as new
+// files.
+static QStringList expandFileArguments(const QStringList &arguments) {
+  QStringList filePaths;
+  for (const QString &argument : arguments) {
+    const QFileInfo info(argument);
+    const QString pattern = info.fileName();
+    if (!pattern.contains(QLatin1Char('*')) &&
+        !pattern.contains(QLatin1Char('?')) &&
+        !pattern.contains(QLatin1Char('['))) {
+      filePaths.append(argument);
+      continue;
+    }
+    const QDir dir = info.dir();
+    const QStringList matches =
+        dir.entryList({pattern}, QDir::Files, QDir::Name);
+    if (matches.isEmpty()) {
+      filePaths.append(argument);
+    }
+    for (const QString &match : matches) {
+      filePaths.append(dir.filePath(match));
+    }
+  }
+  return filePaths;
+}
 
 int main(int argc, char *argv[]) {
+  // Batch mode doesn't show a window, so it doesn't need a window system.
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--batch") == 0 &&
+        !qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+      qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+  }
+
   QApplication app(argc, argv);
 
-  WolfEdit::WolfEdit *editor = new WolfEdit::WolfEdit();
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  const QCommandLineOption batchOption(
+      "batch", "Run Ex commands on files requested on stdin (see wolfedit.py).");
+  parser.addOption(batchOption);
+  parser.addPositionalArgument("files", "Files to open.", "[files...]");
+  parser.process(app);
+
+  if (parser.isSet(batchOption)) {
+    return WolfEdit::BatchServer().exec();
+  }
+
+  WolfEdit::WolfEdit *editor =
+      new WolfEdit::WolfEdit(expandFileArguments(parser.positionalArguments()));
   editor->show();
 
   return app.exec();
@@ -2,23 +2,39 @@
 
 #include <QAction>
 #include <QCloseEvent>
+#include <QDir>
+#include <QDockWidget>
 #include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QHBoxLayout>
+#include <QListView>
 #include <QMainWindow>
 #include <QMenu>
 #include <QMenuBar>
 #include <QMessageBox>
+#include <QPlainTextEdit>
+#include <QPointer>
+#include <QProgressBar>
+#include <QPushButton>
 #include <QStandardPaths>
 #include <QString>
 #include <QTabWidget>
+#include <QTextBlock>
 #include <QTextEdit>
 #include <QTextStream>
 #include <QVBoxLayout>
 
+#include <fakevim/fakevimactions.h>
 #include <fakevim/fakevimhandler.h>
 
 #include "editor.h"
+#include "fileloader.h"
+#include "filemonitor.h"
+#include "lexer.h"
+#include "projectsearch.h"
+#include "quickfix.h"
+#include "saveengine.h"
 
 #include <iostream>
 
@@ -35,56 +51,444 @@ static const QString ABOUT_TEXT =
 
 static const QString FOOTER_TEXT = "© 2024 Argos Open Technologies, LLC";
 
+// Tab holds only the file path until it is activated for the first time
+// (see materialize()), so that opening many files only pays for the ones that
+// are looked at.
 class Tab : public QWidget {
   Q_OBJECT
 public:
   Tab(QWidget *parent = nullptr) : QWidget(parent) {
-    this->vimEditor = new VimEditor(this);
-    connect(this->vimEditor, &VimEditor::requestSave, this, &Tab::requestSave);
-    connect(this->vimEditor, &VimEditor::requestSaveAndQuit, this,
-            &Tab::requestSaveAndQuit);
-    connect(this->vimEditor, &VimEditor::requestQuit, this, &Tab::requestQuit);
-    this->textEdit = this->vimEditor->textEdit;
-    connect(this->textEdit, &QTextEdit::textChanged, this, &Tab::textModified);
     modified = false;
+    saveEngine = new SaveEngine(this);
+    connect(saveEngine, &SaveEngine::finished, this, &Tab::saveFinished);
     layout = new QVBoxLayout(this);
-    layout->addWidget(this->vimEditor);
     setLayout(layout);
-    this->vimEditor->textEdit->setFocus();
   }
+  ~Tab() override {
+    // The loader restores the undo stack of the document, which is deleted
+    // with the editor before the loader would be.
+    delete loader;
+    setFileMonitor(nullptr);
+  }
+
+  // Watches the file for changes by other programs once it is loaded or
+  // saved.
+  void setFileMonitor(FileMonitor *monitor) {
+    if (fileMonitor) {
+      fileMonitor->unwatch(filePath);
+      disconnect(fileMonitor, nullptr, this, nullptr);
+    }
+    fileMonitor = monitor;
+    if (fileMonitor) {
+      connect(fileMonitor, &FileMonitor::fileChanged, this,
+              &Tab::fileChangedOnDisk);
+      connect(fileMonitor, &FileMonitor::fileRemoved, this,
+              &Tab::fileRemovedOnDisk);
+    }
+  }
+
+  // Creates the editor and starts loading the file if that hasn't been done
+  // yet.
+  void materialize() {
+    if (vimEditor) {
+      return;
+    }
+    vimEditor = new VimEditor(this);
+    connect(vimEditor, &VimEditor::requestSave, this, &Tab::requestSave);
+    connect(vimEditor, &VimEditor::requestSaveAndQuit, this,
+            &Tab::requestSaveAndQuit);
+    connect(vimEditor, &VimEditor::requestQuit, this, &Tab::requestQuit);
+    connect(vimEditor, &VimEditor::requestQuickfix, this,
+            &Tab::requestQuickfix);
+    connect(vimEditor, &VimEditor::requestHasChanges, this, &Tab::hasChanges);
+    textEdit = vimEditor->textEdit;
+    connect(textEdit, &QPlainTextEdit::textChanged, this, &Tab::textModified);
+    connect(vimEditor->swapFile, &SwapFile::writeError, this,
+            &Tab::swapFileError);
+    layout->addWidget(createLoadBar());
+    layout->addWidget(vimEditor);
+    vimEditor->show();
+    textEdit->setFocus();
+    if (keywordIndex) {
+      vimEditor->setKeywordIndex(keywordIndex);
+    }
+    updateSyntax();
+    if (pendingLoad) {
+      pendingLoad = false;
+      startLoad();
+    } else {
+      applyPendingPosition();
+    }
+  }
+
+  bool isMaterialized() const { return vimEditor != nullptr; }
 
-  VimEditor *vimEditor;
-  QTextEdit *textEdit;
+  VimEditor *vimEditor = nullptr;
+  QPlainTextEdit *textEdit = nullptr;
+  // Keywords of all tabs for completion, owned by the tab widget.
+  FakeVim::Internal::KeywordIndex *keywordIndex = nullptr;
+  QPointer<FileMonitor> fileMonitor;
   QString filePath;
   QVBoxLayout *layout;
   std::atomic<bool> modified;
+  FileLoader *loader = nullptr;
+  SaveEngine *saveEngine;
+  // Fingerprint of the text last loaded or saved. The tab is modified while
+  // the text differs, so undoing all changes makes it unmodified again.
+  Fingerprint savedFingerprint;
+  // Encoding and line endings the file was loaded in and is written back in.
+  FileFormat fileFormat;
+  // Set if loading was cancelled and the buffer only holds part of the file.
+  bool partial = false;
+  // Set if the file should be loaded once the tab is materialized.
+  bool pendingLoad = false;
+  // Cursor position (1-based line) to go to once the file is loaded.
+  int pendingLine = 0;
+  int pendingColumn = 0;
   QString getFilePath() const { return filePath; }
-  void setFilePath(const QString &filePath) { this->filePath = filePath; }
+  void setFilePath(const QString &filePath) {
+    if (fileMonitor && filePath != this->filePath) {
+      fileMonitor->unwatch(this->filePath);
+    }
+    this->filePath = filePath;
+    updateSyntax();
+  }
   bool isModified() const { return modified; }
-  void setModified(bool modified) { this->modified = modified; }
+  void setModified(bool modified) {
+    if (!modified && vimEditor) {
+      savedFingerprint = vimEditor->buffer->fingerprint();
+    }
+    this->modified = modified;
+  }
   bool unsavedChanges() const { return isModified(); }
+  // O(1): modified is updated from fingerprints on each edit, and the file
+  // monitor reports when the file on disk changes.
+  void hasChanges(const QString &fileName, bool *changed) const {
+    *changed = fileName != filePath || isModified();
+  }
+  bool isLoading() const { return loader && loader->isRunning(); }
+  bool isPartial() const { return partial; }
+  void setPartial(bool partial) { this->partial = partial; }
+
+  // Loads the file in the background. The first screen is shown as soon as it
+  // is decoded, the rest of the file is appended while the user can already
+  // move around and edit. Tabs that were not shown yet only remember the file.
+  void load(const QString &filePath) {
+    cancelLoad();
+    this->filePath = filePath;
+    partial = false;
+    if (!vimEditor) {
+      pendingLoad = true;
+      return;
+    }
+    updateSyntax();
+    startLoad();
+  }
 
+  void cancelLoad() {
+    if (loader) {
+      loader->cancel();
+    }
+  }
+
+  // Starts writing a snapshot of the buffer in the background. The tab is
+  // marked unmodified once the write has completed.
   bool save() {
-    if (filePath.isEmpty()) {
+    if (filePath.isEmpty() || !vimEditor || isLoading() || partial) {
       return false;
     }
-    QFile file(filePath);
-    if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-      QTextStream out(&file);
-      out << textEdit->toPlainText();
-      file.close();
-      return true;
+    // The undo file is written by the save worker, from history taken
+    // together with the snapshot.
+    saveEngine->save(filePath, vimEditor->buffer->snapshot(), fileFormat,
+                     undoFilePath(), vimEditor->undoJournal->history());
+    return true;
+  }
+
+  // Undo file for the current file with 'undofile' set. Like in Vim, the path
+  // of the file with '/' replaced by '%' in 'undodir'.
+  QString undoFilePath() const {
+    using namespace FakeVim::Internal;
+    if (filePath.isEmpty() || !fakeVimSettings()->undoFile.value()) {
+      return QString();
+    }
+    QString dir = fakeVimSettings()->undoDir.value();
+    if (dir.isEmpty()) {
+      dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) +
+            QLatin1String("/undo");
     }
-    return false;
+    QString name = QFileInfo(filePath).absoluteFilePath();
+    name.replace(QLatin1Char('/'), QLatin1Char('%'));
+    return dir + QLatin1Char('/') + name;
   }
 
+  // Moves the cursor to a 1-based line and 0-based column, once the file is
+  // loaded if that is still in progress.
+  void gotoPosition(int line, int column) {
+    pendingLine = line;
+    pendingColumn = column;
+    if (vimEditor && !isLoading()) {
+      applyPendingPosition();
+    }
+  }
+
+  bool isSaving() const { return saveEngine->isSaving(); }
+  void waitForSave() { saveEngine->waitForFinished(); }
+
 signals:
   void requestSave();
   void requestSaveAndQuit();
   void requestQuit();
+  void requestQuickfix(const FakeVim::Internal::ExCommand &cmd);
 
 private slots:
-  void textModified() { this->modified = true; }
+  void textModified() {
+    if (loader && loader->isInserting()) {
+      return;
+    }
+    modified = vimEditor->buffer->fingerprint() != savedFingerprint;
+  }
+
+  void saveFinished(const SaveEngine::Result &result) {
+    using namespace FakeVim::Internal;
+    if (!result.ok) {
+      vimEditor->handler->showMessage(
+          MessageError, tr("\"%1\" E212: Can't open file for writing: %2")
+                            .arg(result.filePath, result.error));
+      return;
+    }
+    if (result.filePath == filePath) {
+      savedFingerprint = result.fingerprint;
+      fileFormat = result.format;
+      modified = vimEditor->buffer->fingerprint() != savedFingerprint;
+      if (fileMonitor) {
+        fileMonitor->watch(filePath, result.fingerprint);
+      }
+      restartSwapFile();
+    }
+    QString tags = result.existed ? QString() : tr("[New] ");
+    if (result.converted) {
+      tags += tr("[converted] ");
+    }
+    tags += result.format.tags();
+    vimEditor->handler->showMessage(MessageInfo,
+                                    tr("\"%1\" %2%3L, %4B written")
+                                        .arg(result.filePath, tags)
+                                        .arg(result.lines)
+                                        .arg(result.bytes));
+    if (!result.undoError.isEmpty()) {
+      vimEditor->handler->showMessage(
+          MessageError, tr("E829: Cannot write undo file %1: %2")
+                            .arg(undoFilePath(), result.undoError));
+    }
+  }
+
+  // Like Vim with 'autoread', an unmodified buffer is reloaded; otherwise the
+  // user is asked whether to reload (W12).
+  void fileChangedOnDisk(const QString &path) {
+    if (path != filePath || !vimEditor || isSaving() || isLoading()) {
+      return;
+    }
+    if (isModified() &&
+        QMessageBox::warning(
+            this, tr("File Changed"),
+            tr("W12: Warning: File \"%1\" has changed and the buffer was "
+               "changed in WolfEdit as well. Load the file?")
+                .arg(filePath),
+            QMessageBox::Yes | QMessageBox::No,
+            QMessageBox::No) != QMessageBox::Yes) {
+      return;
+    }
+    reload();
+  }
+
+  void fileRemovedOnDisk(const QString &path) {
+    using namespace FakeVim::Internal;
+    if (path != filePath || !vimEditor || isSaving()) {
+      return;
+    }
+    // Nothing on disk has this text any more.
+    savedFingerprint.length = -1;
+    modified = true;
+    vimEditor->handler->showMessage(
+        MessageError,
+        tr("E211: File \"%1\" no longer available").arg(filePath));
+  }
+
+  void swapFileError(const QString &message) {
+    using namespace FakeVim::Internal;
+    vimEditor->handler->showMessage(
+        MessageError, tr("E297: Write error in swap file: %1").arg(message));
+  }
+
+  void loadProgress(qint64 bytesLoaded, qint64 bytesTotal) {
+    loadProgressBar->setValue(
+        bytesTotal > 0 ? int(bytesLoaded * 100 / bytesTotal) : 100);
+  }
+
+  void loadFinished(bool completed) {
+    loadBar->hide();
+    partial = !completed;
+    fileFormat = loader->format();
+    loader->deleteLater();
+    loader = nullptr;
+    vimEditor->undoJournal->setRecording(true);
+    if (completed) {
+      savedFingerprint = vimEditor->buffer->fingerprint();
+      modified = false;
+      if (fileMonitor) {
+        fileMonitor->watch(filePath, savedFingerprint);
+      }
+      readUndoFile();
+      openSwapFile();
+    }
+    applyPendingPosition();
+  }
+
+private:
+  QWidget *loadBar;
+  QProgressBar *loadProgressBar;
+
+  // Loads the file again and keeps the cursor on the same line.
+  void reload() {
+    const QTextCursor cursor = textEdit->textCursor();
+    pendingLine = cursor.blockNumber() + 1;
+    pendingColumn = cursor.positionInBlock();
+    load(filePath);
+  }
+
+  void startLoad() {
+    vimEditor->undoJournal->setRecording(false);
+    vimEditor->swapFile->stop();
+    loader = new FileLoader(filePath, textEdit->document(), this);
+    connect(loader, &FileLoader::progress, this, &Tab::loadProgress);
+    connect(loader, &FileLoader::finished, this, &Tab::loadFinished);
+    loadProgressBar->setValue(0);
+    loadBar->show();
+    loader->start();
+  }
+
+  // Highlights the syntax of the language of the file (by its extension).
+  void updateSyntax() {
+    if (vimEditor) {
+      vimEditor->syntaxHighlighter->setLexer(Lexer::forFileName(filePath));
+    }
+  }
+
+  void applyPendingPosition() {
+    if (pendingLine <= 0) {
+      return;
+    }
+    const QTextBlock block =
+        textEdit->document()->findBlockByNumber(pendingLine - 1);
+    if (block.isValid()) {
+      vimEditor->handler->setTextCursorPosition(
+          block.position() + qMin(pendingColumn, block.length() - 1));
+      textEdit->ensureCursorVisible();
+    }
+    pendingLine = 0;
+  }
+
+  // Like Vim, offers to recover the changes in a swap file left behind by a
+  // crash or another session (E325) and then starts a new swap file. A swap
+  // file that is kept gets a new one next to it (.swo, .swn, ...).
+  void openSwapFile() {
+    using namespace FakeVim::Internal;
+    SwapFile *swapFile = vimEditor->swapFile;
+    QString swapPath = SwapFile::swapFilePath(filePath);
+    if (swapPath.isEmpty()) {
+      return;
+    }
+
+    SwapFile::Info info;
+    QString error;
+    if (QFileInfo::exists(swapPath) &&
+        SwapFile::readInfo(swapPath, &info, &error)) {
+      QString text = tr("Found a swap file for \"%1\" (modified %2).")
+                         .arg(filePath, info.modified.toString());
+      if (SwapFile::isOwnerRunning(info)) {
+        text += QLatin1Char(' ') +
+                tr("Process %1 that wrote it is still running; the file may "
+                   "be edited in another window.")
+                    .arg(info.pid);
+      }
+      QMessageBox box(QMessageBox::Warning, tr("E325: ATTENTION"), text,
+                      QMessageBox::NoButton, this);
+      QPushButton *recoverButton =
+          box.addButton(tr("&Recover"), QMessageBox::AcceptRole);
+      QPushButton *deleteButton =
+          box.addButton(tr("&Delete it"), QMessageBox::DestructiveRole);
+      box.addButton(tr("&Edit anyway"), QMessageBox::RejectRole);
+      box.exec();
+      if (box.clickedButton() == recoverButton) {
+        if (!SwapFile::recover(swapPath, vimEditor->buffer, &error)) {
+          // Keep the swap file for another attempt.
+          vimEditor->handler->showMessage(
+              MessageError,
+              tr("E308: Cannot recover from %1: %2").arg(swapPath, error));
+          swapPath = SwapFile::unusedSwapFilePath(swapPath);
+        } else {
+          vimEditor->handler->showMessage(
+              MessageInfo,
+              tr("Recovery completed. Write the buffer to keep the changes."));
+        }
+      } else if (box.clickedButton() != deleteButton) {
+        // Leave the swap file of the other session alone.
+        swapPath = SwapFile::unusedSwapFilePath(swapPath);
+      }
+    }
+
+    swapFile->start(swapPath, filePath);
+    if (isModified()) {
+      // The recovered text is not on disk.
+      swapFile->compact();
+    }
+  }
+
+  // Starts the swap file over from the text that was just saved. It keeps its
+  // name unless the file was saved under another name.
+  void restartSwapFile() {
+    SwapFile *swapFile = vimEditor->swapFile;
+    const QString swapPath = SwapFile::swapFilePath(filePath);
+    if (swapPath.isEmpty()) {
+      swapFile->stop();
+      return;
+    }
+    if (swapFile->isActive() && swapFile->filePath() == filePath) {
+      swapFile->restart();
+    } else {
+      swapFile->stop();
+      swapFile->start(SwapFile::unusedSwapFilePath(swapPath), filePath);
+    }
+    if (isModified()) {
+      // Changed again while it was being saved.
+      swapFile->compact();
+    }
+  }
+
+  // A missing or outdated undo file is silently ignored.
+  void readUndoFile() {
+    const QString undoFile = undoFilePath();
+    if (undoFile.isEmpty() || !QFileInfo::exists(undoFile)) {
+      return;
+    }
+    QString error;
+    vimEditor->undoJournal->load(undoFile, &error);
+  }
+
+  QWidget *createLoadBar() {
+    loadBar = new QWidget(this);
+    QHBoxLayout *loadLayout = new QHBoxLayout(loadBar);
+    loadLayout->setContentsMargins(0, 0, 0, 0);
+    loadProgressBar = new QProgressBar(loadBar);
+    loadProgressBar->setRange(0, 100);
+    loadProgressBar->setFormat(tr("Loading %p%"));
+    QPushButton *cancelButton = new QPushButton(tr("Cancel"), loadBar);
+    connect(cancelButton, &QPushButton::clicked, this, &Tab::cancelLoad);
+    loadLayout->addWidget(loadProgressBar);
+    loadLayout->addWidget(cancelButton);
+    loadBar->hide();
+    return loadBar;
+  }
 };
 
 class TabWidget : public QTabWidget {
@@ -92,30 +496,49 @@ class TabWidget : public QTabWidget {
 public:
   TabWidget(QWidget *parent = nullptr) : QTabWidget(parent) {
     setTabsClosable(true);
+    keywordIndex = new FakeVim::Internal::KeywordIndex(this);
+    fileMonitor = new FileMonitor(this);
   }
   Tab *getCurrentTab() const { return qobject_cast<Tab *>(currentWidget()); }
   int getCurrentTabIndex() const { return currentIndex(); }
   Tab *getTab(int index) const { return qobject_cast<Tab *>(widget(index)); }
 
+  FakeVim::Internal::KeywordIndex *keywordIndex;
+  FileMonitor *fileMonitor;
+
 signals:
   void requestSave();
   void requestSaveAndQuit();
   void requestQuit();
+  void requestQuickfix(const FakeVim::Internal::ExCommand &cmd);
 };
 
 class WolfEdit : public QMainWindow {
   Q_OBJECT
 public:
-  WolfEdit(QWidget *parent = nullptr) : QMainWindow(parent) {
+  WolfEdit(QWidget *parent = nullptr) : WolfEdit(QStringList(), parent) {}
+
+  // Opens the files as tabs or an empty tab if there are none.
+  explicit WolfEdit(const QStringList &filePaths, QWidget *parent = nullptr)
+      : QMainWindow(parent) {
     tabWidget = new TabWidget(this);
     setCentralWidget(tabWidget);
+    connect(tabWidget, &TabWidget::currentChanged, this,
+            &WolfEdit::materializeTab);
     connect(tabWidget, &TabWidget::tabCloseRequested, this,
             &WolfEdit::closeTab);
     connect(tabWidget, &TabWidget::requestSave, this, &WolfEdit::saveFile);
     connect(tabWidget, &TabWidget::requestSaveAndQuit, this,
             &WolfEdit::saveAndQuit);
     connect(tabWidget, &TabWidget::requestQuit, this, &WolfEdit::quit);
-    addEmptyTab();
+    connect(tabWidget, &TabWidget::requestQuickfix, this,
+            &WolfEdit::handleQuickfixCommand);
+    createQuickfix();
+    if (filePaths.isEmpty()) {
+      addEmptyTab();
+    } else {
+      openFiles(filePaths);
+    }
     createMenu();
     setWindowTitle(APP_NAME);
     resize(800, 600);
@@ -139,6 +562,13 @@ public slots:
     if (tabWidget->count() > 0) {
       // TODO: Saving probably shouldn't necessarily be tied to the current tab
       Tab *currentTab = tabWidget->getCurrentTab();
+      if (currentTab && currentTab->isPartial()) {
+        QMessageBox::warning(
+            this, tr("Partially Loaded File"),
+            tr("Loading of this file was cancelled. Use Save As to write the "
+               "loaded part to a different file."));
+        return;
+      }
       if (currentTab) {
         QString currentFilePath = tabWidget->getCurrentTab()->getFilePath();
 
@@ -158,7 +588,6 @@ public slots:
         }
 
         currentTab->save();
-        currentTab->setModified(false);
       }
     }
   }
@@ -169,10 +598,16 @@ public slots:
   }
 
   void quit() {
-    // Iterate through all tabs and check for unsaved changes
-    for (int i = 0; i < tabWidget->count(); i++) {
+    // Iterate through all tabs and check for unsaved changes. Closed tabs
+    // remove their swap files. Only tabs with unsaved changes are shown, so
+    // tabs that were never shown are not loaded just to be closed.
+    closingTabs = true;
+    for (int i = tabWidget->count() - 1; i >= 0; i--) {
       closeTab(i);
     }
+    closingTabs = false;
+    // Some tabs are left if closing was cancelled.
+    materializeTab(tabWidget->currentIndex());
   }
 
   void saveFileAs() {
@@ -188,8 +623,8 @@ public slots:
         tabWidget->setTabText(tabWidget->currentIndex(),
                               QFileInfo(newFilePath).fileName());
         tabWidget->setTabToolTip(tabWidget->currentIndex(), newFilePath);
+        currentTab->setPartial(false);
         currentTab->save();
-        currentTab->setModified(false);
       }
     }
   }
@@ -199,8 +634,41 @@ public slots:
     addTab("");
   }
 
+  // Adds a tab for the file. The file is read once the tab is activated.
+  Tab *addTab(const QString &filePath, bool activate = true) {
+    Tab *tab = createTab();
+    tab->setFilePath(filePath);
+    if (!filePath.isEmpty() && QFileInfo::exists(filePath)) {
+      tab->load(filePath);
+    }
+    int tabIndex = tabWidget->addTab(tab, QFileInfo(filePath).fileName());
+    tabWidget->setTabToolTip(tabIndex, filePath);
+    if (activate) {
+      tabWidget->setCurrentIndex(tabIndex);
+    }
+    connectTab(tab);
+    return tab;
+  }
+
+  // Opens files in background tabs and activates the first one.
+  void openFiles(const QStringList &filePaths) {
+    Tab *first = nullptr;
+    for (const QString &filePath : filePaths) {
+      Tab *tab = addTab(filePath, false);
+      if (!first) {
+        first = tab;
+      }
+    }
+    if (first) {
+      tabWidget->setCurrentWidget(first);
+    }
+  }
+
   void closeTab(int index) {
     Tab *tab = tabWidget->getTab(index);
+    if (tab) {
+      tab->waitForSave();
+    }
     if (tab && tab->isModified()) {
       // Set the current tab to the one with unsaved changes
       tabWidget->setCurrentIndex(index);
@@ -215,24 +683,43 @@ public slots:
       if (button == QMessageBox::Save) {
         // Save the changes and continue closing the tab
         saveFile();
+        tab->waitForSave();
       } else if (button == QMessageBox::Cancel) {
         // Cancel closing the tab
         return;
       }
     }
 
-    // Close the tab
+    // Close the tab. The tab that becomes current is only materialized
+    // once it is clear that it stays open.
+    const bool wasClosingTabs = closingTabs;
+    closingTabs = true;
     tabWidget->removeTab(index);
+    closingTabs = wasClosingTabs;
     delete tab;
 
     // If there are no tabs left close the main window
     if (tabWidget->count() == 0) {
       close();
+    } else if (!closingTabs) {
+      materializeTab(tabWidget->currentIndex());
     }
   }
 
 private:
   TabWidget *tabWidget;
+  // Set while tabs are being closed, so that a tab that becomes current in
+  // between is not loaded.
+  bool closingTabs = false;
+
+  void materializeTab(int index) {
+    if (closingTabs) {
+      return;
+    }
+    if (Tab *tab = tabWidget->getTab(index)) {
+      tab->materialize();
+    }
+  }
 
   void createMenu() {
     QMenu *fileMenu = menuBar()->addMenu(tr("File"));
@@ -265,30 +752,234 @@ private:
                        ABOUT_TEXT + "\n\n" + FOOTER_TEXT);
   }
 
-  void addTab(QString filePath) {
+  void addEmptyTab() {
+    Tab *tab = createTab();
+    int tabIndex = tabWidget->addTab(tab, "");
+    tabWidget->setTabToolTip(tabIndex, "");
+    connectTab(tab);
+  }
+
+  Tab *createTab() {
     Tab *tab = new Tab(this);
-    if (!filePath.isEmpty()) {
-      QFile file(filePath);
-      if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        tab->textEdit->setPlainText(QString::fromUtf8(file.readAll()));
-        file.close();
-      }
-    }
-    int tabIndex = tabWidget->addTab(tab, QFileInfo(filePath).fileName());
-    tabWidget->setTabToolTip(tabIndex, filePath);
-    tabWidget->setCurrentIndex(tabIndex);
-    tabWidget->getTab(tabIndex)->setFilePath(filePath);
+    tab->keywordIndex = tabWidget->keywordIndex;
+    tab->setFileMonitor(tabWidget->fileMonitor);
+    return tab;
+  }
+
+  void connectTab(Tab *tab) {
     connect(tab, &Tab::requestSave, tabWidget, &TabWidget::requestSave);
     connect(tab, &Tab::requestSaveAndQuit, tabWidget,
             &TabWidget::requestSaveAndQuit);
     connect(tab, &Tab::requestQuit, tabWidget, &TabWidget::requestQuit);
+    connect(tab, &Tab::requestQuickfix, tabWidget,
+            &TabWidget::requestQuickfix);
   }
 
-  void addEmptyTab() {
-    Tab *tab = new Tab(this);
-    int tabIndex = tabWidget->addTab(tab, "");
-    tabWidget->setTabToolTip(tabIndex, "");
+  void createQuickfix() {
+    quickfix = new QuickfixList(this);
+    projectSearch = new ProjectSearch(this);
+    connect(projectSearch, &ProjectSearch::matchesFound, this,
+            &WolfEdit::quickfixMatchesFound);
+    connect(projectSearch, &ProjectSearch::finished, this,
+            &WolfEdit::quickfixSearchFinished);
+
+    quickfixView = new QListView(this);
+    quickfixView->setModel(quickfix);
+    quickfixView->setUniformItemSizes(true);
+    quickfixView->setFont(QFont("Monospace"));
+    connect(quickfixView, &QListView::activated, this,
+            [this](const QModelIndex &index) { gotoQuickfix(index.row()); });
+
+    quickfixDock = new QDockWidget(tr("Quickfix List"), this);
+    quickfixDock->setObjectName("quickfix");
+    quickfixDock->setWidget(quickfixView);
+    addDockWidget(Qt::BottomDockWidgetArea, quickfixDock);
+    quickfixDock->hide();
+  }
+
+  void showMessage(FakeVim::Internal::MessageLevel level,
+                   const QString &message) {
+    Tab *tab = tabWidget->getCurrentTab();
+    if (tab && tab->vimEditor) {
+      tab->vimEditor->handler->showMessage(level, message);
+    }
+  }
+
+  // :vim[grep][!] /{pattern}/[g][j] {file} ...
+  // :vim[grep][!] {pattern} {file} ...
+  // :gr[ep][!] {regexp} [{file} ...]
+  // :cope[n]
+  // :ccl[ose]
+  // :cn[ext]
+  // :cp[revious], :cN[ext]
+  // :cc [nr]
+  void handleQuickfixCommand(const FakeVim::Internal::ExCommand &cmd) {
+    using namespace FakeVim::Internal;
+    if (cmd.matches("vim", "vimgrep") || cmd.matches("gr", "grep")) {
+      startSearch(cmd);
+    } else if (cmd.matches("cope", "copen")) {
+      quickfixDock->show();
+    } else if (cmd.matches("ccl", "cclose")) {
+      quickfixDock->hide();
+    } else if (quickfix->count() == 0) {
+      showMessage(MessageError, tr("E42: No Errors"));
+    } else if (cmd.matches("cn", "cnext")) {
+      if (quickfix->current() + 1 >= quickfix->count()) {
+        showMessage(MessageError, tr("E553: No more items"));
+      } else {
+        gotoQuickfix(quickfix->current() + 1);
+      }
+    } else if (cmd.matches("cp", "cprevious") || cmd.matches("cN", "cNext")) {
+      if (quickfix->current() <= 0) {
+        showMessage(MessageError, tr("E553: No more items"));
+      } else {
+        gotoQuickfix(quickfix->current() - 1);
+      }
+    } else {
+      bool ok = false;
+      const int number = cmd.args.trimmed().toInt(&ok);
+      gotoQuickfix(ok ? qBound(1, number, quickfix->count()) - 1
+                      : qMax(0, quickfix->current()));
+    }
   }
+
+  void startSearch(const FakeVim::Internal::ExCommand &cmd) {
+    using namespace FakeVim::Internal;
+    const bool vimPattern = cmd.matches("vim", "vimgrep");
+    QString args = cmd.args.trimmed();
+    QString pattern;
+    QString flags;
+    const QChar delimiter = args.isEmpty() ? QChar() : args.at(0);
+    if (vimPattern && !delimiter.isNull() && !delimiter.isLetterOrNumber() &&
+        delimiter != QLatin1Char('\\') && delimiter != QLatin1Char('"')) {
+      // Pattern ends at the next delimiter not preceded by a backslash.
+      int end = 1;
+      while (end < args.size() && args.at(end) != delimiter) {
+        if (args.at(end) == QLatin1Char('\\')) {
+          ++end;
+        }
+        ++end;
+      }
+      pattern = args.mid(1, end - 1);
+      const int flagsEnd = args.indexOf(QLatin1Char(' '), end);
+      flags = args.mid(end + 1, flagsEnd == -1 ? -1 : flagsEnd - end - 1);
+      args = flagsEnd == -1 ? QString() : args.mid(flagsEnd);
+    } else {
+      pattern = args.section(QLatin1Char(' '), 0, 0, QString::SectionSkipEmpty);
+      args = args.section(QLatin1Char(' '), 1, -1, QString::SectionSkipEmpty);
+    }
+
+    args = args.simplified();
+    QStringList files =
+        args.isEmpty() ? QStringList() : args.split(QLatin1Char(' '));
+    if (pattern.isEmpty()) {
+      showMessage(MessageError, tr("E35: No previous regular expression"));
+      return;
+    }
+    if (files.isEmpty()) {
+      if (vimPattern) {
+        showMessage(MessageError, tr("E683: File name missing or invalid "
+                                     "pattern"));
+        return;
+      }
+      files.append(QStringLiteral("."));
+    }
+
+    ProjectSearch::Query query;
+    if (vimPattern) {
+      const SearchExpression expression =
+          vimPatternToSearchExpression(pattern);
+      query.regExp = expression.regExp;
+      query.literalPrefix = expression.literalPrefix;
+      query.prefixCaseSensitivity = expression.prefixCaseSensitivity;
+    } else {
+      query.regExp.setPattern(pattern);
+      // A pattern without special characters is all literal.
+      if (QRegularExpression::escape(pattern) == pattern) {
+        query.literalPrefix = pattern;
+      }
+    }
+    if (!query.regExp.isValid()) {
+      showMessage(MessageError, tr("E383: Invalid search string: %1")
+                                    .arg(query.regExp.errorString()));
+      return;
+    }
+    query.allMatches = flags.contains(QLatin1Char('g'));
+    jumpToFirstMatch = !flags.contains(QLatin1Char('j'));
+    searchPattern = pattern;
+
+    const QString baseDirectory = QDir::currentPath();
+    quickfix->reset(baseDirectory);
+    projectSearch->start(query, files, baseDirectory);
+    showMessage(MessageInfo, tr("Searching for %1...").arg(pattern));
+  }
+
+  void quickfixMatchesFound(const QVector<ProjectSearch::Match> &matches) {
+    const bool first = quickfix->count() == 0;
+    quickfix->add(matches);
+    if (first && jumpToFirstMatch) {
+      gotoQuickfix(0);
+    }
+  }
+
+  void quickfixSearchFinished(int filesSearched) {
+    using namespace FakeVim::Internal;
+    if (quickfix->count() == 0) {
+      showMessage(MessageError, tr("E480: No match: %1 (%2 files searched)")
+                                    .arg(searchPattern)
+                                    .arg(filesSearched));
+    } else if (quickfix->current() >= 0) {
+      showQuickfixMessage();
+    } else {
+      showMessage(MessageInfo, tr("%1 matches in %2 files searched")
+                                   .arg(quickfix->count())
+                                   .arg(filesSearched));
+    }
+  }
+
+  // Opens the file of the entry (or switches to its tab) and moves the cursor
+  // to the match.
+  void gotoQuickfix(int row) {
+    if (row < 0 || row >= quickfix->count()) {
+      return;
+    }
+    quickfix->setCurrent(row);
+    quickfixView->setCurrentIndex(quickfix->index(row));
+    const QuickfixList::Entry &entry = quickfix->entry(row);
+
+    Tab *target = nullptr;
+    const QString filePath = QFileInfo(entry.filePath).absoluteFilePath();
+    for (int i = 0; i < tabWidget->count() && !target; ++i) {
+      Tab *tab = tabWidget->getTab(i);
+      if (!tab->getFilePath().isEmpty() &&
+          QFileInfo(tab->getFilePath()).absoluteFilePath() == filePath) {
+        target = tab;
+      }
+    }
+    if (target) {
+      tabWidget->setCurrentWidget(target);
+    } else {
+      target = addTab(filePath);
+    }
+    target->gotoPosition(entry.line, entry.column);
+    showQuickfixMessage();
+  }
+
+  void showQuickfixMessage() {
+    using namespace FakeVim::Internal;
+    const int row = quickfix->current();
+    showMessage(MessageInfo, tr("(%1 of %2): %3")
+                                 .arg(row + 1)
+                                 .arg(quickfix->count())
+                                 .arg(quickfix->entry(row).text.trimmed()));
+  }
+
+  QuickfixList *quickfix;
+  ProjectSearch *projectSearch;
+  QListView *quickfixView;
+  QDockWidget *quickfixDock;
+  QString searchPattern;
+  bool jumpToFirstMatch = true;
 };
 
 } // namespace WolfEdit
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "batchserver.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QPlainTextEdit>
+#include <fakevim/fakevimhandler.h>
+
+#include <cstdio>
+#include <memory>
+
+#include "fileloader.h"
+#include "textbuffer.h"
+
+using namespace FakeVim::Internal;
+
+namespace WolfEdit {
+
+BatchServer::BatchServer(QObject *parent) : QObject(parent) {
+  connect(&m_saveEngine, &SaveEngine::finished, this,
+          [this](const SaveEngine::Result &result) { m_saveResult = result; });
+}
+
+int BatchServer::exec() {
+  QFile in;
+  QFile out;
+  if (!in.open(stdin, QIODevice::ReadOnly) ||
+      !out.open(stdout, QIODevice::WriteOnly)) {
+    return 1;
+  }
+
+  for (QByteArray line = in.readLine(); !line.isEmpty();
+       line = in.readLine()) {
+    if (line.trimmed().isEmpty()) {
+      continue;
+    }
+    QJsonParseError error;
+    const QJsonDocument request = QJsonDocument::fromJson(line, &error);
+    QJsonObject response;
+    if (!request.isObject()) {
+      response.insert(QStringLiteral("ok"), false);
+      response.insert(QStringLiteral("error"),
+                      request.isNull() ? error.errorString()
+                                       : QStringLiteral("Expected an object"));
+    } else {
+      response = run(request.object());
+    }
+    out.write(QJsonDocument(response).toJson(QJsonDocument::Compact));
+    out.write("\n");
+    out.flush();
+  }
+  return 0;
+}
+
+QJsonObject BatchServer::run(const QJsonObject &request) {
+  const QString filePath = request.value(QStringLiteral("file")).toString();
+  QString outputPath =
+      request.value(QStringLiteral("output")).toString(filePath);
+
+  QJsonObject response;
+  if (request.contains(QStringLiteral("id"))) {
+    response.insert(QStringLiteral("id"), request.value(QStringLiteral("id")));
+  }
+  response.insert(QStringLiteral("file"), filePath);
+
+  QString text;
+  FileFormat format;
+  if (filePath.isEmpty() || !FileLoader::read(filePath, &text, &format)) {
+    response.insert(QStringLiteral("ok"), false);
+    response.insert(QStringLiteral("error"),
+                    QStringLiteral("Can't open file %1").arg(filePath));
+    return response;
+  }
+
+  // A new editor for every file, so that nothing (undo history, marks)
+  // carries over from the previous one.
+  QPlainTextEdit textEdit;
+  textEdit.setLineWrapMode(QPlainTextEdit::NoWrap);
+  textEdit.setPlainText(text);
+  text.clear();
+  TextBuffer buffer(textEdit.document());
+  const Fingerprint original = buffer.fingerprint();
+
+  QJsonArray errors;
+  bool discard = false;
+  std::unique_ptr<FakeVimHandler> handler(new FakeVimHandler(&textEdit));
+  handler->setCurrentFileName(filePath);
+  handler->commandBufferChanged.connect(
+      [&errors](const QString &message, int, int, int messageLevel) {
+        if (messageLevel == MessageError) {
+          errors.append(message);
+        }
+      });
+  // The file is written once all commands ran, to the file given to the last
+  // ":w {file}" if any.
+  handler->handleExCommandRequested.connect(
+      [&discard, &outputPath, &errors](bool *handled, const ExCommand &cmd) {
+        const bool quit = cmd.matches("q", "quit");
+        if (!cmd.matches("w", "write") && !cmd.matches("up", "update") &&
+            !cmd.matches("x", "xit") && !quit && cmd.cmd != "wq") {
+          return;
+        }
+        *handled = true;
+        discard = cmd.hasBang && quit;
+        const QString args = cmd.args.trimmed();
+        if (quit || args.isEmpty()) {
+          return;
+        }
+        if (args.startsWith('>') || args.startsWith('!')) {
+          errors.append(QStringLiteral("Not supported in batch mode: :%1 %2")
+                            .arg(cmd.cmd, args));
+        } else {
+          outputPath = args;
+        }
+      });
+
+  const QJsonArray commands =
+      request.value(QStringLiteral("commands")).toArray();
+  for (const QJsonValue &command : commands) {
+    handler->handleCommand(command.toString());
+    // There is no event loop to finish a :{range}!{cmd} filter.
+    handler->waitForFilter();
+    handler->enterCommandMode();
+  }
+  handler->disconnectFromEditor();
+
+  const bool modified = buffer.fingerprint() != original;
+  response.insert(QStringLiteral("modified"), modified);
+  response.insert(QStringLiteral("errors"), errors);
+
+  const bool write = request.value(QStringLiteral("write")).toBool(true);
+  if (write && !discard && (modified || outputPath != filePath)) {
+    m_saveResult = SaveEngine::Result();
+    m_saveEngine.save(outputPath, buffer.snapshot(), format);
+    m_saveEngine.waitForFinished();
+    if (!m_saveResult.ok) {
+      response.insert(QStringLiteral("ok"), false);
+      response.insert(QStringLiteral("error"), m_saveResult.error);
+      return response;
+    }
+  }
+
+  response.insert(QStringLiteral("ok"), errors.isEmpty());
+  return response;
+}
+
+} // namespace WolfEdit
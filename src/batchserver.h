@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QObject>
+#include <QStringList>
+
+#include "saveengine.h"
+
+namespace WolfEdit {
+
+// Headless batch editing (WolfEdit --batch), driven by wolfedit.py.
+//
+// Requests are read from stdin, one JSON object per line:
+//   {"id": 1, "file": "a.txt", "commands": ["g/^#/d", "%s/a/b/g"]}
+// and each is answered with one line on stdout once the file is written:
+//   {"id": 1, "file": "a.txt", "ok": true, "modified": true, "errors": []}
+// The commands are Ex commands run by FakeVim as if typed after ':' (use
+// ":normal" for keys); a ":{range}!{cmd}" filter is run to the end before the
+// next command. A modified file is written back, or to "output" or the file
+// of a ":w {file}" if given, unless "write" is false or the commands end with
+// ":q!". It keeps the encoding and line endings it was read with.
+//
+// FakeVim needs an editor widget, so every file gets a QPlainTextEdit that is
+// never shown; with the offscreen platform no window system is needed. The
+// process is kept running between files; wolfedit.py runs one per core to
+// edit files in parallel.
+class BatchServer : public QObject {
+  Q_OBJECT
+
+public:
+  explicit BatchServer(QObject *parent = nullptr);
+
+  // Serves requests until stdin is closed. Returns the exit code.
+  int exec();
+
+  QJsonObject run(const QJsonObject &request);
+
+private:
+  SaveEngine m_saveEngine;
+  SaveEngine::Result m_saveResult;
+};
+
+} // namespace WolfEdit
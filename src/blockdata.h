@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QTextBlock>
+#include <QTextBlockUserData>
+#include <QVector>
+
+#include "lexer.h"
+
+namespace WolfEdit {
+
+// Per-block cache attached to QTextBlock::userData(). The data lives and dies
+// with its block; whoever fills a cache is responsible for invalidating it when
+// the text of the block changes.
+class BlockData : public QTextBlockUserData {
+public:
+  struct Range {
+    int start;
+    int length;
+  };
+
+  // Search matches, relative to the start of the block. Valid only if
+  // searchGeneration matches the generation of the highlighter.
+  int searchGeneration = -1;
+  QVector<Range> searchMatches;
+
+  // Lexer state at the end of the block (-1 if the block was never lexed) and
+  // the tokens of the block. The state is only written by lexing that started
+  // from a known state, so it is what the next block was lexed with.
+  int syntaxState = -1;
+  QVector<Lexer::Token> syntaxTokens;
+  // Set if the tokens are applied as formats to the layout of the block.
+  bool syntaxApplied = false;
+
+  // Returns the data of block, creating it if needed.
+  static BlockData *of(QTextBlock block) {
+    BlockData *data = static_cast<BlockData *>(block.userData());
+    if (!data) {
+      data = new BlockData;
+      block.setUserData(data);
+    }
+    return data;
+  }
+};
+
+} // namespace WolfEdit
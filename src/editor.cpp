@@ -26,6 +26,7 @@ https://github.com/hluk/FakeVim/blob/master/example/editor.cpp
 #include "editor.h"
 #include <fakevim/fakevimactions.h>
 #include <fakevim/fakevimhandler.h>
+#include <fakevim/fakevimperf.h>
 
 #include <QApplication>
 #include <QDebug>
@@ -116,7 +117,16 @@ Proxy *connectSignals(FakeVimHandler *handler, QWidget *editor,
 }
 
 Proxy::Proxy(QWidget *widget, QLabel *statusBar, QObject *parent)
-    : QObject(parent), m_widget(widget), statusBar(statusBar) {}
+    : QObject(parent), m_widget(widget), statusBar(statusBar) {
+  if (QPlainTextEdit *editor = qobject_cast<QPlainTextEdit *>(widget)) {
+    m_searchHighlighter = new WolfEdit::SearchHighlighter(editor, this);
+    connect(m_searchHighlighter, &WolfEdit::SearchHighlighter::selectionsChanged,
+            this, [this] {
+              m_searchSelection = m_searchHighlighter->selections();
+              updateExtraSelections();
+            });
+  }
+}
 
 void Proxy::openFile(const QString &fileName) {
   emit handleInput(QString(_(":r %1<CR>")).arg(fileName));
@@ -128,52 +138,9 @@ void Proxy::changeStatusData(const QString &info) {
 }
 
 void Proxy::highlightMatches(const QString &pattern) {
-  QTextDocument *doc = nullptr;
-
-  { // in a block so we don't inadvertently use one of them later
-    QPlainTextEdit *plainEditor = qobject_cast<QPlainTextEdit *>(m_widget);
-    QTextEdit *editor = qobject_cast<QTextEdit *>(m_widget);
-    if (editor) {
-      doc = editor->document();
-    } else if (plainEditor) {
-      doc = plainEditor->document();
-    } else {
-      return;
-    }
-  }
-  Q_ASSERT(doc);
-
-  QTextEdit::ExtraSelection selection;
-  selection.format.setBackground(Qt::yellow);
-  selection.format.setForeground(Qt::black);
-
-  // Highlight matches.
-  QRegExp re(pattern);
-  QTextCursor cur = doc->find(re);
-
-  m_searchSelection.clear();
-
-  int a = cur.position();
-  while (!cur.isNull()) {
-    if (cur.hasSelection()) {
-      selection.cursor = cur;
-      m_searchSelection.append(selection);
-    } else {
-      cur.movePosition(QTextCursor::NextCharacter);
-    }
-    cur = doc->find(re, cur);
-    int b = cur.position();
-    if (a == b) {
-      cur.movePosition(QTextCursor::NextCharacter);
-      cur = doc->find(re, cur);
-      b = cur.position();
-      if (a == b)
-        break;
-    }
-    a = b;
+  if (m_searchHighlighter) {
+    m_searchHighlighter->setPattern(pattern);
   }
-
-  updateExtraSelections();
 }
 
 void Proxy::changeStatusMessage(const QString &contents, int cursorPos) {
@@ -188,6 +155,7 @@ void Proxy::changeExtraInformation(const QString &info) {
 }
 
 void Proxy::updateStatusBar() {
+  FAKEVIM_PERF_SCOPE("updateStatusBar");
   int slack = 80 - m_statusMessage.size() - m_statusData.size();
   QString msg =
       m_statusMessage + QString(slack, QLatin1Char(' ')) + m_statusData;
@@ -209,6 +177,8 @@ void Proxy::handleExCommand(bool *handled, const ExCommand &cmd) {
     }
   } else if (wantRun(cmd)) {
     emit requestRun();
+  } else if (wantQuickfix(cmd)) {
+    emit requestQuickfix(cmd);
   } else {
     *handled = false;
     return;
@@ -224,35 +194,32 @@ void Proxy::requestSetBlockSelection(const QTextCursor &tc) {
     return;
   }
 
-  QPalette pal = m_widget->parentWidget() != nullptr
-                     ? m_widget->parentWidget()->palette()
-                     : QApplication::palette();
+  if (m_blockSelection.isNull()) {
+    // Hide the selection of the text cursor; the block is painted by the
+    // editor.
+    QPalette pal = m_widget->palette();
+    pal.setColor(QPalette::Highlight, Qt::transparent);
+    pal.setColor(QPalette::HighlightedText, pal.color(QPalette::Text));
+    m_widget->setPalette(pal);
+  }
 
-  m_blockSelection.clear();
-  m_clearSelection.clear();
-
-  QTextCursor cur = tc;
-
-  QTextEdit::ExtraSelection selection;
-  selection.format.setBackground(pal.color(QPalette::Base));
-  selection.format.setForeground(pal.color(QPalette::Text));
-  selection.cursor = cur;
-  m_clearSelection.append(selection);
-
-  selection.format.setBackground(pal.color(QPalette::Highlight));
-  selection.format.setForeground(pal.color(QPalette::HighlightedText));
-
-  int from = cur.positionInBlock();
-  int to = cur.anchor() - cur.document()->findBlock(cur.anchor()).position();
-  const int min = qMin(cur.position(), cur.anchor());
-  const int max = qMax(cur.position(), cur.anchor());
-  for (QTextBlock block = cur.document()->findBlock(min);
-       block.isValid() && block.position() < max; block = block.next()) {
-    cur.setPosition(block.position() + qMin(from, block.length()));
-    cur.setPosition(block.position() + qMin(to, block.length()),
-                    QTextCursor::KeepAnchor);
-    selection.cursor = cur;
-    m_blockSelection.append(selection);
+  const QTextDocument *doc = tc.document();
+  const QTextBlock anchorBlock = doc->findBlock(tc.anchor());
+  const int from = tc.positionInBlock();
+  const int to = tc.anchor() - anchorBlock.position();
+  const int min = qMin(tc.position(), tc.anchor());
+  const int max = qMax(tc.position(), tc.anchor());
+  m_blockSelection.firstBlock = doc->findBlock(min).blockNumber();
+  m_blockSelection.lastBlock = doc->findBlock(max).blockNumber();
+  m_blockSelection.fromColumn = qMin(from, to);
+  m_blockSelection.toColumn = qMax(from, to);
+  // Like a selection, the block ends in front of the last position.
+  if (max == doc->findBlock(max).position() &&
+      m_blockSelection.lastBlock > m_blockSelection.firstBlock) {
+    --m_blockSelection.lastBlock;
+  }
+  if (Editor *blockEditor = dynamic_cast<Editor *>(m_widget)) {
+    blockEditor->setBlockSelection(m_blockSelection);
   }
 
   if (editor) {
@@ -268,13 +235,6 @@ void Proxy::requestSetBlockSelection(const QTextCursor &tc) {
     connect(plainEditor, &QPlainTextEdit::selectionChanged, this,
             &Proxy::updateBlockSelection);
   }
-
-  QPalette pal2 = m_widget->palette();
-  pal2.setColor(QPalette::Highlight, Qt::transparent);
-  pal2.setColor(QPalette::HighlightedText, Qt::transparent);
-  m_widget->setPalette(pal2);
-
-  updateExtraSelections();
 }
 
 void Proxy::requestDisableBlockSelection() {
@@ -288,8 +248,10 @@ void Proxy::requestDisableBlockSelection() {
                      ? m_widget->parentWidget()->palette()
                      : QApplication::palette();
 
-  m_blockSelection.clear();
-  m_clearSelection.clear();
+  m_blockSelection = BlockSelection();
+  if (Editor *blockEditor = dynamic_cast<Editor *>(m_widget)) {
+    blockEditor->setBlockSelection(m_blockSelection);
+  }
 
   m_widget->setPalette(pal);
 
@@ -300,8 +262,6 @@ void Proxy::requestDisableBlockSelection() {
     disconnect(plainEditor, &QPlainTextEdit::selectionChanged, this,
                &Proxy::updateBlockSelection);
   }
-
-  updateExtraSelections();
 }
 
 void Proxy::updateBlockSelection() {
@@ -316,7 +276,7 @@ void Proxy::updateBlockSelection() {
 }
 
 void Proxy::requestHasBlockSelection(bool *on) {
-  *on = !m_blockSelection.isEmpty();
+  *on = !m_blockSelection.isNull();
 }
 
 void Proxy::indentRegion(int beginBlock, int endBlock, QChar typedChar) {
@@ -391,11 +351,9 @@ void Proxy::updateExtraSelections() {
   QTextEdit *editor = qobject_cast<QTextEdit *>(m_widget);
   QPlainTextEdit *plainEditor = qobject_cast<QPlainTextEdit *>(m_widget);
   if (editor) {
-    editor->setExtraSelections(m_clearSelection + m_searchSelection +
-                               m_blockSelection);
+    editor->setExtraSelections(m_searchSelection);
   } else if (plainEditor) {
-    plainEditor->setExtraSelections(m_clearSelection + m_searchSelection +
-                                    m_blockSelection);
+    plainEditor->setExtraSelections(m_searchSelection);
   }
 }
 
@@ -413,6 +371,13 @@ bool Proxy::wantRun(const ExCommand &cmd) {
   return cmd.matches("run", "run") || cmd.matches("make", "make");
 }
 
+bool Proxy::wantQuickfix(const ExCommand &cmd) {
+  return cmd.matches("vim", "vimgrep") || cmd.matches("gr", "grep") ||
+         cmd.matches("cope", "copen") || cmd.matches("ccl", "cclose") ||
+         cmd.matches("cn", "cnext") || cmd.matches("cp", "cprevious") ||
+         cmd.matches("cN", "cNext") || cmd.cmd == "cc";
+}
+
 void Proxy::cancel(const QString &fileName) {
   if (hasChanges(fileName)) {
     QMessageBox::critical(m_widget, tr("FakeVim Warning"),
@@ -425,15 +390,12 @@ void Proxy::cancel(const QString &fileName) {
 void Proxy::invalidate() { QApplication::quit(); }
 
 bool Proxy::hasChanges(const QString &fileName) {
-  if (fileName.isEmpty() && content().isEmpty())
-    return false;
-
-  QFile f(fileName);
-  if (!f.open(QIODevice::ReadOnly))
-    return true;
-
-  QTextStream ts(&f);
-  return content() != ts.readAll();
+  // The tab compares the fingerprint of the buffer, which is kept up to date
+  // with each edit, with that of the text last loaded or saved. The file is
+  // only read again when the file monitor reports a change on disk.
+  bool changed = true;
+  emit requestHasChanges(fileName, &changed);
+  return changed;
 }
 
 QTextDocument *Proxy::document() const {
@@ -444,5 +406,3 @@ QTextDocument *Proxy::document() const {
     doc = ed->document();
   return doc;
 }
-
-QString Proxy::content() const { return document()->toPlainText(); }
@@ -25,10 +25,23 @@
 #include <QObject>
 #include <QPaintEvent>
 #include <QPainter>
+#include <QPlainTextEdit>
+#include <QResizeEvent>
 #include <QStandardPaths>
+#include <QTextBlock>
 #include <QTextEdit>
+#include <QTextLayout>
+#include <QTimer>
 #include <QVBoxLayout>
+#include <fakevim/fakevimcompletion.h>
 #include <fakevim/fakevimhandler.h>
+#include <fakevim/fakevimperf.h>
+#include <fakevim/fakevimundo.h>
+
+#include "searchhighlighter.h"
+#include "swapfile.h"
+#include "syntaxhighlighter.h"
+#include "textbuffer.h"
 
 class QMainWindow;
 class QTextDocument;
@@ -45,6 +58,25 @@ struct ExCommand;
 } // namespace Internal
 } // namespace FakeVim
 
+// Visual block selection: the columns [fromColumn, toColumn) of the blocks
+// firstBlock to lastBlock. Kept as this descriptor instead of a selection per
+// line, so that its cost doesn't depend on the number of selected lines.
+struct BlockSelection {
+  int firstBlock = -1;
+  int lastBlock = -1;
+  int fromColumn = 0;
+  int toColumn = 0;
+
+  bool isNull() const { return firstBlock < 0; }
+  bool operator==(const BlockSelection &other) const {
+    return firstBlock == other.firstBlock && lastBlock == other.lastBlock &&
+           fromColumn == other.fromColumn && toColumn == other.toColumn;
+  }
+  bool operator!=(const BlockSelection &other) const {
+    return !(*this == other);
+  }
+};
+
 QWidget *createEditorWidget();
 void initHandler(FakeVim::Internal::FakeVimHandler *handler);
 void clearUndoRedo(QWidget *editor);
@@ -67,6 +99,10 @@ signals:
   void requestSaveAndQuit();
   void requestQuit();
   void requestRun();
+  // :vimgrep, :grep and the quickfix list commands
+  void requestQuickfix(const FakeVim::Internal::ExCommand &cmd);
+  // Asks whether the buffer differs from the file (answered by the tab).
+  void requestHasChanges(const QString &fileName, bool *changed);
 
 public slots:
   void changeStatusData(const QString &info);
@@ -90,54 +126,79 @@ private:
   bool wantSave(const FakeVim::Internal::ExCommand &cmd);
   bool wantQuit(const FakeVim::Internal::ExCommand &cmd);
   bool wantRun(const FakeVim::Internal::ExCommand &cmd);
+  bool wantQuickfix(const FakeVim::Internal::ExCommand &cmd);
 
   void invalidate();
   bool hasChanges(const QString &fileName);
 
   QTextDocument *document() const;
-  QString content() const;
 
   QWidget *m_widget;
   QLabel *statusBar;
   QString m_statusMessage;
   QString m_statusData;
 
+  WolfEdit::SearchHighlighter *m_searchHighlighter = nullptr;
   QList<QTextEdit::ExtraSelection> m_searchSelection;
-  QList<QTextEdit::ExtraSelection> m_clearSelection;
-  QList<QTextEdit::ExtraSelection> m_blockSelection;
+  BlockSelection m_blockSelection;
 };
 
-class Editor : public QTextEdit {
+class Editor : public QPlainTextEdit {
 public:
-  explicit Editor(QWidget *parent = nullptr) : QTextEdit(parent) {
-    QTextEdit::setCursorWidth(0);
+  explicit Editor(QWidget *parent = nullptr) : QPlainTextEdit(parent) {
+    QPlainTextEdit::setCursorWidth(0);
+    m_relayoutTimer.setSingleShot(true);
+    m_relayoutTimer.setInterval(RELAYOUT_DELAY);
+    QObject::connect(&m_relayoutTimer, &QTimer::timeout, [this] { relayout(); });
+  }
+
+  // QPlainTextEdit lays out only the visible blocks, but a change of the
+  // width resets the layout of every block in the document. Without
+  // wrapping, the width does not change any line, so while it keeps changing
+  // (e.g. the window is resized with the mouse) only the height is applied
+  // and the reset is done once the width settles. With wrapping the lines
+  // are wrapped again right away. See Notes.md for what is still O(blocks).
+  void resizeEvent(QResizeEvent *e) override {
+    if (e->oldSize().width() == e->size().width() ||
+        !e->oldSize().isValid() ||
+        QPlainTextEdit::lineWrapMode() != QPlainTextEdit::NoWrap) {
+      QPlainTextEdit::resizeEvent(e);
+      return;
+    }
+    QResizeEvent heightOnly(e->size(),
+                            QSize(e->size().width(), e->oldSize().height()));
+    QPlainTextEdit::resizeEvent(&heightOnly);
+    m_relayoutTimer.start();
   }
 
-  void paintEvent(QPaintEvent *e) {
-    QTextEdit::paintEvent(e);
+  void paintEvent(QPaintEvent *e) override {
+    FakeVim::Internal::Perf::recordInputLatency();
+    FAKEVIM_PERF_SCOPE("paint");
+    QPlainTextEdit::paintEvent(e);
+    paintBlockSelection(e->rect());
 
     if (!m_cursorRect.isNull() && e->rect().intersects(m_cursorRect)) {
       QRect rect = m_cursorRect;
       m_cursorRect = QRect();
-      QTextEdit::viewport()->update(rect);
+      QPlainTextEdit::viewport()->update(rect);
     }
 
     // Draw text cursor.
-    QRect rect = QTextEdit::cursorRect();
+    QRect rect = QPlainTextEdit::cursorRect();
     if (e->rect().intersects(rect)) {
-      QPainter painter(QTextEdit::viewport());
+      QPainter painter(QPlainTextEdit::viewport());
 
-      if (QTextEdit::overwriteMode()) {
-        QFontMetrics fm(QTextEdit::font());
-        const int position = QTextEdit::textCursor().position();
-        const QChar c = QTextEdit::document()->characterAt(position);
+      if (QPlainTextEdit::overwriteMode()) {
+        QFontMetrics fm(QPlainTextEdit::font());
+        const int position = QPlainTextEdit::textCursor().position();
+        const QChar c = QPlainTextEdit::document()->characterAt(position);
         rect.setWidth(fm.horizontalAdvance(c));
         painter.setPen(Qt::NoPen);
-        painter.setBrush(QTextEdit::palette().color(QPalette::Base));
+        painter.setBrush(QPlainTextEdit::palette().color(QPalette::Base));
         painter.setCompositionMode(QPainter::CompositionMode_Difference);
       } else {
-        rect.setWidth(QTextEdit::cursorWidth());
-        painter.setPen(QTextEdit::palette().color(QPalette::Text));
+        rect.setWidth(QPlainTextEdit::cursorWidth());
+        painter.setPen(QPlainTextEdit::palette().color(QPalette::Text));
       }
 
       painter.drawRect(rect);
@@ -145,8 +206,87 @@ public:
     }
   }
 
+  // Sets the visual block selection, which is painted for the visible lines
+  // only.
+  void setBlockSelection(const BlockSelection &selection) {
+    if (selection != m_blockSelection) {
+      m_blockSelection = selection;
+      QPlainTextEdit::viewport()->update();
+    }
+  }
+
 private:
+  static const int RELAYOUT_DELAY = 100;
+
+  void relayout() {
+    // An invalid old size makes QPlainTextEdit wrap the lines again.
+    QResizeEvent event(QPlainTextEdit::viewport()->size(), QSize());
+    QPlainTextEdit::resizeEvent(&event);
+    QPlainTextEdit::viewport()->update();
+  }
+
+  void paintBlockSelection(const QRect &rect) {
+    if (m_blockSelection.isNull()) {
+      return;
+    }
+    QTextBlock block = QPlainTextEdit::firstVisibleBlock();
+    if (block.blockNumber() < m_blockSelection.firstBlock) {
+      block = QPlainTextEdit::document()->findBlockByNumber(
+          m_blockSelection.firstBlock);
+    }
+
+    // The palette of the editor has a transparent highlight while a block
+    // is selected.
+    const QPalette pal = QPlainTextEdit::parentWidget() != nullptr
+                             ? QPlainTextEdit::parentWidget()->palette()
+                             : QApplication::palette();
+    QTextLayout::FormatRange range;
+    range.format.setBackground(pal.color(QPalette::Highlight));
+    range.format.setForeground(pal.color(QPalette::HighlightedText));
+
+    QPainter painter(QPlainTextEdit::viewport());
+    const QPointF offset = QPlainTextEdit::contentOffset();
+    for (; block.isValid() && block.blockNumber() <= m_blockSelection.lastBlock;
+         block = block.next()) {
+      if (!block.isVisible()) {
+        continue;
+      }
+      const QRectF geometry =
+          QPlainTextEdit::blockBoundingGeometry(block).translated(offset);
+      if (geometry.top() > rect.bottom()) {
+        break;
+      }
+      const int textLength = block.length() - 1;
+      range.start = qMin(m_blockSelection.fromColumn, textLength);
+      range.length = qMin(m_blockSelection.toColumn, textLength) - range.start;
+      if (geometry.bottom() < rect.top() || range.length <= 0) {
+        continue;
+      }
+
+      // Draw the line again, clipped to the selected part.
+      QTextLayout *layout = block.layout();
+      QRegion clip;
+      for (int i = 0; i < layout->lineCount(); ++i) {
+        const QTextLine line = layout->lineAt(i);
+        const int from = qMax(range.start, line.textStart());
+        const int to = qMin(range.start + range.length,
+                            line.textStart() + line.textLength());
+        if (from < to) {
+          const qreal x1 = line.cursorToX(from);
+          const qreal x2 = line.cursorToX(to);
+          clip += QRectF(qMin(x1, x2), line.y(), qAbs(x2 - x1), line.height())
+                      .translated(geometry.topLeft())
+                      .toAlignedRect();
+        }
+      }
+      painter.setClipRegion(clip & rect);
+      layout->draw(&painter, geometry.topLeft(), {range}, geometry);
+    }
+  }
+
   QRect m_cursorRect;
+  BlockSelection m_blockSelection;
+  QTimer m_relayoutTimer;
 };
 
 class VimEditor : public QWidget {
@@ -155,11 +295,18 @@ class VimEditor : public QWidget {
 public:
   QVBoxLayout *layout;
   FakeVim::Internal::FakeVimHandler *handler;
-  QTextEdit *textEdit;
+  QPlainTextEdit *textEdit;
+  WolfEdit::TextBuffer *buffer;
+  WolfEdit::SyntaxHighlighter *syntaxHighlighter;
+  FakeVim::Internal::UndoJournal *undoJournal;
+  WolfEdit::SwapFile *swapFile;
   QLabel *statusBar;
   VimEditor(QWidget *parent = nullptr) {
     textEdit = new Editor(this);
     textEdit->setCursorWidth(0);
+    buffer = new WolfEdit::TextBuffer(textEdit->document(), this);
+    syntaxHighlighter =
+        new WolfEdit::SyntaxHighlighter(textEdit, buffer, this);
     handler = new FakeVim::Internal::FakeVimHandler(this->textEdit, 0);
     statusBar = new QLabel(this);
     configureFont();
@@ -178,11 +325,15 @@ public:
     connect(proxy, &Proxy::requestSaveAndQuit, this,
             &VimEditor::requestSaveAndQuit);
     connect(proxy, &Proxy::requestQuit, this, &VimEditor::requestQuit);
+    connect(proxy, &Proxy::requestQuickfix, this, &VimEditor::requestQuickfix);
+    connect(proxy, &Proxy::requestHasChanges, this,
+            &VimEditor::requestHasChanges);
 
     // Initialize FakeVimHandler.
     initHandler(handler);
 
-    // Load vimrc if it exists
+    // Load vimrc if it exists. It is parsed and applied once for all tabs
+    // and only again if it changes.
     QString vimrc =
         QStandardPaths::writableLocation(QStandardPaths::HomeLocation)
 #ifdef Q_OS_WIN
@@ -190,9 +341,7 @@ public:
 #else
         + QLatin1String("/.vimrc");
 #endif
-    if (QFile::exists(vimrc)) {
-      handler->handleCommand(QLatin1String("source ") + vimrc);
-    } else {
+    if (!handler->loadConfig(vimrc)) {
       // Set some Vim options.
       handler->handleCommand(QLatin1String("set expandtab"));
       handler->handleCommand(QLatin1String("set shiftwidth=8"));
@@ -204,6 +353,19 @@ public:
     // Clear undo and redo queues.
     clearUndoRedo(textEdit);
 
+    // Keep undo history as deltas of the text buffer instead of the undo
+    // stack of the document.
+    undoJournal = new FakeVim::Internal::UndoJournal(textEdit->document(), this);
+    connect(buffer, &WolfEdit::TextBuffer::edited, undoJournal,
+            &FakeVim::Internal::UndoJournal::record);
+    connect(buffer, &WolfEdit::TextBuffer::reset, undoJournal,
+            &FakeVim::Internal::UndoJournal::clear);
+    handler->setUndoJournal(undoJournal);
+
+    // Journal unsaved changes for recovery after a crash (started by the tab
+    // once the file is loaded).
+    swapFile = new WolfEdit::SwapFile(buffer, this);
+
     // TODO
     const QString fileToEdit = "";
     if (!fileToEdit.isEmpty()) {
@@ -212,10 +374,26 @@ public:
   }
   ~VimEditor() { delete handler; }
 
+  // Completes keywords in insert mode from the index shared by all tabs and
+  // keeps the index up to date with the edits of this buffer.
+  void setKeywordIndex(FakeVim::Internal::KeywordIndex *index) {
+    QTextDocument *document = textEdit->document();
+    handler->setKeywordIndex(index);
+    connect(buffer, &WolfEdit::TextBuffer::edited, index,
+            [index, document](int position, const QString &removed,
+                              const QString &inserted) {
+              index->record(document, position, removed, inserted);
+            });
+    connect(buffer, &WolfEdit::TextBuffer::reset, index,
+            [index, document] { index->resetDocument(document); });
+  }
+
 signals:
   void requestSave();
   void requestSaveAndQuit();
   void requestQuit();
+  void requestQuickfix(const FakeVim::Internal::ExCommand &cmd);
+  void requestHasChanges(const QString &fileName, bool *changed);
 
 private:
   void configureFont() {
@@ -2,7 +2,34 @@ include($$PWD/../fakevim/fakevim.pri)
 
 INCLUDEPATH += $$PWD
 
-SOURCES += $$PWD/editor.cpp
-HEADERS += $$PWD/editor.h
+SOURCES += $$PWD/editor.cpp \
+    $$PWD/batchserver.cpp \
+    $$PWD/fileloader.cpp \
+    $$PWD/filemonitor.cpp \
+    $$PWD/lexer.cpp \
+    $$PWD/piecetable.cpp \
+    $$PWD/projectsearch.cpp \
+    $$PWD/quickfix.cpp \
+    $$PWD/saveengine.cpp \
+    $$PWD/searchhighlighter.cpp \
+    $$PWD/swapfile.cpp \
+    $$PWD/syntaxhighlighter.cpp \
+    $$PWD/textbuffer.cpp \
+    $$PWD/textcodec.cpp
+HEADERS += $$PWD/editor.h \
+    $$PWD/batchserver.h \
+    $$PWD/blockdata.h \
+    $$PWD/fileloader.h \
+    $$PWD/filemonitor.h \
+    $$PWD/lexer.h \
+    $$PWD/piecetable.h \
+    $$PWD/projectsearch.h \
+    $$PWD/quickfix.h \
+    $$PWD/saveengine.h \
+    $$PWD/searchhighlighter.h \
+    $$PWD/swapfile.h \
+    $$PWD/syntaxhighlighter.h \
+    $$PWD/textbuffer.h \
+    $$PWD/textcodec.h
 CONFIG += qt
 QT += widgets
@@ -0,0 +1,204 @@
+#include "fileloader.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QThread>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+namespace WolfEdit {
+
+// The first chunk only has to fill the first screen, so keep it small enough
+// to be laid out within a frame or two. Later chunks are larger to keep the
+// number of document edits down.
+static const qint64 FIRST_CHUNK_SIZE = 64 * 1024;
+static const qint64 CHUNK_SIZE = 1024 * 1024;
+// Reading a file into one string decodes it in one piece, up to the size a
+// QString can hold.
+static const qint64 MAX_CHUNK_SIZE = 512 * 1024 * 1024;
+static const int MAX_PENDING_CHUNKS = 4;
+
+FileLoader::FileLoader(const QString &filePath, QTextDocument *document,
+                       QObject *parent)
+    : QObject(parent), m_filePath(filePath), m_document(document),
+      m_freeSlots(MAX_PENDING_CHUNKS) {}
+
+FileLoader::~FileLoader() {
+  cancel();
+  if (m_worker) {
+    m_worker->wait();
+    delete m_worker;
+  }
+  if (m_running) {
+    m_document->setUndoRedoEnabled(m_undoWasEnabled);
+  }
+}
+
+void FileLoader::start() {
+  if (m_running || m_worker) {
+    return;
+  }
+  m_bytesTotal = QFileInfo(m_filePath).size();
+  m_bytesLoaded = 0;
+  m_running = true;
+
+  // Appending chunks must not end up on the undo stack.
+  m_undoWasEnabled = m_document->isUndoRedoEnabled();
+  m_document->setUndoRedoEnabled(false);
+
+  m_worker = QThread::create([this] { run(); });
+  m_worker->start();
+}
+
+void FileLoader::cancel() {
+  if (!m_cancelled.exchange(true)) {
+    // Wake up the worker if it is waiting for the GUI thread.
+    m_freeSlots.release(MAX_PENDING_CHUNKS);
+  }
+}
+
+bool FileLoader::fingerprint(const QString &filePath,
+                             Fingerprint *fingerprint) {
+  FileFormat format;
+  return decode(filePath, CHUNK_SIZE, CHUNK_SIZE, &format,
+                [fingerprint](const QString &text, qint64, bool first) {
+                  if (first) {
+                    *fingerprint = Fingerprint();
+                  }
+                  fingerprint->append(text);
+                  return true;
+                });
+}
+
+bool FileLoader::read(const QString &filePath, QString *text,
+                      FileFormat *format) {
+  FileFormat detected;
+  text->clear();
+  const bool ok =
+      decode(filePath, MAX_CHUNK_SIZE, MAX_CHUNK_SIZE, &detected,
+             [text](const QString &chunk, qint64, bool first) {
+               if (first) {
+                 // Shares the decoded string; usually it is the whole file.
+                 *text = chunk;
+               } else {
+                 text->append(chunk);
+               }
+               return true;
+             });
+  if (format) {
+    *format = detected;
+  }
+  return ok;
+}
+
+bool FileLoader::decode(
+    const QString &filePath, qint64 firstChunkSize, qint64 chunkSize,
+    FileFormat *format,
+    const std::function<bool(const QString &text, qint64 offset, bool first)>
+        &chunk) {
+  *format = FileFormat();
+  QFile file(filePath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  qint64 size = file.size();
+  uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+  const char *data = reinterpret_cast<const char *>(mapped);
+  QByteArray buffer; // Used only if the file cannot be mapped.
+  if (mapped) {
+#ifdef Q_OS_UNIX
+    madvise(mapped, size_t(size), MADV_SEQUENTIAL);
+#endif
+  } else {
+    // Not a regular file, or empty.
+    buffer = file.readAll();
+    if (file.error() != QFileDevice::NoError) {
+      return false;
+    }
+    data = buffer.constData();
+    size = buffer.size();
+  }
+
+  // The whole mapping is scanned before anything is decoded, so the format
+  // is final and the text shown first is never replaced under the user.
+  *format = FileFormat::detect(data, size);
+  bool ok = true;
+  TextDecoder decoder(*format);
+  qint64 offset = format->bomSize();
+  qint64 length = firstChunkSize;
+  bool first = true;
+  while (offset < size) {
+    // The text is decoded straight from the mapped file into the string that
+    // is handed on.
+    const qint64 end = qMin(size, offset + length);
+    QString text;
+    offset += decoder.decode(data + offset, end - offset, end == size, &text);
+    if (!chunk(text, offset, first)) {
+      ok = false;
+      break;
+    }
+    first = false;
+    length = chunkSize;
+  }
+
+  if (mapped) {
+    file.unmap(mapped);
+  }
+  return ok;
+}
+
+void FileLoader::run() {
+  FileFormat format;
+  const bool ok =
+      decode(m_filePath, FIRST_CHUNK_SIZE, CHUNK_SIZE, &format,
+             [this](const QString &text, qint64 offset, bool first) {
+               m_freeSlots.acquire();
+               if (m_cancelled) {
+                 return false;
+               }
+               QMetaObject::invokeMethod(
+                   this,
+                   [this, text, offset, first] {
+                     appendChunk(text, offset, first);
+                   },
+                   Qt::QueuedConnection);
+               return true;
+             });
+  QMetaObject::invokeMethod(
+      this, [this, ok, format] { finish(ok && !m_cancelled, format); },
+      Qt::QueuedConnection);
+}
+
+void FileLoader::appendChunk(const QString &text, qint64 bytesLoaded,
+                             bool first) {
+  m_inserting = true;
+  if (first) {
+    m_document->setPlainText(text);
+  } else {
+    QTextCursor cursor(m_document);
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(text);
+  }
+  m_inserting = false;
+
+  m_bytesLoaded = bytesLoaded;
+  emit progress(m_bytesLoaded, m_bytesTotal);
+  m_freeSlots.release();
+}
+
+void FileLoader::finish(bool completed, const FileFormat &format) {
+  if (!m_running) {
+    return;
+  }
+  m_running = false;
+  m_format = format;
+  m_document->setUndoRedoEnabled(m_undoWasEnabled);
+  emit finished(completed);
+}
+
+} // namespace WolfEdit
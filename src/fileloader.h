@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QObject>
+#include <QSemaphore>
+#include <QString>
+
+#include <atomic>
+#include <functional>
+
+#include "piecetable.h"
+#include "textcodec.h"
+
+class QTextDocument;
+class QThread;
+
+namespace WolfEdit {
+
+// Streams a file into a QTextDocument without blocking the GUI thread.
+//
+// The file is memory-mapped and decoded on a worker thread, in the encoding
+// detected from its bytes (see FileFormat). Decoded chunks are handed
+// back to the GUI thread and appended to the document one at a time, so the
+// first screen is shown (and editable) while the rest is still loading.
+// The first chunk is kept small so that it can be laid out immediately.
+class FileLoader : public QObject {
+  Q_OBJECT
+
+public:
+  FileLoader(const QString &filePath, QTextDocument *document,
+             QObject *parent = nullptr);
+  ~FileLoader() override;
+
+  void start();
+  void cancel();
+
+  bool isRunning() const { return m_running; }
+  bool wasCancelled() const { return m_cancelled; }
+  // True while the loader itself is modifying the document.
+  bool isInserting() const { return m_inserting; }
+
+  qint64 bytesLoaded() const { return m_bytesLoaded; }
+  qint64 bytesTotal() const { return m_bytesTotal; }
+  // Encoding and line endings of the file, known once loading has finished.
+  FileFormat format() const { return m_format; }
+
+  // Fingerprint of the text the file is loaded as, without keeping the text.
+  // Blocks; returns false if the file cannot be read.
+  static bool fingerprint(const QString &filePath, Fingerprint *fingerprint);
+  // Reads the whole file as it is loaded into a document. Blocks; returns
+  // false if the file cannot be read.
+  static bool read(const QString &filePath, QString *text,
+                   FileFormat *format = nullptr);
+
+signals:
+  void progress(qint64 bytesLoaded, qint64 bytesTotal);
+  // completed is false if loading was cancelled or the file could not be read.
+  void finished(bool completed);
+
+private:
+  // Decodes the file in chunks with normalized line endings. Stops early if
+  // chunk returns false. The offset is the number of bytes read so far. The
+  // format is detected from the whole file before the first chunk.
+  static bool
+  decode(const QString &filePath, qint64 firstChunkSize, qint64 chunkSize,
+         FileFormat *format,
+         const std::function<bool(const QString &text, qint64 offset,
+                                  bool first)> &chunk);
+
+  void run();
+  void appendChunk(const QString &text, qint64 bytesLoaded, bool first);
+  void finish(bool completed, const FileFormat &format);
+
+  QString m_filePath;
+  QTextDocument *m_document;
+  QThread *m_worker = nullptr;
+
+  // Limits the number of decoded chunks waiting for the GUI thread.
+  QSemaphore m_freeSlots;
+
+  std::atomic<bool> m_cancelled{false};
+  bool m_running = false;
+  bool m_inserting = false;
+  bool m_undoWasEnabled = true;
+  qint64 m_bytesLoaded = 0;
+  qint64 m_bytesTotal = 0;
+  FileFormat m_format;
+};
+
+} // namespace WolfEdit
@@ -0,0 +1,117 @@
+#include "filemonitor.h"
+
+#include <QFileInfo>
+#include <QThread>
+
+#include "fileloader.h"
+
+namespace WolfEdit {
+
+// Time to wait for more notifications before the files are checked.
+static const int CHECK_DELAY = 200;
+
+FileMonitor::FileMonitor(QObject *parent) : QObject(parent) {
+  m_checkTimer.setSingleShot(true);
+  m_checkTimer.setInterval(CHECK_DELAY);
+  connect(&m_checkTimer, &QTimer::timeout, this, &FileMonitor::checkPending);
+  connect(&m_watcher, &QFileSystemWatcher::fileChanged, this,
+          &FileMonitor::onFileChanged);
+}
+
+FileMonitor::~FileMonitor() {
+  if (m_worker) {
+    m_worker->wait();
+    delete m_worker;
+  }
+}
+
+void FileMonitor::watch(const QString &filePath,
+                        const Fingerprint &fingerprint) {
+  const QFileInfo info(filePath);
+  Entry &entry = m_entries[filePath];
+  entry.modified = info.lastModified();
+  entry.size = info.size();
+  entry.fingerprint = fingerprint;
+  entry.removed = !info.exists();
+  if (!entry.removed && !m_watcher.files().contains(filePath)) {
+    m_watcher.addPath(filePath);
+  }
+}
+
+void FileMonitor::unwatch(const QString &filePath) {
+  if (m_entries.remove(filePath) > 0) {
+    m_watcher.removePath(filePath);
+    m_pending.removeAll(filePath);
+  }
+}
+
+void FileMonitor::onFileChanged(const QString &filePath) {
+  if (m_entries.contains(filePath) && !m_pending.contains(filePath)) {
+    m_pending.append(filePath);
+  }
+  m_checkTimer.start();
+}
+
+void FileMonitor::checkPending() {
+  while (!m_worker && !m_pending.isEmpty()) {
+    const QString filePath = m_pending.takeFirst();
+    const auto it = m_entries.find(filePath);
+    if (it == m_entries.end()) {
+      continue;
+    }
+
+    const QFileInfo info(filePath);
+    if (!info.exists()) {
+      if (!it->removed) {
+        it->removed = true;
+        emit fileRemoved(filePath);
+      }
+      continue;
+    }
+    // The watch is lost if the file was replaced.
+    if (!m_watcher.files().contains(filePath)) {
+      m_watcher.addPath(filePath);
+    }
+    if (!it->removed && info.lastModified() == it->modified &&
+        info.size() == it->size) {
+      continue;
+    }
+
+    const QDateTime modified = info.lastModified();
+    const qint64 size = info.size();
+    m_worker = QThread::create([this, filePath, modified, size] {
+      Fingerprint fingerprint;
+      const bool ok = FileLoader::fingerprint(filePath, &fingerprint);
+      QMetaObject::invokeMethod(
+          this,
+          [this, filePath, modified, size, ok, fingerprint] {
+            checkFinished(filePath, modified, size, ok, fingerprint);
+          },
+          Qt::QueuedConnection);
+    });
+    m_worker->start();
+  }
+}
+
+void FileMonitor::checkFinished(const QString &filePath,
+                                const QDateTime &modified, qint64 size, bool ok,
+                                const Fingerprint &fingerprint) {
+  m_worker->wait();
+  delete m_worker;
+  m_worker = nullptr;
+
+  const auto it = m_entries.find(filePath);
+  if (ok && it != m_entries.end()) {
+    it->modified = modified;
+    it->size = size;
+    it->removed = false;
+    // Report a change only once.
+    if (fingerprint != it->fingerprint) {
+      it->fingerprint = fingerprint;
+      emit fileChanged(filePath);
+    }
+  }
+  checkPending();
+}
+
+} // namespace WolfEdit
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QDateTime>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+
+#include "piecetable.h"
+
+class QThread;
+
+namespace WolfEdit {
+
+// Notices when open files are changed by other programs.
+//
+// Files are watched with QFileSystemWatcher (inotify on Linux). Notifications
+// are collected for a moment, since tools often write a file in several steps
+// or replace it by renaming another one over it. A file whose modification
+// time and size are unchanged is left alone; otherwise its text is
+// fingerprinted on a worker thread and compared with the text it was last
+// loaded or saved with, so rewriting a file with the same contents (e.g. by a
+// code generator) is not reported.
+class FileMonitor : public QObject {
+  Q_OBJECT
+
+public:
+  explicit FileMonitor(QObject *parent = nullptr);
+  ~FileMonitor() override;
+
+  // Starts watching the file, which was just loaded or saved with the text of
+  // fingerprint. Watching it again updates the fingerprint.
+  void watch(const QString &filePath, const Fingerprint &fingerprint);
+  void unwatch(const QString &filePath);
+
+signals:
+  // The text of the file differs from the text it was loaded or saved with.
+  void fileChanged(const QString &filePath);
+  void fileRemoved(const QString &filePath);
+
+private:
+  struct Entry {
+    QDateTime modified;
+    qint64 size = -1;
+    Fingerprint fingerprint;
+    bool removed = false;
+  };
+
+  void onFileChanged(const QString &filePath);
+  void checkPending();
+  void checkFinished(const QString &filePath, const QDateTime &modified,
+                     qint64 size, bool ok, const Fingerprint &fingerprint);
+
+  QFileSystemWatcher m_watcher;
+  QHash<QString, Entry> m_entries;
+  QStringList m_pending;
+  QTimer m_checkTimer;
+  // Fingerprints one file at a time.
+  QThread *m_worker = nullptr;
+};
+
+} // namespace WolfEdit
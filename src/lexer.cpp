@@ -0,0 +1,406 @@
+#include "lexer.h"
+
+#include <iterator>
+#include <vector>
+
+namespace WolfEdit {
+
+// Table describing a language. Lists are separated by spaces.
+struct LanguageDefinition {
+  struct String {
+    const char *delimiter;
+    bool multiLine;
+    bool escapes;
+  };
+
+  const char *names;
+  // "*.ext" or a file name.
+  const char *patterns;
+  const char *keywords;
+  const char *types;
+  const char *lineComment;
+  // The line comment starts only at the beginning of a word (e.g. '#' in
+  // shell scripts).
+  bool lineCommentAfterSpace;
+  const char *blockCommentStart;
+  const char *blockCommentEnd;
+  // Checked in order, so longer delimiters have to come first.
+  String strings[4];
+  // '#' directives at the start of a line.
+  bool preprocessor;
+  // $name, ${name} and $1.
+  bool variables;
+};
+
+namespace {
+
+// States at the end of a line.
+const int BlockCommentState = 1;
+// Followed by the index of the string rule.
+const int StringState = 2;
+
+// Classes of characters.
+const quint8 WordChar = 1;
+const quint8 WordStart = 2;
+const quint8 Digit = 4;
+// May start a comment, a string, a directive or a variable.
+const quint8 Special = 8;
+
+const LanguageDefinition Languages[] = {
+    {"cpp c",
+     "*.c *.h *.cc *.cpp *.cxx *.c++ *.hh *.hpp *.hxx *.h++ *.inl *.ino",
+     "alignas alignof asm auto break case catch class const consteval "
+     "constexpr constinit const_cast continue co_await co_return co_yield "
+     "decltype default delete do dynamic_cast else enum explicit export extern "
+     "false final for friend goto if inline mutable namespace new noexcept "
+     "nullptr operator override private protected public register "
+     "reinterpret_cast requires return sizeof static static_assert "
+     "static_cast struct switch template this thread_local throw true try "
+     "typedef typeid typename union using virtual volatile while NULL",
+     "bool char char8_t char16_t char32_t double float int long short signed "
+     "unsigned void wchar_t size_t ssize_t ptrdiff_t intptr_t uintptr_t int8_t "
+     "int16_t int32_t int64_t uint8_t uint16_t uint32_t uint64_t qint8 qint16 "
+     "qint32 qint64 quint8 quint16 quint32 quint64 qreal",
+     "//",
+     false,
+     "/*",
+     "*/",
+     {{"\"", false, true}, {"'", false, true}},
+     true,
+     false},
+    {"python py",
+     "*.py *.pyw *.pyi SConstruct SConscript",
+     "and as assert async await break class continue def del elif else except "
+     "False finally for from global if import in is lambda None nonlocal not "
+     "or pass raise return True try while with yield match case self",
+     "bool bytearray bytes complex dict float frozenset int list object range "
+     "set str tuple type abs all any enumerate filter isinstance len map max "
+     "min open print repr reversed sorted sum super zip",
+     "#",
+     false,
+     "",
+     "",
+     {{"\"\"\"", true, true},
+      {"'''", true, true},
+      {"\"", false, true},
+      {"'", false, true}},
+     false,
+     false},
+    {"json",
+     "*.json *.geojson *.jsonl .babelrc .eslintrc",
+     "true false null",
+     "",
+     "",
+     false,
+     "",
+     "",
+     {{"\"", false, true}},
+     false,
+     false},
+    {"sh bash zsh",
+     "*.sh *.bash *.zsh *.ksh .bashrc .bash_profile .bash_logout .profile "
+     ".zshrc .zprofile PKGBUILD",
+     "if then else elif fi case esac for select while until do done in "
+     "function time return exit break continue local export readonly declare "
+     "typeset unset shift",
+     "alias bg cd command echo eval exec false fg getopts jobs kill printf pwd "
+     "read set source test trap true type ulimit umask wait",
+     "#",
+     true,
+     "",
+     "",
+     {{"\"", true, true}, {"'", true, false}},
+     false,
+     true},
+};
+
+bool startsWith(const QChar *text, int length, int from,
+                const QString &prefix) {
+  const int size = prefix.size();
+  if (size == 0 || length - from < size) {
+    return false;
+  }
+  for (int i = 0; i < size; ++i) {
+    if (text[from + i] != prefix[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const std::vector<Lexer> &lexers() {
+  static const std::vector<Lexer> lexers(std::begin(Languages),
+                                         std::end(Languages));
+  return lexers;
+}
+
+} // namespace
+
+Lexer::Lexer(const LanguageDefinition &definition)
+    : m_names(QString::fromLatin1(definition.names).split(QLatin1Char(' '))),
+      m_patterns(
+          QString::fromLatin1(definition.patterns).split(QLatin1Char(' '))),
+      m_lineComment(QString::fromLatin1(definition.lineComment)),
+      m_lineCommentAfterSpace(definition.lineCommentAfterSpace),
+      m_blockCommentStart(QString::fromLatin1(definition.blockCommentStart)),
+      m_blockCommentEnd(QString::fromLatin1(definition.blockCommentEnd)),
+      m_preprocessor(definition.preprocessor),
+      m_variables(definition.variables) {
+  for (int c = 0; c < 128; ++c) {
+    quint8 cls = 0;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+      cls = WordChar | WordStart;
+    } else if (c >= '0' && c <= '9') {
+      cls = WordChar | Digit;
+    }
+    m_classes[c] = cls;
+  }
+
+  const auto addWords = [this](const char *words, TokenKind kind) {
+    const QStringList list = QString::fromLatin1(words).split(QLatin1Char(' '));
+    for (const QString &word : list) {
+      if (!word.isEmpty()) {
+        m_words.insert(word, kind);
+      }
+    }
+  };
+  addWords(definition.keywords, Keyword);
+  addWords(definition.types, Type);
+
+  const auto markSpecial = [this](const QString &prefix) {
+    if (!prefix.isEmpty() && prefix[0].unicode() < 128) {
+      m_classes[prefix[0].unicode()] |= Special;
+    }
+  };
+  markSpecial(m_lineComment);
+  markSpecial(m_blockCommentStart);
+  for (const LanguageDefinition::String &rule : definition.strings) {
+    if (rule.delimiter) {
+      m_strings.append({QString::fromLatin1(rule.delimiter), rule.multiLine,
+                        rule.escapes});
+      markSpecial(m_strings.last().delimiter);
+    }
+  }
+  if (m_preprocessor) {
+    m_classes['#'] |= Special;
+  }
+  if (m_variables) {
+    m_classes['$'] |= Special;
+  }
+}
+
+quint8 Lexer::charClass(QChar c) const {
+  const ushort u = c.unicode();
+  if (u < 128) {
+    return m_classes[u];
+  }
+  return c.isLetter() ? WordChar | WordStart : c.isNumber() ? WordChar : 0;
+}
+
+int Lexer::lexLine(const QChar *text, int length, int state,
+                   QVector<Token> *tokens) const {
+  int i = 0;
+  bool closed = true;
+  if (state == BlockCommentState && !m_blockCommentEnd.isEmpty()) {
+    i = lexComment(text, length, 0, 0, tokens, &closed);
+  } else if (state >= StringState && state - StringState < m_strings.size()) {
+    i = lexString(text, length, 0, 0, state - StringState, tokens, &closed);
+  }
+  if (!closed) {
+    return state;
+  }
+
+  int firstNonSpace = 0;
+  while (firstNonSpace < length && text[firstNonSpace].isSpace()) {
+    ++firstNonSpace;
+  }
+
+  while (i < length) {
+    const QChar c = text[i];
+    const quint8 cls = charClass(c);
+
+    if (cls & WordStart) {
+      int end = i + 1;
+      while (end < length && (charClass(text[end]) & WordChar)) {
+        ++end;
+      }
+      const auto it = m_words.constFind(QString::fromRawData(text + i, end - i));
+      if (it != m_words.constEnd()) {
+        tokens->append({i, end - i, it.value()});
+      }
+      i = end;
+      continue;
+    }
+
+    if (cls & Digit) {
+      int end = i + 1;
+      while (end < length) {
+        const QChar d = text[end];
+        if ((charClass(d) & WordChar) || d == QLatin1Char('.')) {
+          ++end;
+        } else if ((d == QLatin1Char('+') || d == QLatin1Char('-')) &&
+                   (text[end - 1] == QLatin1Char('e') ||
+                    text[end - 1] == QLatin1Char('E')) &&
+                   text[i + 1] != QLatin1Char('x') &&
+                   text[i + 1] != QLatin1Char('X')) {
+          ++end;
+        } else {
+          break;
+        }
+      }
+      tokens->append({i, end - i, Number});
+      i = end;
+      continue;
+    }
+
+    if (cls & Special) {
+      if (startsWith(text, length, i, m_lineComment) &&
+          (!m_lineCommentAfterSpace || i == 0 || text[i - 1].isSpace())) {
+        tokens->append({i, length - i, Comment});
+        return InitialState;
+      }
+      if (startsWith(text, length, i, m_blockCommentStart)) {
+        i = lexComment(text, length, i, i + m_blockCommentStart.size(), tokens,
+                       &closed);
+        if (!closed) {
+          return BlockCommentState;
+        }
+        continue;
+      }
+      const int rule = matchString(text, length, i);
+      if (rule != -1) {
+        i = lexString(text, length, i, i + m_strings[rule].delimiter.size(),
+                      rule, tokens, &closed);
+        if (!closed) {
+          return m_strings[rule].multiLine ? StringState + rule : InitialState;
+        }
+        continue;
+      }
+      if (m_preprocessor && c == QLatin1Char('#') && i == firstNonSpace) {
+        int end = i + 1;
+        while (end < length && text[end].isSpace()) {
+          ++end;
+        }
+        while (end < length && (charClass(text[end]) & WordChar)) {
+          ++end;
+        }
+        tokens->append({i, end - i, Preprocessor});
+        i = end;
+        continue;
+      }
+      if (m_variables && c == QLatin1Char('$')) {
+        const int end = lexVariable(text, length, i);
+        if (end > i + 1) {
+          tokens->append({i, end - i, Variable});
+        }
+        i = end;
+        continue;
+      }
+    }
+    ++i;
+  }
+  return InitialState;
+}
+
+int Lexer::lexComment(const QChar *text, int length, int start, int from,
+                      QVector<Token> *tokens, bool *closed) const {
+  int end = length;
+  *closed = false;
+  for (int i = from; i < length; ++i) {
+    if (startsWith(text, length, i, m_blockCommentEnd)) {
+      end = i + m_blockCommentEnd.size();
+      *closed = true;
+      break;
+    }
+  }
+  if (end > start) {
+    tokens->append({start, end - start, Comment});
+  }
+  return end;
+}
+
+int Lexer::lexString(const QChar *text, int length, int start, int from,
+                     int rule, QVector<Token> *tokens, bool *closed) const {
+  const StringRule &string = m_strings[rule];
+  int end = length;
+  *closed = false;
+  for (int i = from; i < length; ++i) {
+    if (string.escapes && text[i] == QLatin1Char('\\')) {
+      ++i;
+    } else if (startsWith(text, length, i, string.delimiter)) {
+      end = i + string.delimiter.size();
+      *closed = true;
+      break;
+    }
+  }
+  if (end > start) {
+    tokens->append({start, end - start, String});
+  }
+  return end;
+}
+
+int Lexer::lexVariable(const QChar *text, int length, int start) const {
+  int end = start + 1;
+  if (end == length) {
+    return end;
+  }
+  if (text[end] == QLatin1Char('{')) {
+    while (end < length && text[end] != QLatin1Char('}')) {
+      ++end;
+    }
+    return qMin(length, end + 1);
+  }
+  if (charClass(text[end]) & WordStart) {
+    while (end < length && (charClass(text[end]) & WordChar)) {
+      ++end;
+    }
+    return end;
+  }
+  // Positional and special parameters.
+  if (text[end].isDigit() ||
+      QStringLiteral("#?@*!$-").contains(text[end])) {
+    return end + 1;
+  }
+  return end;
+}
+
+int Lexer::matchString(const QChar *text, int length, int from) const {
+  for (int rule = 0; rule < m_strings.size(); ++rule) {
+    if (startsWith(text, length, from, m_strings[rule].delimiter)) {
+      return rule;
+    }
+  }
+  return -1;
+}
+
+bool Lexer::handlesFileName(const QString &fileName) const {
+  for (const QString &pattern : m_patterns) {
+    if (pattern.startsWith(QLatin1String("*."))
+            ? fileName.endsWith(pattern.midRef(1), Qt::CaseInsensitive)
+            : fileName == pattern) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const Lexer *Lexer::forFileName(const QString &fileName) {
+  const QString name = fileName.section(QLatin1Char('/'), -1);
+  for (const Lexer &lexer : lexers()) {
+    if (lexer.handlesFileName(name)) {
+      return &lexer;
+    }
+  }
+  return nullptr;
+}
+
+const Lexer *Lexer::forName(const QString &name) {
+  for (const Lexer &lexer : lexers()) {
+    if (lexer.m_names.contains(name)) {
+      return &lexer;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace WolfEdit
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QChar>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+namespace WolfEdit {
+
+struct LanguageDefinition;
+
+// Line-by-line lexer for syntax highlighting.
+//
+// A lexer is built from a table describing the language (keywords, comment
+// and string delimiters). Lines are lexed independently given the state at the
+// end of the previous line, which is all that is carried across lines (e.g.
+// "inside a block comment"), so the state can be cached per block and lexing
+// can stop as soon as it matches the cached one again. Lexers are immutable
+// and can be used from any thread.
+class Lexer {
+public:
+  enum TokenKind : quint8 {
+    Keyword,
+    Type,
+    Comment,
+    String,
+    Number,
+    Preprocessor,
+    Variable,
+    TokenKindCount
+  };
+
+  struct Token {
+    int start;
+    int length;
+    TokenKind kind;
+
+    bool operator==(const Token &other) const {
+      return start == other.start && length == other.length &&
+             kind == other.kind;
+    }
+  };
+
+  // State at the start of the first line.
+  static const int InitialState = 0;
+
+  explicit Lexer(const LanguageDefinition &definition);
+
+  // Name of the language, e.g. "cpp".
+  QString name() const { return m_names.first(); }
+
+  // Lexes a line (without the line break) starting in state, appends the
+  // tokens to tokens and returns the state at the end of the line.
+  int lexLine(const QChar *text, int length, int state,
+              QVector<Token> *tokens) const;
+
+  // Lexer for a file (by extension or name) or nullptr if there is none.
+  static const Lexer *forFileName(const QString &fileName);
+  // Lexer for a language name ("c", "cpp", "python", "json", "sh") or
+  // nullptr.
+  static const Lexer *forName(const QString &name);
+
+private:
+  struct StringRule {
+    QString delimiter;
+    bool multiLine;
+    bool escapes;
+  };
+
+  int lexComment(const QChar *text, int length, int start, int from,
+                 QVector<Token> *tokens, bool *closed) const;
+  int lexString(const QChar *text, int length, int start, int from, int rule,
+                QVector<Token> *tokens, bool *closed) const;
+  int lexVariable(const QChar *text, int length, int start) const;
+  int matchString(const QChar *text, int length, int from) const;
+  bool handlesFileName(const QString &fileName) const;
+  quint8 charClass(QChar c) const;
+
+  QStringList m_names;
+  QStringList m_patterns;
+  // Classes of ASCII characters, see lexer.cpp.
+  quint8 m_classes[128];
+  QHash<QString, TokenKind> m_words;
+  QString m_lineComment;
+  bool m_lineCommentAfterSpace;
+  QString m_blockCommentStart;
+  QString m_blockCommentEnd;
+  QVector<StringRule> m_strings;
+  bool m_preprocessor;
+  bool m_variables;
+};
+
+} // namespace WolfEdit
@@ -0,0 +1,506 @@
+#include "piecetable.h"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace WolfEdit {
+
+// Capacity of each append buffer. Typed text accumulates here.
+static const int APPEND_BUFFER_CAPACITY = 64 * 1024;
+// Insertions at least this long (e.g. chunks of a loaded file or large pastes)
+// are kept in their own read-only buffer instead of being copied again.
+static const int READ_ONLY_THRESHOLD = 4 * 1024;
+// Splitting a piece counts the line feeds of one half, so pieces are kept
+// short enough for that to be cheap.
+static const int MAX_PIECE_LENGTH = 64 * 1024;
+// The hash of the text is computed modulo this Mersenne prime. Modulo 2^64,
+// Thue-Morse strings collide for any base.
+static const quint64 HASH_MODULUS = (quint64(1) << 61) - 1;
+// Base of the polynomial hash of the text, below HASH_MODULUS.
+static const quint64 HASH_BASE = 0x16a09e667f3bcc90ull;
+
+static quint64 addHash(quint64 a, quint64 b) {
+  const quint64 sum = a + b;
+  return sum >= HASH_MODULUS ? sum - HASH_MODULUS : sum;
+}
+
+static quint64 subtractHash(quint64 a, quint64 b) {
+  return a >= b ? a - b : a + HASH_MODULUS - b;
+}
+
+static quint64 multiplyHash(quint64 a, quint64 b) {
+#ifdef _MSC_VER
+  quint64 high;
+  const quint64 low = _umul128(a, b, &high);
+#else
+  const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  const quint64 low = quint64(product);
+  const quint64 high = quint64(product >> 64);
+#endif
+  // 2^61 is 1 modulo HASH_MODULUS, so the bits above 61 are added back in.
+  const quint64 sum = (low & HASH_MODULUS) + (low >> 61 | high << 3);
+  return addHash(sum & HASH_MODULUS, sum >> 61);
+}
+
+static quint64 hashText(quint64 hash, const QChar *text, int length) {
+  for (int i = 0; i < length; ++i) {
+    hash = addHash(multiplyHash(hash, HASH_BASE), text[i].unicode());
+  }
+  return hash;
+}
+
+// HASH_BASE to the power of exponent.
+static quint64 hashPower(int exponent) {
+  quint64 result = 1;
+  quint64 base = HASH_BASE;
+  for (; exponent > 0; exponent >>= 1) {
+    if (exponent & 1) {
+      result = multiplyHash(result, base);
+    }
+    base = multiplyHash(base, base);
+  }
+  return result;
+}
+
+void Fingerprint::append(const QChar *text, int count) {
+  hash = hashText(hash, text, count);
+  length += count;
+}
+
+PieceBuffer::PieceBuffer(const QString &text)
+    : m_text(text), m_data(m_text.constData()), m_size(m_text.size()),
+      m_capacity(m_text.size()) {}
+
+PieceBuffer::PieceBuffer(int capacity)
+    : m_owned(new QChar[capacity]), m_data(m_owned.get()), m_size(0),
+      m_capacity(capacity) {}
+
+int PieceBuffer::append(const QChar *text, int length) {
+  if (!m_owned) {
+    return 0;
+  }
+  const int count = std::min(length, available());
+  std::copy(text, text + count, m_owned.get() + m_size);
+  m_size += count;
+  return count;
+}
+
+struct PieceTable::Node {
+  Piece piece;
+  unsigned int priority = 0;
+  Node *left = nullptr;
+  Node *right = nullptr;
+  int length = 0;
+  int lineFeeds = 0;
+  // Hash of the text of the subtree and HASH_BASE to the power of its length.
+  quint64 hash = 0;
+  quint64 power = 1;
+};
+
+PieceTable::PieceTable() = default;
+
+PieceTable::PieceTable(const QString &text) { setText(text); }
+
+PieceTable::~PieceTable() { destroy(m_root); }
+
+int PieceTable::length() const { return nodeLength(m_root); }
+
+int PieceTable::lineCount() const { return nodeLineFeeds(m_root) + 1; }
+
+Fingerprint PieceTable::fingerprint() const {
+  Fingerprint fingerprint;
+  fingerprint.hash = nodeHash(m_root);
+  fingerprint.length = length();
+  return fingerprint;
+}
+
+void PieceTable::setText(const QString &text) {
+  clear();
+  insert(0, text);
+}
+
+void PieceTable::clear() {
+  destroy(m_root);
+  m_root = nullptr;
+  m_appendBuffer.reset();
+}
+
+void PieceTable::insert(int position, const QString &text) {
+  if (text.isEmpty()) {
+    return;
+  }
+  position = qBound(0, position, length());
+
+  Node *left;
+  Node *right;
+  split(m_root, position, &left, &right);
+
+  if (text.size() >= READ_ONLY_THRESHOLD) {
+    PieceBufferPtr buffer = std::make_shared<PieceBuffer>(text);
+    for (int start = 0; start < text.size(); start += MAX_PIECE_LENGTH) {
+      Piece piece;
+      piece.buffer = buffer;
+      piece.start = start;
+      piece.length = std::min(MAX_PIECE_LENGTH, text.size() - start);
+      measure(&piece);
+      left = merge(left, createNode(piece));
+    }
+  } else {
+    left = appendText(left, text.constData(), text.size());
+  }
+
+  m_root = merge(left, right);
+}
+
+void PieceTable::remove(int position, int count) {
+  position = qBound(0, position, length());
+  count = qBound(0, count, length() - position);
+  if (count == 0) {
+    return;
+  }
+
+  Node *left;
+  Node *middle;
+  Node *right;
+  split(m_root, position, &left, &middle);
+  split(middle, count, &middle, &right);
+  destroy(middle);
+  m_root = merge(left, right);
+}
+
+QChar PieceTable::at(int position) const {
+  const Node *node = m_root;
+  while (node) {
+    const int leftLength = nodeLength(node->left);
+    if (position < leftLength) {
+      node = node->left;
+      continue;
+    }
+    position -= leftLength;
+    if (position < node->piece.length) {
+      return node->piece.buffer->data()[node->piece.start + position];
+    }
+    position -= node->piece.length;
+    node = node->right;
+  }
+  return QChar();
+}
+
+QString PieceTable::mid(int position, int count) const {
+  position = qBound(0, position, length());
+  count = qBound(0, count, length() - position);
+
+  QString result;
+  result.reserve(count);
+  forEachPiece(m_root, position, position + count, 0,
+               [&result](const Piece &piece, int offset, int length) {
+                 result.append(piece.buffer->data() + piece.start + offset,
+                               length);
+               });
+  return result;
+}
+
+bool PieceTable::equals(int position, const QString &text) const {
+  if (position < 0 || position + text.size() > length()) {
+    return false;
+  }
+  bool equal = true;
+  int compared = 0;
+  forEachPiece(m_root, position, position + text.size(), 0,
+               [&](const Piece &piece, int offset, int length) {
+                 if (equal) {
+                   const QChar *data = piece.buffer->data() + piece.start;
+                   equal = std::equal(data + offset, data + offset + length,
+                                      text.constData() + compared);
+                 }
+                 compared += length;
+               });
+  return equal;
+}
+
+int PieceTable::lineStart(int line) const {
+  if (line <= 0) {
+    return 0;
+  }
+  int remaining = line;
+  int position = 0;
+  const Node *node = m_root;
+  while (node) {
+    const int leftLineFeeds = nodeLineFeeds(node->left);
+    if (remaining <= leftLineFeeds) {
+      node = node->left;
+      continue;
+    }
+    remaining -= leftLineFeeds;
+    position += nodeLength(node->left);
+
+    const Piece &piece = node->piece;
+    if (remaining <= piece.lineFeeds) {
+      const QChar *data = piece.buffer->data() + piece.start;
+      for (int i = 0; i < piece.length; ++i) {
+        if (data[i] == QLatin1Char('\n') && --remaining == 0) {
+          return position + i + 1;
+        }
+      }
+    }
+    remaining -= piece.lineFeeds;
+    position += piece.length;
+    node = node->right;
+  }
+  return length();
+}
+
+int PieceTable::lineAt(int position) const {
+  int line = 0;
+  const Node *node = m_root;
+  while (node) {
+    const int leftLength = nodeLength(node->left);
+    if (position < leftLength) {
+      node = node->left;
+      continue;
+    }
+    line += nodeLineFeeds(node->left);
+    position -= leftLength;
+
+    const Piece &piece = node->piece;
+    if (position < piece.length) {
+      return line + countLineFeeds(piece.buffer->data() + piece.start, position);
+    }
+    line += piece.lineFeeds;
+    position -= piece.length;
+    node = node->right;
+  }
+  return line;
+}
+
+PieceTable::Snapshot PieceTable::snapshot() const {
+  Snapshot snapshot;
+  snapshot.m_length = length();
+  snapshot.m_lineFeeds = nodeLineFeeds(m_root);
+  snapshot.m_fingerprint = fingerprint();
+  forEachPiece(m_root, 0, snapshot.m_length, 0,
+               [&snapshot](const Piece &piece, int offset, int length) {
+                 Piece copy = piece;
+                 copy.start += offset;
+                 copy.length = length;
+                 snapshot.m_pieces.push_back(copy);
+               });
+  return snapshot;
+}
+
+QString PieceTable::Snapshot::text() const {
+  QString result;
+  result.reserve(m_length);
+  forEachChunk([&result](const QChar *data, int length) {
+    result.append(data, length);
+    return true;
+  });
+  return result;
+}
+
+bool PieceTable::Snapshot::forEachChunk(
+    const std::function<bool(const QChar *, int)> &visitor) const {
+  for (const Piece &piece : m_pieces) {
+    if (!visitor(piece.buffer->data() + piece.start, piece.length)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int PieceTable::nodeLength(const Node *node) {
+  return node ? node->length : 0;
+}
+
+int PieceTable::nodeLineFeeds(const Node *node) {
+  return node ? node->lineFeeds : 0;
+}
+
+quint64 PieceTable::nodeHash(const Node *node) { return node ? node->hash : 0; }
+
+quint64 PieceTable::nodePower(const Node *node) {
+  return node ? node->power : 1;
+}
+
+void PieceTable::update(Node *node) {
+  node->length = nodeLength(node->left) + node->piece.length +
+                 nodeLength(node->right);
+  node->lineFeeds = nodeLineFeeds(node->left) + node->piece.lineFeeds +
+                    nodeLineFeeds(node->right);
+  const quint64 rightPower = nodePower(node->right);
+  const quint64 leftHash = addHash(
+      multiplyHash(nodeHash(node->left), node->piece.power), node->piece.hash);
+  node->hash =
+      addHash(multiplyHash(leftHash, rightPower), nodeHash(node->right));
+  node->power = multiplyHash(
+      multiplyHash(nodePower(node->left), node->piece.power), rightPower);
+}
+
+PieceTable::Node *PieceTable::merge(Node *left, Node *right) {
+  if (!left) {
+    return right;
+  }
+  if (!right) {
+    return left;
+  }
+  if (left->priority > right->priority) {
+    left->right = merge(left->right, right);
+    update(left);
+    return left;
+  }
+  right->left = merge(left, right->left);
+  update(right);
+  return right;
+}
+
+void PieceTable::split(Node *node, int position, Node **left, Node **right) {
+  if (!node) {
+    *left = nullptr;
+    *right = nullptr;
+    return;
+  }
+
+  const int leftLength = nodeLength(node->left);
+  const int pieceEnd = leftLength + node->piece.length;
+  if (position <= leftLength) {
+    split(node->left, position, left, &node->left);
+    update(node);
+    *right = node;
+  } else if (position >= pieceEnd) {
+    split(node->right, position - pieceEnd, &node->right, right);
+    update(node);
+    *left = node;
+  } else {
+    // The split point is inside this piece; cut it in two. The tail keeps the
+    // node's priority so it can take the node's place in the right tree.
+    const int offset = position - leftLength;
+    Node *tail = new Node;
+    tail->piece = node->piece;
+    tail->piece.start += offset;
+    tail->piece.length -= offset;
+    tail->priority = node->priority;
+    node->piece.length = offset;
+    measure(&node->piece);
+    tail->piece.lineFeeds -= node->piece.lineFeeds;
+    // hash(piece) = hash(head) * power(tail) + hash(tail)
+    tail->piece.power = hashPower(tail->piece.length);
+    tail->piece.hash = subtractHash(
+        tail->piece.hash, multiplyHash(node->piece.hash, tail->piece.power));
+
+    tail->right = node->right;
+    node->right = nullptr;
+    update(node);
+    update(tail);
+    *left = node;
+    *right = tail;
+  }
+}
+
+void PieceTable::destroy(Node *node) {
+  if (!node) {
+    return;
+  }
+  destroy(node->left);
+  destroy(node->right);
+  delete node;
+}
+
+int PieceTable::countLineFeeds(const QChar *text, int length) {
+  return int(std::count(text, text + length, QLatin1Char('\n')));
+}
+
+// Counts the line feeds and hashes the text of the piece.
+void PieceTable::measure(Piece *piece) {
+  const QChar *text = piece->buffer->data() + piece->start;
+  piece->lineFeeds = countLineFeeds(text, piece->length);
+  piece->hash = hashText(0, text, piece->length);
+  piece->power = hashPower(piece->length);
+}
+
+PieceTable::Node *PieceTable::createNode(const Piece &piece) {
+  // xorshift32
+  m_seed ^= m_seed << 13;
+  m_seed ^= m_seed >> 17;
+  m_seed ^= m_seed << 5;
+
+  Node *node = new Node;
+  node->piece = piece;
+  node->priority = m_seed;
+  update(node);
+  return node;
+}
+
+PieceTable::Node *PieceTable::appendText(Node *root, const QChar *text,
+                                         int length) {
+  while (length > 0) {
+    if (!m_appendBuffer || m_appendBuffer->available() == 0) {
+      m_appendBuffer = std::make_shared<PieceBuffer>(APPEND_BUFFER_CAPACITY);
+    }
+    const int start = m_appendBuffer->size();
+    const int count = m_appendBuffer->append(text, length);
+
+    // Consecutive typing extends the same piece.
+    if (!extendLastPiece(root, start, count)) {
+      Piece piece;
+      piece.buffer = m_appendBuffer;
+      piece.start = start;
+      piece.length = count;
+      measure(&piece);
+      root = merge(root, createNode(piece));
+    }
+    text += count;
+    length -= count;
+  }
+  return root;
+}
+
+bool PieceTable::extendLastPiece(Node *node, int start, int length) {
+  if (!node) {
+    return false;
+  }
+  if (node->right) {
+    if (!extendLastPiece(node->right, start, length)) {
+      return false;
+    }
+    update(node);
+    return true;
+  }
+
+  Piece &piece = node->piece;
+  if (piece.buffer != m_appendBuffer || piece.start + piece.length != start ||
+      piece.length + length > MAX_PIECE_LENGTH) {
+    return false;
+  }
+  piece.lineFeeds += countLineFeeds(piece.buffer->data() + start, length);
+  piece.hash = hashText(piece.hash, piece.buffer->data() + start, length);
+  piece.power = multiplyHash(piece.power, hashPower(length));
+  piece.length += length;
+  update(node);
+  return true;
+}
+
+void PieceTable::forEachPiece(
+    const Node *node, int from, int to, int offset,
+    const std::function<void(const Piece &, int, int)> &visitor) const {
+  if (!node || from >= to) {
+    return;
+  }
+  const int pieceStart = offset + nodeLength(node->left);
+  const int pieceEnd = pieceStart + node->piece.length;
+  if (from < pieceStart) {
+    forEachPiece(node->left, from, to, offset, visitor);
+  }
+  if (from < pieceEnd && to > pieceStart) {
+    const int begin = std::max(from, pieceStart) - pieceStart;
+    const int end = std::min(to, pieceEnd) - pieceStart;
+    visitor(node->piece, begin, end - begin);
+  }
+  if (to > pieceEnd) {
+    forEachPiece(node->right, from, to, pieceEnd, visitor);
+  }
+}
+
+} // namespace WolfEdit
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <QChar>
+#include <QString>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace WolfEdit {
+
+// Storage for the text referenced by pieces. A buffer is either read-only
+// (e.g. a chunk of the file as it was loaded) or an append buffer with a fixed
+// capacity. Characters already handed out are never moved or modified, so a
+// snapshot can read them from another thread while new text is appended.
+class PieceBuffer {
+public:
+  explicit PieceBuffer(const QString &text);
+  explicit PieceBuffer(int capacity);
+
+  const QChar *data() const { return m_data; }
+  int size() const { return m_size; }
+  bool isReadOnly() const { return !m_owned; }
+  int available() const { return m_capacity - m_size; }
+
+  // Appends as much of text as fits and returns the number of characters
+  // appended.
+  int append(const QChar *text, int length);
+
+private:
+  QString m_text;
+  std::unique_ptr<QChar[]> m_owned;
+  const QChar *m_data;
+  int m_size;
+  int m_capacity;
+};
+
+using PieceBufferPtr = std::shared_ptr<PieceBuffer>;
+
+struct Piece {
+  PieceBufferPtr buffer;
+  int start = 0;
+  int length = 0;
+  int lineFeeds = 0;
+  // Hash of the text of the piece and the power of the hash base for its
+  // length (see Fingerprint).
+  quint64 hash = 0;
+  quint64 power = 1;
+};
+
+// Polynomial hash of a text (modulo the prime 2^61 - 1) and its length.
+//
+// The fingerprint of a concatenation can be computed from the fingerprints of
+// the parts, so the piece table keeps the fingerprint of the whole text up to
+// date in O(log n) per edit. It is meant to tell whether a buffer still has
+// the text it was loaded or saved with; it is not a cryptographic hash.
+struct Fingerprint {
+  quint64 hash = 0;
+  qint64 length = 0;
+
+  // Extends the fingerprint by text.
+  void append(const QChar *text, int count);
+  void append(const QString &text) { append(text.constData(), text.size()); }
+
+  bool operator==(const Fingerprint &other) const {
+    return hash == other.hash && length == other.length;
+  }
+  bool operator!=(const Fingerprint &other) const { return !(*this == other); }
+};
+
+// Plain text buffer implemented as a piece table.
+//
+// Text is never copied on edit: inserted text is written once to an append
+// buffer (or kept as its own read-only buffer if it is large) and the document
+// is described by an ordered sequence of pieces. The pieces are kept in an
+// implicit treap with subtree lengths and line counts, so edits and lookups
+// by position or line number are O(log n) in the number of pieces.
+class PieceTable {
+public:
+  // Immutable copy of the piece sequence. Cheap to create and safe to read
+  // from another thread while the table keeps being edited.
+  class Snapshot {
+  public:
+    int length() const { return m_length; }
+    int lineCount() const { return m_lineFeeds + 1; }
+    Fingerprint fingerprint() const { return m_fingerprint; }
+    QString text() const;
+    // Calls visitor with consecutive runs of characters; stops early if it
+    // returns false.
+    bool forEachChunk(
+        const std::function<bool(const QChar *, int)> &visitor) const;
+
+  private:
+    friend class PieceTable;
+    std::vector<Piece> m_pieces;
+    int m_length = 0;
+    int m_lineFeeds = 0;
+    Fingerprint m_fingerprint;
+  };
+
+  PieceTable();
+  explicit PieceTable(const QString &text);
+  ~PieceTable();
+
+  PieceTable(const PieceTable &) = delete;
+  PieceTable &operator=(const PieceTable &) = delete;
+
+  int length() const;
+  int lineCount() const;
+  bool isEmpty() const { return length() == 0; }
+  // O(1), kept up to date on every edit.
+  Fingerprint fingerprint() const;
+
+  void setText(const QString &text);
+  void insert(int position, const QString &text);
+  void remove(int position, int count);
+  void clear();
+
+  QChar at(int position) const;
+  QString text() const { return mid(0, length()); }
+  QString mid(int position, int count) const;
+  bool equals(int position, const QString &text) const;
+
+  // Position of the first character of a 0-based line.
+  int lineStart(int line) const;
+  // 0-based line containing position.
+  int lineAt(int position) const;
+
+  Snapshot snapshot() const;
+
+private:
+  struct Node;
+
+  static int nodeLength(const Node *node);
+  static int nodeLineFeeds(const Node *node);
+  static quint64 nodeHash(const Node *node);
+  static quint64 nodePower(const Node *node);
+  static void update(Node *node);
+  static Node *merge(Node *left, Node *right);
+  static void split(Node *node, int position, Node **left, Node **right);
+  static void destroy(Node *node);
+  static int countLineFeeds(const QChar *text, int length);
+  static void measure(Piece *piece);
+
+  Node *createNode(const Piece &piece);
+  Node *appendText(Node *root, const QChar *text, int length);
+  bool extendLastPiece(Node *node, int start, int length);
+  void forEachPiece(const Node *node, int from, int to, int offset,
+                    const std::function<void(const Piece &, int, int)> &visitor)
+      const;
+
+  Node *m_root = nullptr;
+  PieceBufferPtr m_appendBuffer;
+  unsigned int m_seed = 0x9e3779b9u;
+};
+
+} // namespace WolfEdit
@@ -0,0 +1,375 @@
+#include "projectsearch.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace WolfEdit {
+
+namespace {
+
+// Files with a NUL byte in this many leading bytes are treated as binary.
+const qint64 BinaryCheckSize = 8192;
+
+const int DeliverInterval = 50; // ms
+
+class Task : public QRunnable {
+public:
+  explicit Task(std::function<void()> function)
+      : m_function(std::move(function)) {}
+  void run() override { m_function(); }
+
+private:
+  std::function<void()> m_function;
+};
+
+bool hasWildcard(const QString &pattern) {
+  return pattern.contains(QLatin1Char('*')) ||
+         pattern.contains(QLatin1Char('?')) ||
+         pattern.contains(QLatin1Char('['));
+}
+
+// Files to search for one file pattern.
+struct FileSpec {
+  QString root;
+  bool recursive = false;
+  bool isFile = false;
+  // Matches file names; empty matches every file.
+  QRegularExpression name;
+};
+
+FileSpec parseFilePattern(const QString &pattern, const QString &base) {
+  FileSpec spec;
+  const QString path = QDir::cleanPath(QDir(base).filePath(pattern));
+  const int recursive = path.indexOf(QLatin1String("**"));
+  QString namePattern;
+  if (recursive != -1) {
+    spec.root = path.left(recursive);
+    spec.recursive = true;
+    namePattern = path.mid(recursive + 2).section(QLatin1Char('/'), -1);
+  } else if (hasWildcard(QFileInfo(path).fileName())) {
+    spec.root = QFileInfo(path).path();
+    namePattern = QFileInfo(path).fileName();
+  } else {
+    spec.root = path;
+    spec.recursive = true;
+    spec.isFile = !QFileInfo(path).isDir();
+  }
+  if (spec.root.isEmpty()) {
+    spec.root = QStringLiteral(".");
+  }
+  if (!namePattern.isEmpty() && namePattern != QLatin1String("*")) {
+    spec.name.setPattern(
+        QRegularExpression::wildcardToRegularExpression(namePattern));
+  }
+  return spec;
+}
+
+} // namespace
+
+struct ProjectSearchState {
+  ProjectSearch::Query query;
+  // UTF-8 encoded literal prefix; empty if lines can't be skipped.
+  QByteArray prefix;
+  bool prefixIgnoresCase = false;
+
+  QThreadPool *pool = nullptr;
+  std::atomic<bool> cancelled{false};
+  std::atomic<int> pendingTasks{0};
+  std::atomic<int> filesSearched{0};
+
+  QMutex mutex;
+  QVector<ProjectSearch::Match> matches;
+  bool done = false;
+};
+
+namespace {
+
+using StatePtr = std::shared_ptr<ProjectSearchState>;
+
+void searchFile(ProjectSearchState *state, const QString &filePath);
+void searchDirectory(const StatePtr &state, const FileSpec &spec,
+                     const QString &directory);
+
+void startTask(const StatePtr &state, std::function<void()> function) {
+  ++state->pendingTasks;
+  state->pool->start(new Task([state, function] {
+    if (!state->cancelled) {
+      function();
+    }
+    if (--state->pendingTasks == 0) {
+      QMutexLocker locker(&state->mutex);
+      state->done = true;
+    }
+  }));
+}
+
+void searchDirectory(const StatePtr &state, const FileSpec &spec,
+                     const QString &directory) {
+  const QFileInfoList entries = QDir(directory).entryInfoList(
+      QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+  for (const QFileInfo &entry : entries) {
+    if (state->cancelled) {
+      return;
+    }
+    if (entry.isDir()) {
+      // Symbolic links to directories could lead to cycles.
+      if (spec.recursive && !entry.isSymLink()) {
+        const QString path = entry.filePath();
+        startTask(state,
+                  [state, spec, path] { searchDirectory(state, spec, path); });
+      }
+    } else if (spec.name.pattern().isEmpty() ||
+               spec.name.match(entry.fileName()).hasMatch()) {
+      const QString path = entry.filePath();
+      startTask(state, [state, path] { searchFile(state.get(), path); });
+    }
+  }
+}
+
+// Finds the next occurrence of the prefix in [begin, end).
+const char *findPrefix(const ProjectSearchState &state, const char *begin,
+                       const char *end) {
+  const QByteArray &prefix = state.prefix;
+  const int length = prefix.size();
+  if (!state.prefixIgnoresCase) {
+    const char first = prefix[0];
+    while (end - begin >= length) {
+      const char *hit = static_cast<const char *>(
+          std::memchr(begin, first, end - begin - length + 1));
+      if (!hit) {
+        return nullptr;
+      }
+      if (std::memcmp(hit + 1, prefix.constData() + 1, length - 1) == 0) {
+        return hit;
+      }
+      begin = hit + 1;
+    }
+    return nullptr;
+  }
+
+  // ASCII prefix; look for both cases of the first character.
+  const char lower = char(QChar::toLower(uint(prefix[0])));
+  const char upper = char(QChar::toUpper(uint(prefix[0])));
+  while (end - begin >= length) {
+    const size_t searchLength = size_t(end - begin - length + 1);
+    const char *hit =
+        static_cast<const char *>(std::memchr(begin, lower, searchLength));
+    if (upper != lower) {
+      const char *hitUpper = static_cast<const char *>(
+          std::memchr(begin, upper, hit ? size_t(hit - begin) : searchLength));
+      if (hitUpper) {
+        hit = hitUpper;
+      }
+    }
+    if (!hit) {
+      return nullptr;
+    }
+    if (qstrnicmp(hit + 1, prefix.constData() + 1, uint(length - 1)) == 0) {
+      return hit;
+    }
+    begin = hit + 1;
+  }
+  return nullptr;
+}
+
+void matchLine(ProjectSearchState *state, const QString &filePath,
+               const char *begin, const char *end, int lineNumber,
+               QVector<ProjectSearch::Match> *matches) {
+  if (end > begin && end[-1] == '\r') {
+    --end;
+  }
+  const QString text = QString::fromUtf8(begin, int(end - begin));
+  const QRegularExpression &regExp = state->query.regExp;
+  if (state->query.allMatches) {
+    QRegularExpressionMatchIterator it = regExp.globalMatch(text);
+    while (it.hasNext()) {
+      const QRegularExpressionMatch match = it.next();
+      matches->append({filePath, lineNumber, match.capturedStart(), text});
+    }
+  } else {
+    const QRegularExpressionMatch match = regExp.match(text);
+    if (match.hasMatch()) {
+      matches->append({filePath, lineNumber, match.capturedStart(), text});
+    }
+  }
+}
+
+void searchFile(ProjectSearchState *state, const QString &filePath) {
+  QFile file(filePath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return;
+  }
+  ++state->filesSearched;
+  qint64 size = file.size();
+  if (size == 0) {
+    return;
+  }
+
+  // Mapping avoids copying the file; fall back to reading for files that
+  // can't be mapped (e.g. special files).
+  QByteArray buffer;
+  const char *data = reinterpret_cast<const char *>(file.map(0, size));
+  if (!data) {
+    buffer = file.readAll();
+    data = buffer.constData();
+    size = buffer.size();
+  }
+  const char *end = data + size;
+
+  if (std::memchr(data, '\0', size_t(qMin(size, BinaryCheckSize)))) {
+    return;
+  }
+
+  QVector<ProjectSearch::Match> matches;
+  int lineNumber = 1;
+  const char *counted = data;
+  const char *lineBegin = data;
+  while (lineBegin < end && !state->cancelled) {
+    const char *candidate = lineBegin;
+    if (!state->prefix.isEmpty()) {
+      const char *hit = findPrefix(*state, lineBegin, end);
+      if (!hit) {
+        break;
+      }
+      candidate = hit;
+      while (candidate > lineBegin && candidate[-1] != '\n') {
+        --candidate;
+      }
+      lineNumber += int(std::count(counted, candidate, '\n'));
+      counted = candidate;
+    }
+    const char *lineEnd =
+        static_cast<const char *>(std::memchr(candidate, '\n', end - candidate));
+    if (!lineEnd) {
+      lineEnd = end;
+    }
+    matchLine(state, filePath, candidate, lineEnd, lineNumber, &matches);
+    if (lineEnd == end) {
+      break;
+    }
+    if (state->prefix.isEmpty()) {
+      ++lineNumber;
+    }
+    lineBegin = lineEnd + 1;
+  }
+
+  if (!matches.isEmpty()) {
+    QMutexLocker locker(&state->mutex);
+    state->matches += matches;
+  }
+}
+
+} // namespace
+
+ProjectSearch::ProjectSearch(QObject *parent) : QObject(parent) {
+  m_pool.setMaxThreadCount(QThread::idealThreadCount());
+  m_deliverTimer.setInterval(DeliverInterval);
+  connect(&m_deliverTimer, &QTimer::timeout, this, &ProjectSearch::deliver);
+}
+
+ProjectSearch::~ProjectSearch() {
+  cancel();
+  m_pool.waitForDone();
+}
+
+bool ProjectSearch::pathLessThan(const QString &a, const QString &b) {
+  const int length = qMin(a.size(), b.size());
+  for (int i = 0; i < length; ++i) {
+    if (a[i] != b[i]) {
+      // A directory's own files and subdirectories come before any name
+      // that merely starts with the directory's name.
+      if (a[i] == QLatin1Char('/')) {
+        return true;
+      }
+      if (b[i] == QLatin1Char('/')) {
+        return false;
+      }
+      return a[i] < b[i];
+    }
+  }
+  return a.size() < b.size();
+}
+
+void ProjectSearch::start(const Query &query, const QStringList &filePatterns,
+                          const QString &baseDirectory) {
+  cancel();
+
+  m_state = std::make_shared<ProjectSearchState>();
+  m_state->query = query;
+  m_state->pool = &m_pool;
+  m_state->query.regExp.optimize();
+  const QByteArray prefix = query.literalPrefix.toUtf8();
+  const bool ascii = std::all_of(prefix.begin(), prefix.end(),
+                                 [](char c) { return uchar(c) < 0x80; });
+  // Without ignoring case, any prefix can be searched byte by byte.
+  if (query.prefixCaseSensitivity == Qt::CaseSensitive || ascii) {
+    m_state->prefix = prefix;
+    m_state->prefixIgnoresCase =
+        query.prefixCaseSensitivity == Qt::CaseInsensitive;
+  }
+
+  // Keeps the search from finishing before all patterns are queued.
+  const StatePtr state = m_state;
+  ++state->pendingTasks;
+  for (const QString &pattern : filePatterns) {
+    const FileSpec spec = parseFilePattern(pattern, baseDirectory);
+    if (spec.isFile) {
+      const QString path = spec.root;
+      startTask(state, [state, path] { searchFile(state.get(), path); });
+    } else {
+      startTask(state, [state, spec] {
+        searchDirectory(state, spec, spec.root);
+      });
+    }
+  }
+  if (--state->pendingTasks == 0) {
+    QMutexLocker locker(&state->mutex);
+    state->done = true;
+  }
+
+  m_deliverTimer.start();
+}
+
+void ProjectSearch::cancel() {
+  if (!m_state) {
+    return;
+  }
+  m_state->cancelled = true;
+  m_state.reset();
+  m_deliverTimer.stop();
+}
+
+void ProjectSearch::deliver() {
+  if (!m_state) {
+    return;
+  }
+  QVector<Match> matches;
+  bool done;
+  {
+    QMutexLocker locker(&m_state->mutex);
+    matches.swap(m_state->matches);
+    done = m_state->done;
+  }
+
+  const int filesSearched = m_state->filesSearched;
+  if (done) {
+    m_state.reset();
+    m_deliverTimer.stop();
+  }
+  if (!matches.isEmpty()) {
+    emit matchesFound(matches);
+  }
+  if (done) {
+    emit finished(filesSearched);
+  }
+}
+
+} // namespace WolfEdit
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QMutex>
+#include <QObject>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+
+namespace WolfEdit {
+
+struct ProjectSearchState;
+
+// Searches files for a regular expression on a thread pool (:vimgrep).
+//
+// Every directory and every file is a separate task, so idle threads pick up
+// whatever work is left regardless of how the tree is shaped. Files are
+// memory-mapped and scanned for the literal prefix of the pattern with
+// memchr() before any line is decoded and matched against the expression;
+// without a prefix each line is matched. Matches are collected by the
+// workers and handed to the owner in batches from the event loop, so results
+// show up while the scan is still running and the UI thread never waits.
+class ProjectSearch : public QObject {
+  Q_OBJECT
+
+public:
+  struct Match {
+    QString filePath;
+    int line = 0;   // 1-based
+    int column = 0; // 0-based, in UTF-16 code units
+    QString text;
+  };
+
+  struct Query {
+    QRegularExpression regExp;
+    // Literal text every match starts with (empty if there is none).
+    QString literalPrefix;
+    Qt::CaseSensitivity prefixCaseSensitivity = Qt::CaseSensitive;
+    // Report every match on a line, not only the first one.
+    bool allMatches = false;
+  };
+
+  explicit ProjectSearch(QObject *parent = nullptr);
+  ~ProjectSearch() override;
+
+  // Starts a search, cancelling the running one. File patterns are relative
+  // to baseDirectory and may use wildcards in the last component; "**/"
+  // searches the directory tree below it. A directory is searched
+  // recursively. Hidden files and directories are skipped, as are binary
+  // files.
+  void start(const Query &query, const QStringList &filePatterns,
+             const QString &baseDirectory);
+  // Stops the running search; finished() is not emitted for it.
+  void cancel();
+
+  bool isRunning() const { return m_state != nullptr; }
+
+  // Orders file paths like a sorted walk of the directory tree: by name,
+  // component by component. This is the order of the quickfix list.
+  static bool pathLessThan(const QString &a, const QString &b);
+
+signals:
+  // The matches of a file are delivered together and in line order. Files
+  // are delivered in the order they were searched, which depends on the
+  // thread scheduling, so a receiver that lists them inserts each file's
+  // matches at its place (see pathLessThan()).
+  void matchesFound(const QVector<WolfEdit::ProjectSearch::Match> &matches);
+  void finished(int filesSearched);
+
+private:
+  void deliver();
+
+  QThreadPool m_pool;
+  QTimer m_deliverTimer;
+  std::shared_ptr<ProjectSearchState> m_state;
+};
+
+} // namespace WolfEdit
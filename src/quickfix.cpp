@@ -0,0 +1,89 @@
+#include "quickfix.h"
+
+#include <QDir>
+#include <QFont>
+
+#include <algorithm>
+
+namespace WolfEdit {
+
+QuickfixList::QuickfixList(QObject *parent) : QAbstractListModel(parent) {}
+
+int QuickfixList::rowCount(const QModelIndex &parent) const {
+  return parent.isValid() ? 0 : m_entries.size();
+}
+
+QVariant QuickfixList::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || index.row() >= m_entries.size()) {
+    return QVariant();
+  }
+  if (role == Qt::DisplayRole) {
+    return entryText(index.row());
+  }
+  if (role == Qt::ToolTipRole) {
+    return m_entries[index.row()].filePath;
+  }
+  if (role == Qt::FontRole && index.row() == m_current) {
+    QFont font;
+    font.setBold(true);
+    return font;
+  }
+  return QVariant();
+}
+
+void QuickfixList::reset(const QString &baseDirectory) {
+  beginResetModel();
+  m_baseDirectory = baseDirectory;
+  m_entries.clear();
+  m_current = -1;
+  endResetModel();
+}
+
+void QuickfixList::add(const QVector<Entry> &entries) {
+  int begin = 0;
+  while (begin < entries.size()) {
+    const QString &filePath = entries[begin].filePath;
+    int end = begin + 1;
+    while (end < entries.size() && entries[end].filePath == filePath) {
+      ++end;
+    }
+    const auto at = std::upper_bound(
+        m_entries.cbegin(), m_entries.cend(), filePath,
+        [](const QString &path, const Entry &entry) {
+          return ProjectSearch::pathLessThan(path, entry.filePath);
+        });
+    const int row = int(at - m_entries.cbegin());
+    const int count = end - begin;
+    beginInsertRows(QModelIndex(), row, row + count - 1);
+    m_entries.insert(row, count, Entry());
+    std::copy(entries.cbegin() + begin, entries.cbegin() + end,
+              m_entries.begin() + row);
+    if (m_current >= row) {
+      m_current += count;
+    }
+    endInsertRows();
+    begin = end;
+  }
+}
+
+void QuickfixList::setCurrent(int row) {
+  const int previous = m_current;
+  m_current = row;
+  if (previous >= 0) {
+    emit dataChanged(index(previous), index(previous), {Qt::FontRole});
+  }
+  if (row >= 0) {
+    emit dataChanged(index(row), index(row), {Qt::FontRole});
+  }
+}
+
+QString QuickfixList::entryText(int row) const {
+  const Entry &entry = m_entries[row];
+  return QStringLiteral("%1:%2:%3: %4")
+      .arg(QDir(m_baseDirectory).relativeFilePath(entry.filePath))
+      .arg(entry.line)
+      .arg(entry.column + 1)
+      .arg(entry.text.trimmed());
+}
+
+} // namespace WolfEdit
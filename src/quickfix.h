@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QVector>
+
+#include "projectsearch.h"
+
+namespace WolfEdit {
+
+// Locations found by :vimgrep, listed by :copen and visited with :cnext and
+// :cprevious. Entries are added while the search is still running and kept
+// in path order (see ProjectSearch::pathLessThan()), whatever order the files
+// were searched in.
+class QuickfixList : public QAbstractListModel {
+  Q_OBJECT
+
+public:
+  using Entry = ProjectSearch::Match;
+
+  explicit QuickfixList(QObject *parent = nullptr);
+
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  QVariant data(const QModelIndex &index, int role) const override;
+
+  // File names are shown relative to the directory.
+  void reset(const QString &baseDirectory);
+  // Inserts the matches of one or more files; the matches of a file must be
+  // next to each other.
+  void add(const QVector<Entry> &entries);
+
+  int count() const { return m_entries.size(); }
+  const Entry &entry(int row) const { return m_entries[row]; }
+
+  // Index of the entry visited last or -1.
+  int current() const { return m_current; }
+  void setCurrent(int row);
+
+  // Entry as "file:line:column: text".
+  QString entryText(int row) const;
+
+private:
+  QString m_baseDirectory;
+  QVector<Entry> m_entries;
+  int m_current = -1;
+};
+
+} // namespace WolfEdit
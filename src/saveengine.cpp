@@ -0,0 +1,217 @@
+#include "saveengine.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace WolfEdit {
+
+// Number of characters encoded at a time.
+static const int SLICE_SIZE = 256 * 1024;
+
+SaveEngine::SaveEngine(QObject *parent) : QObject(parent) {}
+
+SaveEngine::~SaveEngine() {
+  // Never abandon a write half way; the user asked for the file to be saved.
+  waitForFinished();
+}
+
+void SaveEngine::save(const QString &filePath,
+                      const PieceTable::Snapshot &snapshot,
+                      const FileFormat &format, const QString &undoFilePath,
+                      const FakeVim::Internal::UndoJournal::History
+                          &undoHistory) {
+  m_pending.filePath = filePath;
+  m_pending.snapshot = snapshot;
+  m_pending.format = format;
+  m_pending.undoFilePath = undoFilePath;
+  m_pending.undoHistory = undoHistory;
+  m_hasPending = true;
+  if (!m_worker) {
+    startNext();
+  }
+}
+
+void SaveEngine::waitForFinished() {
+  while (m_worker) {
+    m_worker->wait();
+    deliver();
+  }
+}
+
+void SaveEngine::startNext() {
+  if (!m_hasPending) {
+    return;
+  }
+  Request request = m_pending;
+  m_pending = Request();
+  m_hasPending = false;
+
+  m_worker = QThread::create([this, request] {
+    Result result = write(request);
+    {
+      QMutexLocker locker(&m_resultMutex);
+      m_result = result;
+      m_hasResult = true;
+    }
+    QMetaObject::invokeMethod(
+        this, [this] { deliver(); }, Qt::QueuedConnection);
+  });
+  m_worker->start();
+}
+
+void SaveEngine::deliver() {
+  Result result;
+  {
+    QMutexLocker locker(&m_resultMutex);
+    if (!m_hasResult) {
+      return;
+    }
+    result = m_result;
+    m_hasResult = false;
+  }
+
+  m_worker->wait();
+  delete m_worker;
+  m_worker = nullptr;
+
+  emit finished(result);
+  startNext();
+}
+
+SaveEngine::Result SaveEngine::write(const Request &request) {
+  Result result;
+  result.filePath = request.filePath;
+  result.existed = QFileInfo::exists(request.filePath);
+  result.fingerprint = request.snapshot.fingerprint();
+  result.format = request.format;
+
+  QSaveFile file(request.filePath);
+  if (!file.open(QIODevice::WriteOnly)) {
+    result.error = file.errorString();
+    return result;
+  }
+
+  qint64 bytes = 0;
+  qint64 lines = 0;
+  bool empty = true;
+  QChar last;
+  // Reused for every slice, so that nothing is allocated per piece.
+  QByteArray buffer;
+  TextEncoder encoder(request.format);
+  const auto writeEncoded = [&](const QByteArray &encoded) {
+    if (file.write(encoded) != encoded.size()) {
+      return false;
+    }
+    bytes += encoded.size();
+    return true;
+  };
+  const auto writeChunk = [&](const QChar *data, int length) {
+    lines += std::count(data, data + length, QLatin1Char('\n'));
+    last = data[length - 1];
+    empty = false;
+    // A piece may be the whole file as it was loaded; encode it in slices to
+    // keep the buffer small.
+    for (int i = 0; i < length; i += SLICE_SIZE) {
+      encoder.encode(data + i, qMin(SLICE_SIZE, length - i), &buffer);
+      if (!writeEncoded(buffer)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  bool written = writeEncoded(request.format.byteOrderMark()) &&
+                 request.snapshot.forEachChunk(writeChunk);
+  if (written) {
+    encoder.finish(&buffer);
+    written = writeEncoded(buffer);
+  }
+  if (!written) {
+    result.error = file.errorString();
+    file.cancelWriting();
+    return result;
+  }
+  if (!encoder.isLossless()) {
+    // Rather than drop characters the encoding of the file cannot hold,
+    // write it as UTF-8.
+    file.cancelWriting();
+    Request converted = request;
+    converted.format.encoding = FileFormat::Utf8;
+    converted.format.bom = false;
+    result = write(converted);
+    result.converted = true;
+    return result;
+  }
+
+  if (!file.flush()) {
+    result.error = file.errorString();
+    file.cancelWriting();
+    return result;
+  }
+#ifdef Q_OS_UNIX
+  if (::fsync(file.handle()) != 0) {
+    result.error = QObject::tr("Cannot sync file to disk");
+    file.cancelWriting();
+    return result;
+  }
+#endif
+  if (!file.commit()) {
+    result.error = file.errorString();
+    return result;
+  }
+#ifdef Q_OS_UNIX
+  // Make the rename itself durable.
+  const QByteArray dir =
+      QFile::encodeName(QFileInfo(request.filePath).absolutePath());
+  const int dirFd = ::open(dir.constData(), O_RDONLY);
+  if (dirFd != -1) {
+    ::fsync(dirFd);
+    ::close(dirFd);
+  }
+#endif
+
+  // Count an unterminated last line like Vim does.
+  if (!empty && last != QLatin1Char('\n')) {
+    ++lines;
+  }
+  result.ok = true;
+  result.bytes = bytes;
+  result.lines = lines;
+  result.undoError = writeUndoFile(request);
+  return result;
+}
+
+QString SaveEngine::writeUndoFile(const Request &request) {
+  using FakeVim::Internal::UndoJournal;
+  if (request.undoFilePath.isEmpty()) {
+    return QString();
+  }
+  // Same as UndoJournal::hashText() of the whole text.
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  request.snapshot.forEachChunk([&hash](const QChar *data, int length) {
+    hash.addData(reinterpret_cast<const char *>(data),
+                 length * int(sizeof(QChar)));
+    return true;
+  });
+  QString error;
+  if (!QDir().mkpath(QFileInfo(request.undoFilePath).path())) {
+    return QObject::tr("Cannot create directory");
+  }
+  if (!UndoJournal::save(request.undoFilePath, request.undoHistory,
+                         hash.result(), &error)) {
+    return error;
+  }
+  return QString();
+}
+
+} // namespace WolfEdit
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <fakevim/fakevimundo.h>
+
+#include "piecetable.h"
+#include "textcodec.h"
+
+class QThread;
+
+namespace WolfEdit {
+
+// Writes buffer snapshots to disk on a background thread.
+//
+// The snapshot is encoded in the format of the file (see TextEncoder) and
+// written to a temporary file next to the target, flushed with fsync and then
+// atomically renamed over the target, so a crash at any point leaves either
+// the old or the new file, never a truncated one.
+// Byte and line counts are taken from the data as it is written. The undo file
+// is written on the same thread once the file is on disk.
+class SaveEngine : public QObject {
+  Q_OBJECT
+
+public:
+  struct Result {
+    QString filePath;
+    bool ok = false;
+    QString error;
+    qint64 bytes = 0;
+    qint64 lines = 0;
+    // Whether the file existed before it was written.
+    bool existed = false;
+    // Fingerprint of the text that was written.
+    Fingerprint fingerprint;
+    // Format the file was written in. It is UTF-8 instead of the requested
+    // Latin-1 if that cannot hold the text; converted is set then.
+    FileFormat format;
+    bool converted = false;
+    // Set if the undo file could not be written.
+    QString undoError;
+  };
+
+  explicit SaveEngine(QObject *parent = nullptr);
+  ~SaveEngine() override;
+
+  // Starts writing snapshot to filePath. If a save is already running, the
+  // request is queued and only the most recent queued request is kept.
+  // If undoFilePath is set, the history (taken together with the snapshot) is
+  // written to it as well.
+  void save(const QString &filePath, const PieceTable::Snapshot &snapshot,
+            const FileFormat &format = FileFormat(),
+            const QString &undoFilePath = QString(),
+            const FakeVim::Internal::UndoJournal::History &undoHistory =
+                FakeVim::Internal::UndoJournal::History());
+
+  bool isSaving() const { return m_worker != nullptr; }
+
+  // Blocks until all requested saves are written and reported.
+  void waitForFinished();
+
+signals:
+  void finished(const WolfEdit::SaveEngine::Result &result);
+
+private:
+  struct Request {
+    QString filePath;
+    PieceTable::Snapshot snapshot;
+    FileFormat format;
+    QString undoFilePath;
+    FakeVim::Internal::UndoJournal::History undoHistory;
+  };
+
+  void startNext();
+  void deliver();
+  static Result write(const Request &request);
+  static QString writeUndoFile(const Request &request);
+
+  QThread *m_worker = nullptr;
+  bool m_hasPending = false;
+  Request m_pending;
+
+  QMutex m_resultMutex;
+  bool m_hasResult = false;
+  Result m_result;
+};
+
+} // namespace WolfEdit
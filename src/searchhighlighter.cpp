@@ -0,0 +1,132 @@
+#include "searchhighlighter.h"
+
+#include "blockdata.h"
+
+#include <fakevim/fakevimperf.h>
+
+#include <QEvent>
+#include <QPlainTextEdit>
+#include <QScrollBar>
+#include <QTextBlock>
+#include <QTextDocument>
+
+namespace WolfEdit {
+
+// Number of characters highlighted around the viewport in addition to the
+// visible text, so that scrolling a little does not show unhighlighted matches
+// before the next update.
+static const int MIN_MARGIN = 4096;
+
+SearchHighlighter::SearchHighlighter(QPlainTextEdit *editor, QObject *parent)
+    : QObject(parent), m_editor(editor) {
+  m_updateTimer.setSingleShot(true);
+  m_updateTimer.setInterval(0);
+  connect(&m_updateTimer, &QTimer::timeout, this, &SearchHighlighter::update);
+
+  connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this,
+          &SearchHighlighter::scheduleUpdate);
+  connect(editor->horizontalScrollBar(), &QScrollBar::valueChanged, this,
+          &SearchHighlighter::scheduleUpdate);
+  connect(editor->document(), &QTextDocument::contentsChange, this,
+          &SearchHighlighter::onContentsChange);
+  editor->viewport()->installEventFilter(this);
+}
+
+void SearchHighlighter::setPattern(const QString &pattern) {
+  if (pattern != m_pattern) {
+    m_pattern = pattern;
+    m_re = QRegularExpression(pattern);
+    m_re.optimize();
+    ++m_generation;
+  }
+  scheduleUpdate();
+}
+
+bool SearchHighlighter::eventFilter(QObject *watched, QEvent *event) {
+  if (event->type() == QEvent::Resize) {
+    scheduleUpdate();
+  }
+  return QObject::eventFilter(watched, event);
+}
+
+void SearchHighlighter::onContentsChange(int position, int /*charsRemoved*/,
+                                         int charsAdded) {
+  // Only the blocks touched by the edit need to be scanned again.
+  QTextDocument *doc = m_editor->document();
+  const QTextBlock end = doc->findBlock(position + charsAdded).next();
+  for (QTextBlock block = doc->findBlock(position);
+       block.isValid() && block != end; block = block.next()) {
+    if (auto *data = static_cast<BlockData *>(block.userData())) {
+      data->searchGeneration = -1;
+    }
+  }
+  scheduleUpdate();
+}
+
+void SearchHighlighter::scheduleUpdate() {
+  if (!m_pattern.isEmpty() || !m_selections.isEmpty()) {
+    m_updateTimer.start();
+  }
+}
+
+void SearchHighlighter::update() {
+  FAKEVIM_PERF_SCOPE("searchHighlight");
+  m_selections.clear();
+
+  if (!m_pattern.isEmpty() && m_re.isValid()) {
+    QTextDocument *doc = m_editor->document();
+    const QRect rect = m_editor->viewport()->rect();
+    const int first = m_editor->cursorForPosition(rect.topLeft()).position();
+    const int last = m_editor->cursorForPosition(rect.bottomRight()).position();
+    const int margin = qMax(MIN_MARGIN, last - first);
+    const int from = qMax(0, first - margin);
+    const int to = last + margin;
+
+    QTextEdit::ExtraSelection selection;
+    selection.format.setBackground(Qt::yellow);
+    selection.format.setForeground(Qt::black);
+
+    for (QTextBlock block = doc->findBlock(from);
+         block.isValid() && block.position() <= to; block = block.next()) {
+      const int position = block.position();
+      for (const BlockData::Range &match : matches(block)->searchMatches) {
+        const int start = position + match.start;
+        if (start + match.length < from) {
+          continue;
+        }
+        if (start > to) {
+          break;
+        }
+        selection.cursor = QTextCursor(doc);
+        selection.cursor.setPosition(start);
+        selection.cursor.setPosition(start + match.length,
+                                     QTextCursor::KeepAnchor);
+        m_selections.append(selection);
+      }
+    }
+  }
+
+  emit selectionsChanged();
+}
+
+const BlockData *SearchHighlighter::matches(const QTextBlock &block) {
+  BlockData *data = BlockData::of(block);
+  if (data->searchGeneration == m_generation) {
+    return data;
+  }
+
+  data->searchGeneration = m_generation;
+  data->searchMatches.clear();
+
+  QRegularExpressionMatchIterator it = m_re.globalMatch(block.text());
+  while (it.hasNext()) {
+    const QRegularExpressionMatch match = it.next();
+    if (match.capturedLength() > 0) {
+      data->searchMatches.append(
+          {match.capturedStart(), match.capturedLength()});
+    }
+  }
+  return data;
+}
+
+} // namespace WolfEdit
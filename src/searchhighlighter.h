@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QRegularExpression>
+#include <QTextEdit>
+#include <QTimer>
+
+class QPlainTextEdit;
+class QTextBlock;
+
+namespace WolfEdit {
+
+class BlockData;
+
+// Highlights search matches in a QPlainTextEdit.
+//
+// Matches are cached per block and only recomputed for blocks whose text
+// changed since the last scan. Selections are built only for the blocks in or
+// near the viewport and rebuilt lazily when the editor is scrolled, resized
+// or edited, so the cost of an update does not depend on the document size.
+class SearchHighlighter : public QObject {
+  Q_OBJECT
+
+public:
+  explicit SearchHighlighter(QPlainTextEdit *editor, QObject *parent = nullptr);
+
+  // Sets the (Qt regular expression) pattern to highlight. An empty pattern
+  // clears the highlights. Setting the same pattern again only refreshes the
+  // visible matches.
+  void setPattern(const QString &pattern);
+  QString pattern() const { return m_pattern; }
+
+  QList<QTextEdit::ExtraSelection> selections() const { return m_selections; }
+
+signals:
+  void selectionsChanged();
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+  void onContentsChange(int position, int charsRemoved, int charsAdded);
+  void scheduleUpdate();
+  void update();
+  const BlockData *matches(const QTextBlock &block);
+
+  QPlainTextEdit *m_editor;
+  QString m_pattern;
+  QRegularExpression m_re;
+  // Incremented when the pattern changes to invalidate all cached matches.
+  int m_generation = 0;
+  QTimer m_updateTimer;
+  QList<QTextEdit::ExtraSelection> m_selections;
+};
+
+} // namespace WolfEdit
@@ -0,0 +1,558 @@
+#include "swapfile.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QStandardPaths>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QThread>
+
+#include <fakevim/fakevimactions.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "textbuffer.h"
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace WolfEdit {
+
+static const quint32 SWAP_MAGIC = 0x57535750; // "WSWP"
+static const quint32 SWAP_VERSION = 1;
+static const QDataStream::Version STREAM_VERSION = QDataStream::Qt_5_12;
+
+// Records following the header.
+enum SwapRecord : quint8 { EditRecord = 1, TextRecord = 2 };
+
+// Time between syncs of the swap files to disk. Changes made within the last
+// interval may be lost in a crash.
+static const int SYNC_INTERVAL = 200;
+// The journal is compacted once it is larger than the text and this size.
+static const qint64 COMPACT_MIN_SIZE = 1024 * 1024;
+// Size of an edit record without the inserted text.
+static const int EDIT_RECORD_SIZE = 13;
+
+static void writeHeader(QDataStream &out, const QString &filePath,
+                        const Fingerprint &fingerprint) {
+  out << SWAP_MAGIC << SWAP_VERSION << filePath
+      << qint64(QCoreApplication::applicationPid()) << fingerprint.hash
+      << fingerprint.length;
+}
+
+static bool readHeader(QDataStream &in, SwapFile::Info *info,
+                       Fingerprint *fingerprint) {
+  quint32 magic = 0;
+  quint32 version = 0;
+  in >> magic >> version;
+  if (magic != SWAP_MAGIC || version != SWAP_VERSION) {
+    return false;
+  }
+  in >> info->filePath >> info->pid >> fingerprint->hash >>
+      fingerprint->length;
+  return in.status() == QDataStream::Ok;
+}
+
+// A swap file as seen by the writer thread. Everything but owner is only
+// used by the writer thread.
+struct SwapChannel {
+  QFile file;
+  QString filePath;
+  bool failed = false;
+  // Set to nullptr (under the mutex) once the SwapFile is destroyed.
+  QMutex ownerMutex;
+  SwapFile *owner = nullptr;
+};
+
+struct SwapCommand {
+  enum Type { Open, Edit, Restart, Compact, Remove };
+  Type type = Edit;
+  std::shared_ptr<SwapChannel> channel;
+  int position = 0;
+  int removed = 0;
+  QString text;
+  QString swapPath;
+  QString filePath;
+  Fingerprint fingerprint;
+  PieceTable::Snapshot snapshot;
+  // Released once the command is done.
+  QSemaphore *done = nullptr;
+};
+
+// The thread that writes all swap files. Commands are passed in an intrusive
+// multi-producer single-consumer queue: pushing is one allocation, one atomic
+// exchange and a semaphore release, and the writer never blocks the GUI
+// thread. The writer sleeps until a command is pushed. After writing what is
+// queued it syncs the files that were written and waits for SYNC_INTERVAL, so
+// that the edits typed meanwhile are synced together.
+struct SwapWriter {
+  struct Node {
+    std::atomic<Node *> next{nullptr};
+    SwapCommand command;
+  };
+
+  // The writer, which is started on first use and stopped when the
+  // application exits. Returns nullptr once it is stopped.
+  static SwapWriter *instance();
+
+  SwapWriter() : head(new Node), tail(head) {}
+  ~SwapWriter() {
+    while (head) {
+      Node *next = head->next.load();
+      delete head;
+      head = next;
+    }
+  }
+
+  void push(SwapCommand command) {
+    Node *node = new Node;
+    node->command = std::move(command);
+    Node *previous = tail.exchange(node, std::memory_order_acq_rel);
+    const bool waited = node->command.done;
+    previous->next.store(node, std::memory_order_release);
+    wakeup.release();
+    if (waited) {
+      hurry.release();
+    }
+  }
+
+  bool pop(SwapCommand *command) {
+    Node *next = head->next.load(std::memory_order_acquire);
+    if (!next) {
+      return false;
+    }
+    *command = std::move(next->command);
+    delete head;
+    head = next;
+    return true;
+  }
+
+  void run();
+  void shutdown();
+  bool execute(const SwapCommand &command);
+  bool compact(const SwapCommand &command);
+  static void sync(SwapChannel *channel);
+  static void fail(SwapChannel *channel, const QString &message);
+
+  // The writer owns head (a node that was already popped); pushing only
+  // touches tail.
+  Node *head;
+  std::atomic<Node *> tail;
+  // Released for every command pushed.
+  QSemaphore wakeup;
+  // Released to end the wait between syncs, when stopping or when a command
+  // is waited for.
+  QSemaphore hurry;
+  std::atomic<bool> stopping{false};
+  QThread *thread = nullptr;
+};
+
+static SwapWriter *swapWriter = nullptr;
+static bool swapWriterStopped = false;
+
+SwapWriter *SwapWriter::instance() {
+  if (!swapWriter && !swapWriterStopped) {
+    swapWriter = new SwapWriter;
+    swapWriter->thread = QThread::create([] { swapWriter->run(); });
+    swapWriter->thread->start();
+    qAddPostRoutine([] {
+      swapWriter->shutdown();
+      delete swapWriter;
+      swapWriter = nullptr;
+      swapWriterStopped = true;
+    });
+  }
+  return swapWriter;
+}
+
+void SwapWriter::run() {
+  for (;;) {
+    wakeup.acquire();
+    // Everything pushed before stopping was set is written below.
+    const bool stop = stopping.load(std::memory_order_acquire);
+    std::vector<std::shared_ptr<SwapChannel>> written;
+    int popped = 0;
+    SwapCommand command;
+    while (pop(&command)) {
+      ++popped;
+      if (execute(command) &&
+          std::find(written.begin(), written.end(), command.channel) ==
+              written.end()) {
+        written.push_back(command.channel);
+      }
+      if (command.done) {
+        command.done->release();
+      }
+    }
+    // The semaphore is released once per command (possibly just after it was
+    // popped); one release was taken above.
+    if (popped > 1) {
+      wakeup.acquire(popped - 1);
+    }
+    for (const std::shared_ptr<SwapChannel> &channel : written) {
+      sync(channel.get());
+    }
+    if (stop) {
+      break;
+    }
+    if (!written.empty()) {
+      hurry.tryAcquire(1, SYNC_INTERVAL);
+    }
+  }
+}
+
+void SwapWriter::shutdown() {
+  stopping.store(true, std::memory_order_release);
+  wakeup.release();
+  hurry.release();
+  thread->wait();
+  delete thread;
+  thread = nullptr;
+}
+
+// Returns true if something was written that still has to be synced.
+bool SwapWriter::execute(const SwapCommand &command) {
+  SwapChannel *channel = command.channel.get();
+  QFile &file = channel->file;
+  switch (command.type) {
+  case SwapCommand::Open:
+    file.close();
+    file.setFileName(command.swapPath);
+    channel->filePath = command.filePath;
+    channel->failed = false;
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+      fail(channel, file.errorString());
+      return false;
+    }
+    // The swap file contains the text of the file.
+    file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    break;
+  case SwapCommand::Restart:
+    if (!file.isOpen() || !file.resize(0) || !file.seek(0)) {
+      return false;
+    }
+    break;
+  case SwapCommand::Compact:
+    return compact(command);
+  case SwapCommand::Remove:
+    if (!file.fileName().isEmpty()) {
+      file.close();
+      QFile::remove(file.fileName());
+      file.setFileName(QString());
+    }
+    return false;
+  case SwapCommand::Edit:
+    if (!file.isOpen()) {
+      return false;
+    }
+    break;
+  }
+
+  QDataStream out(&file);
+  out.setVersion(STREAM_VERSION);
+  if (command.type == SwapCommand::Edit) {
+    out << quint8(EditRecord) << qint32(command.position)
+        << qint32(command.removed) << command.text.toUtf8();
+  } else {
+    writeHeader(out, channel->filePath, command.fingerprint);
+  }
+  if (out.status() != QDataStream::Ok) {
+    fail(channel, file.errorString());
+  }
+  return true;
+}
+
+// Replaces the swap file with one that has a copy of the text and no edits.
+bool SwapWriter::compact(const SwapCommand &command) {
+  SwapChannel *channel = command.channel.get();
+  QFile &file = channel->file;
+  if (!file.isOpen()) {
+    return false;
+  }
+  QSaveFile compacted(file.fileName());
+  if (!compacted.open(QIODevice::WriteOnly)) {
+    fail(channel, compacted.errorString());
+    return false;
+  }
+  compacted.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+  QDataStream out(&compacted);
+  out.setVersion(STREAM_VERSION);
+  writeHeader(out, channel->filePath, command.fingerprint);
+  out << quint8(TextRecord) << command.snapshot.text().toUtf8();
+  bool ok = out.status() == QDataStream::Ok && compacted.flush();
+#ifdef Q_OS_UNIX
+  ok = ok && ::fsync(compacted.handle()) == 0;
+#endif
+  if (!ok || !compacted.commit()) {
+    compacted.cancelWriting();
+    fail(channel, compacted.errorString());
+    return false;
+  }
+
+  file.close();
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+    fail(channel, file.errorString());
+  }
+  return false;
+}
+
+void SwapWriter::sync(SwapChannel *channel) {
+  QFile &file = channel->file;
+  if (!file.isOpen()) {
+    return;
+  }
+  bool ok = file.flush();
+#ifdef Q_OS_UNIX
+  ok = ok && ::fsync(file.handle()) == 0;
+#endif
+  if (!ok) {
+    fail(channel, file.errorString());
+  }
+}
+
+void SwapWriter::fail(SwapChannel *channel, const QString &message) {
+  channel->file.close();
+  if (channel->failed) {
+    return;
+  }
+  channel->failed = true;
+  // Events posted to the swap file are discarded if it is destroyed before
+  // they are delivered.
+  QMutexLocker locker(&channel->ownerMutex);
+  if (SwapFile *swapFile = channel->owner) {
+    QMetaObject::invokeMethod(
+        swapFile, [swapFile, message] { emit swapFile->writeError(message); },
+        Qt::QueuedConnection);
+  }
+}
+
+SwapFile::SwapFile(TextBuffer *buffer, QObject *parent)
+    : QObject(parent), m_buffer(buffer), m_channel(new SwapChannel) {
+  m_channel->owner = this;
+  connect(buffer, &TextBuffer::changed, this, &SwapFile::onChanged);
+  connect(buffer, &TextBuffer::reset, this, [this] {
+    if (isActive()) {
+      compact();
+    }
+  });
+}
+
+SwapFile::~SwapFile() {
+  {
+    QMutexLocker locker(&m_channel->ownerMutex);
+    m_channel->owner = nullptr;
+  }
+  // Wait for the swap file to be removed, so that a tab that opens the file
+  // again does not find it.
+  if (isActive() && SwapWriter::instance()) {
+    QSemaphore removed;
+    remove(&removed);
+    removed.acquire();
+  }
+}
+
+QString SwapFile::swapFilePath(const QString &filePath) {
+  using namespace FakeVim::Internal;
+  if (filePath.isEmpty() || !fakeVimSettings()->swapFile.value()) {
+    return QString();
+  }
+  QString dir = fakeVimSettings()->directory.value();
+  if (dir.isEmpty()) {
+    dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) +
+          QLatin1String("/swap");
+  }
+  QString name = QFileInfo(filePath).absoluteFilePath();
+  name.replace(QLatin1Char('/'), QLatin1Char('%'));
+  return dir + QLatin1Char('/') + name + QLatin1String(".swp");
+}
+
+bool SwapFile::readInfo(const QString &swapPath, Info *info, QString *error) {
+  QFile file(swapPath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    *error = file.errorString();
+    return false;
+  }
+  QDataStream in(&file);
+  in.setVersion(STREAM_VERSION);
+  Fingerprint fingerprint;
+  if (!readHeader(in, info, &fingerprint)) {
+    *error = tr("Not a swap file");
+    return false;
+  }
+  info->modified = QFileInfo(swapPath).lastModified();
+  return true;
+}
+
+bool SwapFile::isOwnerRunning(const Info &info) {
+  if (info.pid <= 0 || info.pid == QCoreApplication::applicationPid()) {
+    return false;
+  }
+#ifdef Q_OS_UNIX
+  return ::kill(pid_t(info.pid), 0) == 0 || errno == EPERM;
+#else
+  return false;
+#endif
+}
+
+bool SwapFile::recover(const QString &swapPath, TextBuffer *buffer,
+                       QString *error) {
+  QFile file(swapPath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    *error = file.errorString();
+    return false;
+  }
+  QDataStream in(&file);
+  in.setVersion(STREAM_VERSION);
+  Info info;
+  Fingerprint fingerprint;
+  if (!readHeader(in, &info, &fingerprint)) {
+    *error = tr("Not a swap file");
+    return false;
+  }
+
+  // Replay on a copy so that nothing changes if the journal doesn't apply.
+  PieceTable table(buffer->text());
+  bool matches = table.fingerprint() == fingerprint;
+  for (;;) {
+    quint8 type = 0;
+    in >> type;
+    QByteArray text;
+    if (type == TextRecord) {
+      in >> text;
+      if (in.status() != QDataStream::Ok) {
+        break;
+      }
+      table.setText(QString::fromUtf8(text));
+      matches = true;
+      continue;
+    }
+    if (type != EditRecord) {
+      break;
+    }
+    qint32 position = 0;
+    qint32 removed = 0;
+    in >> position >> removed >> text;
+    // The last record may be cut off by the crash.
+    if (in.status() != QDataStream::Ok) {
+      break;
+    }
+    if (!matches) {
+      *error = tr("The file has changed since the swap file was written");
+      return false;
+    }
+    if (position < 0 || removed < 0 || position > table.length() - removed) {
+      *error = tr("The swap file is damaged");
+      return false;
+    }
+    table.remove(position, removed);
+    table.insert(position, QString::fromUtf8(text));
+  }
+
+  if (table.fingerprint() != buffer->fingerprint()) {
+    QTextCursor cursor(buffer->document());
+    cursor.select(QTextCursor::Document);
+    cursor.insertText(table.text());
+  }
+  return true;
+}
+
+QString SwapFile::unusedSwapFilePath(const QString &swapPath) {
+  // Like Vim: .swp, .swo, .swn and so on.
+  QString path = swapPath;
+  for (char last = 'p'; last >= 'a' && QFileInfo::exists(path); --last) {
+    path[path.size() - 1] = QLatin1Char(last);
+  }
+  return path;
+}
+
+void SwapFile::start(const QString &swapPath, const QString &filePath) {
+  stop();
+  QDir().mkpath(QFileInfo(swapPath).path());
+  m_swapPath = swapPath;
+  m_filePath = filePath;
+  m_journalSize = 0;
+
+  SwapCommand command;
+  command.type = SwapCommand::Open;
+  command.swapPath = swapPath;
+  command.filePath = filePath;
+  command.fingerprint = m_buffer->fingerprint();
+  push(std::move(command));
+}
+
+void SwapFile::restart() {
+  if (!isActive()) {
+    return;
+  }
+  m_journalSize = 0;
+  SwapCommand command;
+  command.type = SwapCommand::Restart;
+  command.fingerprint = m_buffer->fingerprint();
+  push(std::move(command));
+}
+
+void SwapFile::compact() {
+  if (!isActive()) {
+    return;
+  }
+  m_journalSize = 0;
+  SwapCommand command;
+  command.type = SwapCommand::Compact;
+  command.fingerprint = m_buffer->fingerprint();
+  command.snapshot = m_buffer->snapshot();
+  push(std::move(command));
+}
+
+void SwapFile::stop() {
+  if (isActive()) {
+    remove(nullptr);
+  }
+}
+
+void SwapFile::remove(QSemaphore *done) {
+  m_swapPath.clear();
+  m_filePath.clear();
+  SwapCommand command;
+  command.type = SwapCommand::Remove;
+  command.done = done;
+  push(std::move(command));
+}
+
+void SwapFile::push(SwapCommand command) {
+  if (SwapWriter *writer = SwapWriter::instance()) {
+    command.channel = m_channel;
+    writer->push(std::move(command));
+  } else if (command.done) {
+    command.done->release();
+  }
+}
+
+void SwapFile::onChanged(int position, int charsRemoved, int charsAdded) {
+  if (!isActive()) {
+    return;
+  }
+  SwapCommand command;
+  command.position = position;
+  command.removed = charsRemoved;
+  command.text = m_buffer->table().mid(position, charsAdded);
+  m_journalSize += EDIT_RECORD_SIZE + command.text.size();
+  push(std::move(command));
+
+  if (m_journalSize > qMax(COMPACT_MIN_SIZE, qint64(m_buffer->length()))) {
+    compact();
+  }
+}
+
+} // namespace WolfEdit
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <QDateTime>
+#include <QObject>
+#include <QString>
+
+#include <memory>
+
+#include "piecetable.h"
+
+class QSemaphore;
+
+namespace WolfEdit {
+
+class TextBuffer;
+struct SwapChannel;
+struct SwapCommand;
+
+// Journal of the unsaved changes of a buffer, to recover them after a crash.
+//
+// Every change of the text buffer is appended to the swap file as a compact
+// record (position, number of removed characters and the inserted text). The
+// GUI thread only pushes records to a lock-free queue; one background thread,
+// shared by all swap files, writes them and syncs the files to disk in
+// batches, so a slow disk never delays typing. It sleeps while nothing is
+// edited. Once the journal is larger than the text, it is compacted to
+// a copy of the text. After a save it starts over from the saved text.
+class SwapFile : public QObject {
+  Q_OBJECT
+
+public:
+  // Header of a swap file.
+  struct Info {
+    QString filePath;
+    qint64 pid = 0;
+    QDateTime modified;
+  };
+
+  explicit SwapFile(TextBuffer *buffer, QObject *parent = nullptr);
+  // Removes the swap file; it is only left behind by a crash.
+  ~SwapFile() override;
+
+  // Swap file for the file if 'swapfile' is set or an empty string. Like the
+  // undo file, the path of the file with '/' replaced by '%' in 'directory'.
+  static QString swapFilePath(const QString &filePath);
+  // swapPath, or the first of the names Vim tries after it (.swo, .swn, ...)
+  // that is not taken.
+  static QString unusedSwapFilePath(const QString &swapPath);
+
+  static bool readInfo(const QString &swapPath, Info *info, QString *error);
+  // True if the process that wrote the swap file is still running.
+  static bool isOwnerRunning(const Info &info);
+
+  // Applies the journal in the swap file to the buffer, which has to have the
+  // text the journal started from unless the journal was compacted.
+  static bool recover(const QString &swapPath, TextBuffer *buffer,
+                      QString *error);
+
+  // Starts journaling changes to swapPath (replacing the file) from the
+  // current text of the buffer.
+  void start(const QString &swapPath, const QString &filePath);
+  // Starts over from the current text, e.g. after it was saved.
+  void restart();
+  // Replaces the journal with a copy of the current text, e.g. if the text
+  // the journal started from is no longer on disk.
+  void compact();
+  // Stops journaling and removes the swap file.
+  void stop();
+
+  bool isActive() const { return !m_swapPath.isEmpty(); }
+  QString swapPath() const { return m_swapPath; }
+  QString filePath() const { return m_filePath; }
+
+signals:
+  // Writing the swap file failed (reported once per swap file).
+  void writeError(const QString &message);
+
+private:
+  void onChanged(int position, int charsRemoved, int charsAdded);
+  void remove(QSemaphore *done);
+  void push(SwapCommand command);
+
+  TextBuffer *m_buffer;
+  QString m_swapPath;
+  QString m_filePath;
+  // Bytes journaled since the swap file was started or compacted.
+  qint64 m_journalSize = 0;
+  std::shared_ptr<SwapChannel> m_channel;
+};
+
+} // namespace WolfEdit
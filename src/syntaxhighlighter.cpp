@@ -0,0 +1,526 @@
+#include "syntaxhighlighter.h"
+
+#include "blockdata.h"
+#include "textbuffer.h"
+
+#include <fakevim/fakevimperf.h>
+
+#include <QEvent>
+#include <QMutexLocker>
+#include <QPlainTextEdit>
+#include <QRunnable>
+#include <QScrollBar>
+#include <QSemaphore>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTextLayout>
+#include <QThreadPool>
+
+#include <atomic>
+
+namespace WolfEdit {
+
+namespace {
+
+// Dirty blocks in front of the view are lexed synchronously if there are at
+// most this many; otherwise the view is lexed provisionally until the worker
+// gets there.
+const int MaxSyncBlocks = 1000;
+
+// Like Vim's 'synmaxcol': only the start of a longer line is lexed and the
+// state is carried over the line unchanged, so typing in a huge line stays
+// cheap. The rest of the line is not highlighted.
+const int MaxLexColumns = 3000;
+
+// Lines lexed by the worker per batch and batches it may be ahead of the GUI
+// thread. Once lexing has converged, the rest of the work is thrown away.
+const int BatchSize = 500;
+const int MaxPendingBatches = 4;
+
+const int StartDelay = 50;     // ms
+const int DeliverInterval = 16; // ms
+
+} // namespace
+
+struct SyntaxHighlighterJob {
+  struct Batch {
+    int firstLine;
+    QVector<int> states;
+    QVector<QVector<Lexer::Token>> tokens;
+  };
+
+  const Lexer *lexer = nullptr;
+  PieceTable::Snapshot snapshot;
+  int firstLine = 0;
+  int state = Lexer::InitialState;
+
+  std::atomic<bool> cancelled{false};
+  QSemaphore freeSlots{MaxPendingBatches};
+
+  QMutex mutex;
+  QVector<Batch> batches;
+  bool done = false;
+};
+
+namespace {
+
+using JobPtr = std::shared_ptr<SyntaxHighlighterJob>;
+
+// Lexes the snapshot from the first line of the job to the end.
+void lexSnapshot(SyntaxHighlighterJob *job) {
+  SyntaxHighlighterJob::Batch batch;
+  batch.firstLine = job->firstLine;
+  int line = 0;
+  int state = job->state;
+  QString pending; // Line split between chunks.
+
+  const auto push = [job, &batch]() {
+    if (batch.states.isEmpty()) {
+      return true;
+    }
+    job->freeSlots.acquire();
+    if (job->cancelled) {
+      return false;
+    }
+    const int next = batch.firstLine + batch.states.size();
+    {
+      QMutexLocker locker(&job->mutex);
+      job->batches.append(std::move(batch));
+    }
+    batch = SyntaxHighlighterJob::Batch();
+    batch.firstLine = next;
+    return true;
+  };
+
+  const auto lex = [job, &batch, &state](const QChar *text, int length) {
+    QVector<Lexer::Token> tokens;
+    const int next = job->lexer->lexLine(text, qMin(length, MaxLexColumns),
+                                         state, &tokens);
+    if (length <= MaxLexColumns) {
+      state = next;
+    }
+    batch.states.append(state);
+    batch.tokens.append(tokens);
+  };
+
+  const bool completed = job->snapshot.forEachChunk(
+      [&](const QChar *data, int size) {
+        int begin = 0;
+        while (begin < size) {
+          if (job->cancelled) {
+            return false;
+          }
+          int end = begin;
+          while (end < size && data[end] != QLatin1Char('\n')) {
+            ++end;
+          }
+          if (end == size) {
+            if (line >= job->firstLine) {
+              pending.append(data + begin, size - begin);
+            }
+            break;
+          }
+          if (line >= job->firstLine) {
+            if (pending.isEmpty()) {
+              lex(data + begin, end - begin);
+            } else {
+              pending.append(data + begin, end - begin);
+              lex(pending.constData(), pending.size());
+              pending.clear();
+            }
+            if (batch.states.size() == BatchSize && !push()) {
+              return false;
+            }
+          }
+          ++line;
+          begin = end + 1;
+        }
+        return !job->cancelled;
+      });
+
+  if (completed && line >= job->firstLine) {
+    // The last line has no line break.
+    lex(pending.constData(), pending.size());
+  }
+  if (completed) {
+    push();
+  }
+  QMutexLocker locker(&job->mutex);
+  job->done = true;
+}
+
+class LexTask : public QRunnable {
+public:
+  explicit LexTask(JobPtr job) : m_job(std::move(job)) {}
+  void run() override { lexSnapshot(m_job.get()); }
+
+private:
+  JobPtr m_job;
+};
+
+} // namespace
+
+SyntaxHighlighter::SyntaxHighlighter(QPlainTextEdit *editor,
+                                     TextBuffer *buffer, QObject *parent)
+    : QObject(parent), m_editor(editor), m_buffer(buffer),
+      m_formats(Lexer::TokenKindCount) {
+  m_formats[Lexer::Keyword].setForeground(Qt::darkBlue);
+  m_formats[Lexer::Keyword].setFontWeight(QFont::Bold);
+  m_formats[Lexer::Type].setForeground(Qt::darkMagenta);
+  m_formats[Lexer::Comment].setForeground(Qt::darkGreen);
+  m_formats[Lexer::Comment].setFontItalic(true);
+  m_formats[Lexer::String].setForeground(Qt::darkRed);
+  m_formats[Lexer::Number].setForeground(Qt::darkCyan);
+  m_formats[Lexer::Preprocessor].setForeground(Qt::darkYellow);
+  m_formats[Lexer::Variable].setForeground(Qt::darkCyan);
+
+  m_updateTimer.setSingleShot(true);
+  m_updateTimer.setInterval(0);
+  connect(&m_updateTimer, &QTimer::timeout, this, &SyntaxHighlighter::update);
+  m_startTimer.setSingleShot(true);
+  m_startTimer.setInterval(StartDelay);
+  connect(&m_startTimer, &QTimer::timeout, this,
+          &SyntaxHighlighter::startJob);
+  m_deliverTimer.setInterval(DeliverInterval);
+  connect(&m_deliverTimer, &QTimer::timeout, this,
+          &SyntaxHighlighter::deliver);
+
+  connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this,
+          &SyntaxHighlighter::scheduleUpdate);
+  connect(editor->document(), &QTextDocument::contentsChange, this,
+          &SyntaxHighlighter::onContentsChange);
+  editor->viewport()->installEventFilter(this);
+}
+
+SyntaxHighlighter::~SyntaxHighlighter() { cancelJob(); }
+
+void SyntaxHighlighter::setLexer(const Lexer *lexer) {
+  if (lexer == m_lexer) {
+    return;
+  }
+  cancelJob();
+  clearFormats();
+  m_lexer = lexer;
+  m_blockCount = m_editor->document()->blockCount();
+  if (m_lexer) {
+    m_dirtyFrom = 0;
+    m_dirtyTo = m_blockCount - 1;
+    scheduleUpdate();
+  } else {
+    m_dirtyFrom = m_dirtyTo = -1;
+  }
+}
+
+bool SyntaxHighlighter::eventFilter(QObject *watched, QEvent *event) {
+  if (event->type() == QEvent::Resize) {
+    scheduleUpdate();
+  }
+  return QObject::eventFilter(watched, event);
+}
+
+void SyntaxHighlighter::onContentsChange(int position, int /*charsRemoved*/,
+                                         int charsAdded) {
+  if (!m_lexer) {
+    return;
+  }
+  FAKEVIM_PERF_SCOPE("syntaxHighlight");
+  cancelJob();
+
+  QTextDocument *doc = m_editor->document();
+  const int blockCount = doc->blockCount();
+  const int delta = blockCount - m_blockCount;
+  m_blockCount = blockCount;
+
+  const QTextBlock firstBlock = doc->findBlock(position);
+  QTextBlock lastBlock = doc->findBlock(position + charsAdded);
+  if (!lastBlock.isValid()) {
+    lastBlock = doc->lastBlock();
+  }
+  const int first = firstBlock.blockNumber();
+  const int last = lastBlock.blockNumber();
+
+  // The layouts of the edited blocks may have lost their formats. If lines
+  // were joined or split, the data of the last block may belong to another
+  // line, so its state can't be used to tell whether lexing has converged.
+  for (QTextBlock block = firstBlock; block.isValid(); block = block.next()) {
+    if (auto *data = static_cast<BlockData *>(block.userData())) {
+      data->syntaxApplied = false;
+      if (block == lastBlock && (first != last || delta != 0)) {
+        data->syntaxState = -1;
+      }
+    }
+    if (block == lastBlock) {
+      break;
+    }
+  }
+
+  if (m_dirtyFrom == -1) {
+    m_dirtyFrom = first;
+    m_dirtyTo = last;
+  } else {
+    if (m_dirtyTo > first) {
+      m_dirtyTo = qMax(first, m_dirtyTo + delta);
+    }
+    m_dirtyFrom = qMin(m_dirtyFrom, first);
+    m_dirtyTo = qMax(m_dirtyTo, last);
+  }
+
+  // Highlight the edited blocks (and what follows on screen) before they are
+  // painted. Formats applied while the document emits the change are laid out
+  // together with it.
+  const int lines = screenLines();
+  const QTextBlock end =
+      doc->findBlockByNumber(qMin(first + lines, blockCount - 1));
+  if (m_dirtyFrom == first) {
+    lexDirty(first + lines);
+  } else {
+    lexProvisionally(firstBlock, first, end);
+  }
+  for (QTextBlock block = firstBlock; block.isValid(); block = block.next()) {
+    apply(block);
+    if (block == end) {
+      break;
+    }
+  }
+
+  scheduleUpdate();
+}
+
+void SyntaxHighlighter::scheduleUpdate() {
+  if (m_lexer) {
+    m_updateTimer.start();
+  }
+}
+
+void SyntaxHighlighter::update() {
+  if (!m_lexer) {
+    return;
+  }
+  FAKEVIM_PERF_SCOPE("syntaxHighlight");
+
+  const QRect rect = m_editor->viewport()->rect();
+  const QTextBlock first = m_editor->cursorForPosition(rect.topLeft()).block();
+  const QTextBlock last =
+      m_editor->cursorForPosition(rect.bottomRight()).block();
+  const int firstNumber = first.blockNumber();
+  const int lastNumber = last.blockNumber();
+
+  if (m_dirtyFrom != -1 && m_dirtyFrom <= lastNumber &&
+      lastNumber - m_dirtyFrom < MaxSyncBlocks) {
+    lexDirty(lastNumber);
+  }
+  if (m_dirtyFrom != -1 && m_dirtyFrom <= lastNumber &&
+      m_dirtyTo >= firstNumber) {
+    const int from = qMax(firstNumber, m_dirtyFrom);
+    const QTextBlock block =
+        from == firstNumber ? first
+                            : m_editor->document()->findBlockByNumber(from);
+    lexProvisionally(block, from, last);
+  }
+
+  for (QTextBlock block = first; block.isValid(); block = block.next()) {
+    apply(block);
+    if (block == last) {
+      break;
+    }
+  }
+
+  if (m_dirtyFrom != -1 && !m_job) {
+    m_startTimer.start();
+  }
+}
+
+// Lexes the block from state and returns the state at its end. A block
+// longer than MaxLexColumns is not copied whole.
+int SyntaxHighlighter::lexBlock(const QTextBlock &block, int state,
+                                QVector<Lexer::Token> *tokens) const {
+  if (block.length() - 1 > MaxLexColumns) {
+    const QString text =
+        m_buffer->documentText(block.position(), MaxLexColumns);
+    m_lexer->lexLine(text.constData(), text.size(), state, tokens);
+    return state;
+  }
+  const QString text = block.text();
+  return m_lexer->lexLine(text.constData(), text.size(), state, tokens);
+}
+
+// Lexes dirty blocks up to lastBlock or until lexing converges.
+void SyntaxHighlighter::lexDirty(int lastBlock) {
+  if (m_dirtyFrom == -1) {
+    return;
+  }
+  QTextBlock block = m_editor->document()->findBlockByNumber(m_dirtyFrom);
+  int state = stateBefore(block);
+  for (int number = m_dirtyFrom; block.isValid() && number <= lastBlock;
+       block = block.next(), ++number) {
+    QVector<Lexer::Token> tokens;
+    state = lexBlock(block, state, &tokens);
+    commit(block, number, state, tokens);
+    if (m_dirtyFrom == -1) {
+      break;
+    }
+  }
+}
+
+// Lexes the blocks in [from, to] that can't be lexed exactly yet from the
+// state cached in front of them. The states are not kept.
+void SyntaxHighlighter::lexProvisionally(const QTextBlock &from,
+                                         int fromNumber,
+                                         const QTextBlock &to) {
+  int state = stateBefore(from);
+  int number = fromNumber;
+  for (QTextBlock block = from; block.isValid() && number <= m_dirtyTo;
+       block = block.next(), ++number) {
+    QVector<Lexer::Token> tokens;
+    state = lexBlock(block, state, &tokens);
+    BlockData *data = BlockData::of(block);
+    if (data->syntaxTokens != tokens) {
+      data->syntaxTokens = tokens;
+      data->syntaxApplied = false;
+    }
+    if (block == to) {
+      break;
+    }
+  }
+}
+
+// Stores the result of exact lexing of the first dirty block and updates the
+// dirty range.
+void SyntaxHighlighter::commit(const QTextBlock &block, int number, int state,
+                               const QVector<Lexer::Token> &tokens) {
+  BlockData *data = BlockData::of(block);
+  const int oldState = data->syntaxState;
+  data->syntaxState = state;
+  if (data->syntaxTokens != tokens) {
+    data->syntaxTokens = tokens;
+    data->syntaxApplied = false;
+  }
+
+  if ((number >= m_dirtyTo && state == oldState) || !block.next().isValid()) {
+    m_dirtyFrom = m_dirtyTo = -1;
+    cancelJob();
+    return;
+  }
+  m_dirtyFrom = number + 1;
+  m_dirtyTo = qMax(m_dirtyTo, number + 1);
+}
+
+void SyntaxHighlighter::apply(const QTextBlock &block) {
+  BlockData *data = BlockData::of(block);
+  if (data->syntaxApplied) {
+    return;
+  }
+  QVector<QTextLayout::FormatRange> ranges;
+  ranges.reserve(data->syntaxTokens.size());
+  for (const Lexer::Token &token : data->syntaxTokens) {
+    ranges.append({token.start, token.length, m_formats[token.kind]});
+  }
+  block.layout()->setFormats(ranges);
+  m_buffer->markFormatsDirty(block.position(), block.length());
+  data->syntaxApplied = true;
+}
+
+void SyntaxHighlighter::clearFormats() {
+  QTextDocument *doc = m_editor->document();
+  for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+    auto *data = static_cast<BlockData *>(block.userData());
+    if (!data) {
+      continue;
+    }
+    if (data->syntaxApplied && !data->syntaxTokens.isEmpty()) {
+      block.layout()->clearFormats();
+      m_buffer->markFormatsDirty(block.position(), block.length());
+    }
+    data->syntaxState = -1;
+    data->syntaxTokens.clear();
+    data->syntaxApplied = false;
+  }
+}
+
+// Cached state at the end of the previous block.
+int SyntaxHighlighter::stateBefore(const QTextBlock &block) const {
+  const QTextBlock previous = block.previous();
+  const auto *data =
+      previous.isValid() ? static_cast<BlockData *>(previous.userData())
+                         : nullptr;
+  return data ? qMax(Lexer::InitialState, data->syntaxState)
+              : Lexer::InitialState;
+}
+
+int SyntaxHighlighter::screenLines() const {
+  return m_editor->viewport()->height() /
+             qMax(1, m_editor->fontMetrics().lineSpacing()) +
+         1;
+}
+
+void SyntaxHighlighter::startJob() {
+  if (!m_lexer || m_dirtyFrom == -1 || m_job) {
+    return;
+  }
+  const QTextBlock block =
+      m_editor->document()->findBlockByNumber(m_dirtyFrom);
+  m_job = std::make_shared<SyntaxHighlighterJob>();
+  m_job->lexer = m_lexer;
+  m_job->snapshot = m_buffer->snapshot();
+  m_job->firstLine = m_dirtyFrom;
+  m_job->state = stateBefore(block);
+  QThreadPool::globalInstance()->start(new LexTask(m_job));
+  m_deliverTimer.start();
+}
+
+void SyntaxHighlighter::cancelJob() {
+  m_startTimer.stop();
+  if (!m_job) {
+    return;
+  }
+  m_job->cancelled = true;
+  // Wake up the worker if it is waiting for the GUI thread.
+  m_job->freeSlots.release(MaxPendingBatches);
+  m_job.reset();
+  m_deliverTimer.stop();
+}
+
+void SyntaxHighlighter::deliver() {
+  if (!m_job) {
+    return;
+  }
+  FAKEVIM_PERF_SCOPE("syntaxHighlight");
+  const JobPtr job = m_job;
+  QVector<SyntaxHighlighterJob::Batch> batches;
+  bool done;
+  {
+    QMutexLocker locker(&job->mutex);
+    batches.swap(job->batches);
+    done = job->done;
+  }
+
+  QTextDocument *doc = m_editor->document();
+  for (const SyntaxHighlighterJob::Batch &batch : batches) {
+    job->freeSlots.release();
+    if (m_job != job || m_dirtyFrom == -1) {
+      break;
+    }
+    // Blocks may have been lexed synchronously in the meantime.
+    const int skip = m_dirtyFrom - batch.firstLine;
+    if (skip < 0) {
+      break;
+    }
+    QTextBlock block = doc->findBlockByNumber(m_dirtyFrom);
+    for (int i = skip; i < batch.states.size() && block.isValid() &&
+                       m_job == job;
+         ++i, block = block.next()) {
+      commit(block, batch.firstLine + i, batch.states[i], batch.tokens[i]);
+    }
+  }
+
+  if (m_job == job && done) {
+    m_job.reset();
+    m_deliverTimer.stop();
+    if (m_dirtyFrom != -1) {
+      m_startTimer.start();
+    }
+  }
+  scheduleUpdate();
+}
+
+} // namespace WolfEdit
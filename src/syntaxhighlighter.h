@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QObject>
+#include <QTextCharFormat>
+#include <QTimer>
+#include <QVector>
+
+#include <memory>
+
+#include "lexer.h"
+
+class QPlainTextEdit;
+class QTextBlock;
+
+namespace WolfEdit {
+
+class TextBuffer;
+struct SyntaxHighlighterJob;
+
+// Highlights the syntax of the text in a QPlainTextEdit.
+//
+// The lexer state at the end of every block and the tokens are cached in the
+// block data. After an edit only the edited blocks are lexed again, and lexing
+// continues with the following blocks only until the state at the end of a
+// block is the same as before the edit (e.g. after typing "/*" up to the next
+// "*/"). Only the blocks on screen are lexed and formatted synchronously; the
+// rest of the document is lexed from a snapshot of the text buffer on a worker
+// thread and formats are applied once blocks are scrolled into view. Until
+// the worker has caught up, visible blocks below outdated ones are lexed from
+// the state cached before the edit, which is usually right.
+class SyntaxHighlighter : public QObject {
+  Q_OBJECT
+
+public:
+  SyntaxHighlighter(QPlainTextEdit *editor, TextBuffer *buffer,
+                    QObject *parent = nullptr);
+  ~SyntaxHighlighter() override;
+
+  // Sets the lexer for the document; nullptr turns highlighting off.
+  void setLexer(const Lexer *lexer);
+  const Lexer *lexer() const { return m_lexer; }
+
+  // True while some blocks may still have outdated highlighting.
+  bool isPending() const { return m_dirtyFrom != -1; }
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+  void onContentsChange(int position, int charsRemoved, int charsAdded);
+  void scheduleUpdate();
+  void update();
+
+  int lexBlock(const QTextBlock &block, int state,
+               QVector<Lexer::Token> *tokens) const;
+  void lexDirty(int lastBlock);
+  void lexProvisionally(const QTextBlock &from, int fromNumber,
+                        const QTextBlock &to);
+  void commit(const QTextBlock &block, int number, int state,
+              const QVector<Lexer::Token> &tokens);
+  void apply(const QTextBlock &block);
+  void clearFormats();
+  int stateBefore(const QTextBlock &block) const;
+  int screenLines() const;
+
+  void startJob();
+  void cancelJob();
+  void deliver();
+
+  QPlainTextEdit *m_editor;
+  TextBuffer *m_buffer;
+  const Lexer *m_lexer = nullptr;
+  QVector<QTextCharFormat> m_formats;
+
+  // Blocks in front of m_dirtyFrom are up to date. Blocks after m_dirtyTo were
+  // lexed from the state m_dirtyTo had before the edit and become up to date
+  // once lexing reaches the same state again. Both are -1 if all blocks are up
+  // to date.
+  int m_dirtyFrom = -1;
+  int m_dirtyTo = -1;
+  int m_blockCount = 0;
+
+  QTimer m_updateTimer;
+  // Delays the worker while the document keeps changing.
+  QTimer m_startTimer;
+  QTimer m_deliverTimer;
+  std::shared_ptr<SyntaxHighlighterJob> m_job;
+};
+
+} // namespace WolfEdit
@@ -0,0 +1,80 @@
+#include "textbuffer.h"
+
+#include <QMetaMethod>
+#include <QTextCursor>
+#include <QTextDocument>
+
+namespace WolfEdit {
+
+TextBuffer::TextBuffer(QTextDocument *document, QObject *parent)
+    : QObject(parent), m_document(document) {
+  resync();
+  connect(m_document, &QTextDocument::contentsChange, this,
+          &TextBuffer::onContentsChange);
+}
+
+QString TextBuffer::documentText(int position, int count) const {
+  if (count <= 0) {
+    return QString();
+  }
+  QTextCursor cursor(m_document);
+  cursor.setPosition(position);
+  cursor.setPosition(position + count, QTextCursor::KeepAnchor);
+  QString text = cursor.selectedText();
+  text.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+  return text;
+}
+
+void TextBuffer::markFormatsDirty(int position, int length) {
+  m_formatsOnly = true;
+  m_document->markContentsDirty(position, length);
+  m_formatsOnly = false;
+}
+
+void TextBuffer::onContentsChange(int position, int charsRemoved,
+                                  int charsAdded) {
+  if (m_formatsOnly && charsRemoved == charsAdded) {
+    return;
+  }
+
+  // The counts reported by QTextDocument may include the implicit paragraph
+  // separator at the end of the document, which is not part of the text.
+  const int docLength = documentLength();
+  const int removed = qBound(0, charsRemoved, m_table.length() - position);
+  const int added = qBound(0, charsAdded, docLength - position);
+  const QString inserted = documentText(position, added);
+
+  // Other format changes are reported as replacing a range with itself.
+  if (removed == added && m_table.equals(position, inserted)) {
+    return;
+  }
+
+  static const QMetaMethod editedSignal =
+      QMetaMethod::fromSignal(&TextBuffer::edited);
+  const bool wantEdits = isSignalConnected(editedSignal);
+  const QString removedText =
+      wantEdits ? m_table.mid(position, removed) : QString();
+
+  m_table.remove(position, removed);
+  m_table.insert(position, inserted);
+
+  if (m_table.length() != docLength) {
+    resync();
+    return;
+  }
+  emit changed(position, removed, added);
+  if (wantEdits) {
+    emit edited(position, removedText, inserted);
+  }
+}
+
+int TextBuffer::documentLength() const {
+  return qMax(0, m_document->characterCount() - 1);
+}
+
+void TextBuffer::resync() {
+  m_table.setText(documentText(0, documentLength()));
+  emit reset();
+}
+
+} // namespace WolfEdit
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QObject>
+
+#include "piecetable.h"
+
+class QTextDocument;
+
+namespace WolfEdit {
+
+// Mirror of the QTextDocument edited by FakeVim and the view in a PieceTable.
+//
+// The document is still what holds the text: FakeVim and the widgets work on
+// it through the usual QTextCursor operations, and every contentsChange is
+// copied into the piece table. The table is an extra copy of the text, so a
+// tab takes more memory than the document alone. What it buys is that
+// anything that needs the whole buffer (saving, fingerprints, the swap
+// journal) reads the piece table instead of walking the document, and can
+// take a cheap snapshot to do its work on a background thread.
+class TextBuffer : public QObject {
+  Q_OBJECT
+
+public:
+  explicit TextBuffer(QTextDocument *document, QObject *parent = nullptr);
+
+  QTextDocument *document() const { return m_document; }
+  const PieceTable &table() const { return m_table; }
+  PieceTable::Snapshot snapshot() const { return m_table.snapshot(); }
+
+  int length() const { return m_table.length(); }
+  QString text() const { return m_table.text(); }
+  Fingerprint fingerprint() const { return m_table.fingerprint(); }
+
+  // Text of the document in [position, position + count) with line breaks as
+  // '\n'.
+  QString documentText(int position, int count) const;
+
+  // Lays out [position, position + length) again after its formats changed
+  // (e.g. by a highlighter). Unlike QTextDocument::markContentsDirty(), the
+  // text is not compared with the table.
+  void markFormatsDirty(int position, int length);
+
+signals:
+  // Emitted after a change of the document has been applied to the table.
+  void changed(int position, int charsRemoved, int charsAdded);
+  // Same change with the replaced and the inserted text (only emitted if
+  // connected, e.g. for the undo journal).
+  void edited(int position, const QString &removed, const QString &inserted);
+  // Emitted if the table had to be rebuilt from the whole document.
+  void reset();
+
+private:
+  void onContentsChange(int position, int charsRemoved, int charsAdded);
+  int documentLength() const;
+  void resync();
+
+  QTextDocument *m_document;
+  PieceTable m_table;
+  // Set while the document reports a change of formats only.
+  bool m_formatsOnly = false;
+};
+
+} // namespace WolfEdit
@@ -0,0 +1,659 @@
+#include "textcodec.h"
+
+#include <QtAlgorithms>
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define WOLFEDIT_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace WolfEdit {
+
+// Decodes the UTF-8 sequence at p. Returns its length, 0 if it is cut off at
+// end or -1 if it is invalid (overlong, a surrogate or out of range).
+static int decodeUtf8(const uchar *p, const uchar *end, uint *codePoint) {
+  const uchar lead = p[0];
+  int length;
+  uint minimum;
+  uint value;
+  if (lead < 0x80) {
+    *codePoint = lead;
+    return 1;
+  } else if (lead >= 0xc2 && lead <= 0xdf) {
+    length = 2;
+    minimum = 0x80;
+    value = lead & 0x1f;
+  } else if (lead >= 0xe0 && lead <= 0xef) {
+    length = 3;
+    minimum = 0x800;
+    value = lead & 0x0f;
+  } else if (lead >= 0xf0 && lead <= 0xf4) {
+    length = 4;
+    minimum = 0x10000;
+    value = lead & 0x07;
+  } else {
+    return -1;
+  }
+  for (int i = 1; i < length; ++i) {
+    if (p + i == end) {
+      return 0;
+    }
+    if ((p[i] & 0xc0) != 0x80) {
+      return -1;
+    }
+    value = (value << 6) | (p[i] & 0x3f);
+  }
+  if (value < minimum || value > 0x10ffff ||
+      (value >= 0xd800 && value <= 0xdfff)) {
+    return -1;
+  }
+  *codePoint = value;
+  return length;
+}
+
+static uchar *encodeUtf8(uchar *out, uint codePoint) {
+  if (codePoint < 0x800) {
+    *out++ = uchar(0xc0 | (codePoint >> 6));
+  } else {
+    if (codePoint < 0x10000) {
+      *out++ = uchar(0xe0 | (codePoint >> 12));
+    } else {
+      *out++ = uchar(0xf0 | (codePoint >> 18));
+      *out++ = uchar(0x80 | ((codePoint >> 12) & 0x3f));
+    }
+    *out++ = uchar(0x80 | ((codePoint >> 6) & 0x3f));
+  }
+  *out++ = uchar(0x80 | (codePoint & 0x3f));
+  return out;
+}
+
+static ushort readUnit(const uchar *p, bool bigEndian) {
+  return bigEndian ? ushort(p[0] << 8 | p[1]) : ushort(p[0] | p[1] << 8);
+}
+
+static uchar *writeUnit(uchar *out, ushort unit, bool bigEndian) {
+  *out++ = uchar(bigEndian ? unit >> 8 : unit);
+  *out++ = uchar(bigEndian ? unit : unit >> 8);
+  return out;
+}
+
+#ifdef WOLFEDIT_SSE2
+static __m128i swapBytes(__m128i units) {
+  return _mm_or_si128(_mm_slli_epi16(units, 8), _mm_srli_epi16(units, 8));
+}
+#endif
+
+// Whether the bytes are UTF-8.
+static bool isUtf8(const uchar *p, const uchar *end) {
+  while (p < end) {
+#ifdef WOLFEDIT_SSE2
+    // Skip ASCII 32 bytes at a time; that is most of a typical file.
+    while (end - p >= 32) {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      const __m128i b =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+      if (_mm_movemask_epi8(_mm_or_si128(a, b))) {
+        break;
+      }
+      p += 32;
+    }
+#endif
+    while (p < end && *p < 0x80) {
+      ++p;
+    }
+    if (p == end) {
+      break;
+    }
+    uint codePoint;
+    const int length = decodeUtf8(p, end, &codePoint);
+    if (length <= 0) {
+      return false;
+    }
+    p += length;
+  }
+  return true;
+}
+
+// Whether there is a LF at all and one without CR before it, in 8-bit text.
+static void scanLineFeeds(const uchar *p, const uchar *end, bool *lf,
+                          bool *bareLf) {
+  const uchar *const begin = p;
+#ifdef WOLFEDIT_SSE2
+  // Compares each block with the block one byte before it, so the first byte
+  // is left to the scalar loop below.
+  if (end - p > 16) {
+    const __m128i lfs = _mm_set1_epi8('\n');
+    const __m128i crs = _mm_set1_epi8('\r');
+    const uchar *q = p + 1;
+    int seen = 0;
+    for (; end - q >= 16; q += 16) {
+      const __m128i bytes =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(q));
+      const __m128i before =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(q - 1));
+      const __m128i lineFeeds = _mm_cmpeq_epi8(bytes, lfs);
+      seen |= _mm_movemask_epi8(lineFeeds);
+      if (_mm_movemask_epi8(
+              _mm_andnot_si128(_mm_cmpeq_epi8(before, crs), lineFeeds))) {
+        *lf = *bareLf = true;
+        return;
+      }
+    }
+    *lf = seen != 0;
+    if (*p == '\n') {
+      *lf = *bareLf = true;
+      return;
+    }
+    p = q;
+  }
+#endif
+  for (; p < end; ++p) {
+    if (*p == '\n') {
+      *lf = true;
+      if (p == begin || p[-1] != '\r') {
+        *bareLf = true;
+        return;
+      }
+    }
+  }
+}
+
+// The same for UTF-16 text.
+static void scanLineFeeds16(const uchar *p, const uchar *end, bool bigEndian,
+                            bool *lf, bool *bareLf) {
+  const uchar *const begin = p;
+#ifdef WOLFEDIT_SSE2
+  if (end - p > 16) {
+    const __m128i lfs = _mm_set1_epi16('\n');
+    const __m128i crs = _mm_set1_epi16('\r');
+    const uchar *q = p + 2;
+    int seen = 0;
+    for (; end - q >= 16; q += 16) {
+      __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(q));
+      __m128i before =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(q - 2));
+      if (bigEndian) {
+        units = swapBytes(units);
+        before = swapBytes(before);
+      }
+      const __m128i lineFeeds = _mm_cmpeq_epi16(units, lfs);
+      seen |= _mm_movemask_epi8(lineFeeds);
+      if (_mm_movemask_epi8(
+              _mm_andnot_si128(_mm_cmpeq_epi16(before, crs), lineFeeds))) {
+        *lf = *bareLf = true;
+        return;
+      }
+    }
+    *lf = seen != 0;
+    if (readUnit(p, bigEndian) == '\n') {
+      *lf = *bareLf = true;
+      return;
+    }
+    p = q;
+  }
+#endif
+  for (; end - p >= 2; p += 2) {
+    if (readUnit(p, bigEndian) == '\n') {
+      *lf = true;
+      if (p == begin || readUnit(p - 2, bigEndian) != '\r') {
+        *bareLf = true;
+        return;
+      }
+    }
+  }
+}
+
+// Index of a noncharacter that can stand for a CR in a set of them: 0 to 31
+// for U+FDD0..U+FDEF, 32 and 33 for U+FFFE and U+FFFF, otherwise -1.
+static int noncharacterIndex(uint codePoint) {
+  if (codePoint >= 0xfdd0 && codePoint <= 0xfdef) {
+    return int(codePoint - 0xfdd0);
+  }
+  if (codePoint == 0xfffe || codePoint == 0xffff) {
+    return int(codePoint - 0xfffe) + 32;
+  }
+  return -1;
+}
+
+// The noncharacters in UTF-8 text. They are all EF B7 xx or EF BF xx.
+static quint64 usedNoncharacters(const uchar *p, const uchar *end) {
+  quint64 used = 0;
+  while (const void *found = std::memchr(p, 0xef, size_t(end - p))) {
+    p = static_cast<const uchar *>(found);
+    uint codePoint;
+    const int length = decodeUtf8(p, end, &codePoint);
+    const int index = length > 0 ? noncharacterIndex(codePoint) : -1;
+    if (index >= 0) {
+      used |= quint64(1) << index;
+    }
+    ++p;
+  }
+  return used;
+}
+
+// The same for UTF-16 text.
+static quint64 usedNoncharacters16(const uchar *p, const uchar *end,
+                                   bool bigEndian) {
+  quint64 used = 0;
+  for (; end - p >= 2; p += 2) {
+    const ushort unit = readUnit(p, bigEndian);
+    if (unit >= 0xfdd0) {
+      const int index = noncharacterIndex(unit);
+      if (index >= 0) {
+        used |= quint64(1) << index;
+      }
+    }
+  }
+  return used;
+}
+
+// Without a BOM, UTF-16 is recognized by the high (or low) byte of every
+// unit being zero in most of the first few kilobytes, which does not happen
+// in text in any 8-bit encoding.
+static bool looksLikeUtf16(const uchar *p, qint64 size,
+                           FileFormat::Encoding *encoding) {
+  if (size % 2) {
+    return false;
+  }
+  const qint64 units = qMin<qint64>(size, 4096) / 2;
+  qint64 zeros[2] = {0, 0};
+  for (qint64 i = 0; i < units * 2; ++i) {
+    if (!p[i]) {
+      ++zeros[i % 2];
+    }
+  }
+  for (int odd = 0; odd < 2; ++odd) {
+    if (zeros[odd] * 2 > units && zeros[1 - odd] * 16 < units) {
+      *encoding = odd ? FileFormat::Utf16LE : FileFormat::Utf16BE;
+      return true;
+    }
+  }
+  return false;
+}
+
+FileFormat FileFormat::detect(const char *data, qint64 size) {
+  const uchar *p = reinterpret_cast<const uchar *>(data);
+  FileFormat format;
+  if (size >= 3 && p[0] == 0xef && p[1] == 0xbb && p[2] == 0xbf) {
+    format.bom = true;
+  } else if (size >= 2 && p[0] == 0xff && p[1] == 0xfe) {
+    format.encoding = Utf16LE;
+    format.bom = true;
+  } else if (size >= 2 && p[0] == 0xfe && p[1] == 0xff) {
+    format.encoding = Utf16BE;
+    format.bom = true;
+  } else if (!looksLikeUtf16(p, size, &format.encoding) &&
+             !isUtf8(p, p + size)) {
+    format.encoding = Latin1;
+  }
+
+  const uchar *const start = p + format.bomSize();
+  bool lf = false;
+  bool bareLf = false;
+  quint64 used = 0;
+  if (format.encoding == Utf16LE || format.encoding == Utf16BE) {
+    const bool bigEndian = format.encoding == Utf16BE;
+    scanLineFeeds16(start, p + size, bigEndian, &lf, &bareLf);
+    used = usedNoncharacters16(start, p + size, bigEndian);
+  } else {
+    scanLineFeeds(start, p + size, &lf, &bareLf);
+    if (format.encoding == Utf8) {
+      used = usedNoncharacters(start, p + size);
+    }
+  }
+  format.crlf = lf && !bareLf;
+  for (int index = 0; index < 34; ++index) {
+    if (!(used & quint64(1) << index)) {
+      format.carriageReturn =
+          ushort(index < 32 ? 0xfdd0 + index : 0xfffe + index - 32);
+      break;
+    }
+  }
+  return format;
+}
+
+int FileFormat::bomSize() const {
+  if (!bom) {
+    return 0;
+  }
+  return encoding == Utf8 ? 3 : 2;
+}
+
+QByteArray FileFormat::byteOrderMark() const {
+  if (!bom) {
+    return QByteArray();
+  }
+  switch (encoding) {
+  case Utf8:
+    return QByteArrayLiteral("\xef\xbb\xbf");
+  case Utf16LE:
+    return QByteArrayLiteral("\xff\xfe");
+  case Utf16BE:
+    return QByteArrayLiteral("\xfe\xff");
+  case Latin1:
+    break;
+  }
+  return QByteArray();
+}
+
+QString FileFormat::tags() const {
+  QString tags;
+  switch (encoding) {
+  case Utf8:
+    break;
+  case Utf16LE:
+    tags += QStringLiteral("[utf-16le] ");
+    break;
+  case Utf16BE:
+    tags += QStringLiteral("[utf-16be] ");
+    break;
+  case Latin1:
+    tags += QStringLiteral("[latin1] ");
+    break;
+  }
+  if (bom) {
+    tags += QStringLiteral("[BOM] ");
+  }
+  if (crlf) {
+    tags += QStringLiteral("[dos] ");
+  }
+  return tags;
+}
+
+// UTF-8 or Latin-1 to UTF-16. With crlf, CR LF is turned into LF and a LF
+// without CR sets bareLf. Any other CR is kept as carriageReturn.
+static const uchar *decode8Bit(const uchar *p, const uchar *end, bool last,
+                               bool latin1, bool crlf, ushort carriageReturn,
+                               ushort **out, bool *errors, bool *bareLf) {
+  ushort *o = *out;
+  while (p < end) {
+#ifdef WOLFEDIT_SSE2
+    // Widen 16 bytes at a time up to the first CR (or LF with crlf, or
+    // non-ASCII byte in UTF-8). The whole block is stored; there is always
+    // room for it since no byte becomes more than one unit.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8(crlf ? '\n' : '\r');
+    while (end - p >= 16) {
+      const __m128i bytes =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      int special = _mm_movemask_epi8(_mm_or_si128(
+          _mm_cmpeq_epi8(bytes, cr), _mm_cmpeq_epi8(bytes, lf)));
+      if (!latin1) {
+        special |= _mm_movemask_epi8(bytes);
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(o),
+                       _mm_unpacklo_epi8(bytes, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(o + 8),
+                       _mm_unpackhi_epi8(bytes, zero));
+      const int n = special ? int(qCountTrailingZeroBits(uint(special))) : 16;
+      p += n;
+      o += n;
+      if (special) {
+        break;
+      }
+    }
+    if (p == end) {
+      break;
+    }
+#endif
+    const uchar byte = *p;
+    if (byte == '\r') {
+      if (crlf && p + 1 == end && !last) {
+        break;
+      }
+      if (crlf && p + 1 < end && p[1] == '\n') {
+        *o++ = '\n';
+        p += 2;
+      } else {
+        *o++ = carriageReturn;
+        ++p;
+      }
+      continue;
+    }
+    if (byte == '\n' && crlf) {
+      *bareLf = true;
+    }
+    if (byte < 0x80 || latin1) {
+      *o++ = byte;
+      ++p;
+      continue;
+    }
+    uint codePoint;
+    const int length = decodeUtf8(p, end, &codePoint);
+    if (length == 0 && !last) {
+      break;
+    }
+    if (length <= 0) {
+      *o++ = QChar::ReplacementCharacter;
+      *errors = true;
+      ++p;
+    } else if (QChar::requiresSurrogates(codePoint)) {
+      *o++ = QChar::highSurrogate(codePoint);
+      *o++ = QChar::lowSurrogate(codePoint);
+      p += length;
+    } else {
+      *o++ = ushort(codePoint);
+      p += length;
+    }
+  }
+  *out = o;
+  return p;
+}
+
+// UTF-16 in either byte order to UTF-16, with the line endings handled like
+// in decode8Bit().
+static const uchar *decodeUtf16(const uchar *p, const uchar *end, bool last,
+                                bool bigEndian, bool crlf,
+                                ushort carriageReturn, ushort **out,
+                                bool *bareLf) {
+  ushort *o = *out;
+  while (end - p >= 2) {
+#ifdef WOLFEDIT_SSE2
+    const __m128i cr = _mm_set1_epi16('\r');
+    const __m128i lf = _mm_set1_epi16(crlf ? '\n' : '\r');
+    while (end - p >= 16) {
+      __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      if (bigEndian) {
+        units = swapBytes(units);
+      }
+      const int special = _mm_movemask_epi8(
+          _mm_or_si128(_mm_cmpeq_epi16(units, cr), _mm_cmpeq_epi16(units, lf)));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(o), units);
+      const int n =
+          special ? int(qCountTrailingZeroBits(uint(special))) / 2 : 8;
+      p += 2 * n;
+      o += n;
+      if (special) {
+        break;
+      }
+    }
+    if (end - p < 2) {
+      break;
+    }
+#endif
+    const ushort unit = readUnit(p, bigEndian);
+    if (unit == '\r') {
+      if (crlf && end - p < 4 && !last) {
+        break;
+      }
+      if (crlf && end - p >= 4 && readUnit(p + 2, bigEndian) == '\n') {
+        *o++ = '\n';
+        p += 4;
+      } else {
+        *o++ = carriageReturn;
+        p += 2;
+      }
+      continue;
+    }
+    if (unit == '\n' && crlf) {
+      *bareLf = true;
+    }
+    *o++ = unit;
+    p += 2;
+  }
+  if (last && p < end) {
+    // An odd number of bytes.
+    *o++ = QChar::ReplacementCharacter;
+    p = end;
+  }
+  *out = o;
+  return p;
+}
+
+qint64 TextDecoder::decode(const char *data, qint64 size, bool last,
+                           QString *text) {
+  const uchar *begin = reinterpret_cast<const uchar *>(data);
+  const int oldSize = text->size();
+  // No byte becomes more than one UTF-16 unit, so decode in place.
+  text->resize(oldSize + int(size));
+  ushort *const outBegin = reinterpret_cast<ushort *>(text->data()) + oldSize;
+  ushort *out = outBegin;
+
+  const uchar *p;
+  switch (m_format.encoding) {
+  case FileFormat::Utf16LE:
+  case FileFormat::Utf16BE:
+    p = decodeUtf16(begin, begin + size, last,
+                    m_format.encoding == FileFormat::Utf16BE, m_format.crlf,
+                    m_format.carriageReturn, &out, &m_bareLf);
+    break;
+  default:
+    p = decode8Bit(begin, begin + size, last,
+                   m_format.encoding == FileFormat::Latin1, m_format.crlf,
+                   m_format.carriageReturn, &out, &m_errors, &m_bareLf);
+    break;
+  }
+
+  text->resize(oldSize + int(out - outBegin));
+  return p - begin;
+}
+
+void TextEncoder::encode(const QChar *data, int length, QByteArray *out) {
+  const bool crlf = m_format.crlf;
+  const ushort carriageReturn = m_format.carriageReturn;
+  // At most three bytes per unit (four for LF in UTF-16 with CR LF) and a
+  // surrogate pair held back from the previous piece.
+  out->resize(4 * length + 4);
+  uchar *const begin = reinterpret_cast<uchar *>(out->data());
+  uchar *o = begin;
+  const ushort *p = reinterpret_cast<const ushort *>(data);
+  const ushort *const end = p + length;
+
+  if (m_format.encoding == FileFormat::Utf16LE ||
+      m_format.encoding == FileFormat::Utf16BE) {
+    const bool bigEndian = m_format.encoding == FileFormat::Utf16BE;
+    while (p < end) {
+#ifdef WOLFEDIT_SSE2
+      const __m128i lf = _mm_set1_epi16(short(crlf ? '\n' : carriageReturn));
+      const __m128i cr = _mm_set1_epi16(short(carriageReturn));
+      while (end - p >= 8) {
+        __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const int special = _mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi16(units, lf), _mm_cmpeq_epi16(units, cr)));
+        if (bigEndian) {
+          units = swapBytes(units);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(o), units);
+        const int n =
+            special ? int(qCountTrailingZeroBits(uint(special))) / 2 : 8;
+        p += n;
+        o += 2 * n;
+        if (special) {
+          break;
+        }
+      }
+      if (p == end) {
+        break;
+      }
+#endif
+      if (*p == '\n' && crlf) {
+        o = writeUnit(o, '\r', bigEndian);
+      }
+      o = writeUnit(o, *p == carriageReturn ? '\r' : *p, bigEndian);
+      ++p;
+    }
+    out->resize(int(o - begin));
+    return;
+  }
+
+  const bool latin1 = m_format.encoding == FileFormat::Latin1;
+  if (!m_highSurrogate.isNull()) {
+    if (p < end && QChar::isLowSurrogate(*p)) {
+      o = encodeUtf8(o, QChar::surrogateToUcs4(m_highSurrogate.unicode(), *p));
+      ++p;
+    } else {
+      o = encodeUtf8(o, QChar::ReplacementCharacter);
+    }
+    m_highSurrogate = QChar();
+  }
+  while (p < end) {
+#ifdef WOLFEDIT_SSE2
+    // Narrow 8 units at a time up to the first one that does not fit in a
+    // byte (or is not ASCII in UTF-8) or a LF that becomes CR LF.
+    const __m128i wide = _mm_set1_epi16(short(latin1 ? 0xff00 : 0xff80));
+    const __m128i lf = _mm_set1_epi16(crlf ? '\n' : 0);
+    const __m128i zero = _mm_setzero_si128();
+    while (end - p >= 8) {
+      const __m128i units =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      const __m128i narrow =
+          _mm_cmpeq_epi16(_mm_and_si128(units, wide), zero);
+      const __m128i plain =
+          _mm_andnot_si128(_mm_cmpeq_epi16(units, lf), narrow);
+      const int special = ~_mm_movemask_epi8(plain) & 0xffff;
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(o),
+                       _mm_packus_epi16(units, units));
+      const int n =
+          special ? int(qCountTrailingZeroBits(uint(special))) / 2 : 8;
+      p += n;
+      o += n;
+      if (special) {
+        break;
+      }
+    }
+    if (p == end) {
+      break;
+    }
+#endif
+    const ushort unit = *p++;
+    if (unit == '\n' && crlf) {
+      *o++ = '\r';
+      *o++ = '\n';
+    } else if (unit == carriageReturn) {
+      *o++ = '\r';
+    } else if (unit < 0x80 || (latin1 && unit < 0x100)) {
+      *o++ = uchar(unit);
+    } else if (latin1) {
+      *o++ = '?';
+      m_lossless = false;
+    } else if (unit < 0x800) {
+      o = encodeUtf8(o, unit);
+    } else if (QChar::isHighSurrogate(unit) && p == end) {
+      m_highSurrogate = QChar(unit);
+    } else if (QChar::isHighSurrogate(unit) && QChar::isLowSurrogate(*p)) {
+      o = encodeUtf8(o, QChar::surrogateToUcs4(unit, *p));
+      ++p;
+    } else if (QChar::isSurrogate(unit)) {
+      o = encodeUtf8(o, QChar::ReplacementCharacter);
+    } else {
+      o = encodeUtf8(o, unit);
+    }
+  }
+  out->resize(int(o - begin));
+}
+
+void TextEncoder::finish(QByteArray *out) {
+  out->resize(3);
+  uchar *const begin = reinterpret_cast<uchar *>(out->data());
+  uchar *o = begin;
+  if (!m_highSurrogate.isNull()) {
+    o = encodeUtf8(o, QChar::ReplacementCharacter);
+    m_highSurrogate = QChar();
+  }
+  out->resize(int(o - begin));
+}
+
+} // namespace WolfEdit
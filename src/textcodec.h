@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+namespace WolfEdit {
+
+// Stands for a CR that does not end a line in the text of a document, which
+// cannot hold a CR (QTextCursor::insertText() turns it into a line break).
+// It is a noncharacter, reserved for use inside a program. A file that has
+// it in its text gets another one (see FileFormat::carriageReturn).
+const ushort CARRIAGE_RETURN = 0xfdd0;
+
+// Encoding and line endings of a file, detected when it is loaded so that it
+// is written back the same way (like Vim's 'fileencoding', 'bomb' and
+// 'fileformat'). New files are UTF-8 without BOM and with LF line endings.
+struct FileFormat {
+  enum Encoding { Utf8, Utf16LE, Utf16BE, Latin1 };
+
+  Encoding encoding = Utf8;
+  // The file starts with a byte order mark.
+  bool bom = false;
+  // Every line ends with CR LF.
+  bool crlf = false;
+  // Stands for a CR in the text: the first of U+FDD0..U+FDEF, U+FFFE and
+  // U+FFFF that is not in the file. If the file has all of them, it is
+  // CARRIAGE_RETURN and the real ones are written back as CR.
+  ushort carriageReturn = CARRIAGE_RETURN;
+
+  bool operator==(const FileFormat &other) const {
+    return encoding == other.encoding && bom == other.bom &&
+           crlf == other.crlf && carriageReturn == other.carriageReturn;
+  }
+  bool operator!=(const FileFormat &other) const { return !(*this == other); }
+
+  // Detects the format from the whole file. A BOM is trusted, UTF-16 without
+  // BOM is recognized by its zero bytes and anything else that is not valid
+  // UTF-8 is read as Latin-1. The line endings are CR LF only if every LF
+  // follows a CR.
+  static FileFormat detect(const char *data, qint64 size);
+
+  int bomSize() const;
+  QByteArray byteOrderMark() const;
+  // Vim-like tags for messages, e.g. "[latin1] [dos] "; empty for the default.
+  QString tags() const;
+};
+
+// Decodes file bytes straight into a QString with LF line endings.
+//
+// ASCII (and Latin-1 and UTF-16) runs are converted 16 bytes at a time with
+// SSE2 where available; only multibyte UTF-8 sequences take the scalar path.
+// With crlf, CR LF is turned into LF in the same pass, so the text is never
+// copied after decoding. Like Vim with 'fileformats' "unix,dos", a file is
+// only read as CR LF if every line ends with it. Any other CR is kept in the
+// text as carriageReturn, so it is written back.
+class TextDecoder {
+public:
+  explicit TextDecoder(const FileFormat &format) : m_format(format) {}
+
+  // Appends the decoded bytes to text and returns the number of bytes used.
+  // Unless last is set, an incomplete sequence or a CR at the end is left for
+  // the next call. Invalid UTF-8 is decoded as U+FFFD.
+  qint64 decode(const char *data, qint64 size, bool last, QString *text);
+
+  // Set once invalid UTF-8 was decoded; the file should be read as Latin-1.
+  bool hasErrors() const { return m_errors; }
+  // Set once a LF without CR was decoded with crlf; the file should be read
+  // with LF line endings.
+  bool hasBareLineFeeds() const { return m_bareLf; }
+
+private:
+  FileFormat m_format;
+  bool m_errors = false;
+  bool m_bareLf = false;
+};
+
+// Encodes text with LF line endings into the bytes of a file, the reverse of
+// TextDecoder (carriageReturn is written as CR).
+class TextEncoder {
+public:
+  explicit TextEncoder(const FileFormat &format) : m_format(format) {}
+
+  // Replaces out with the encoded text, reusing its allocation. Text may be
+  // passed in pieces; a surrogate pair split between two pieces is kept
+  // together.
+  void encode(const QChar *data, int length, QByteArray *out);
+  // Encodes what is left of a split surrogate pair.
+  void finish(QByteArray *out);
+
+  // False if some character could not be encoded (only Latin-1 cannot encode
+  // everything); '?' was written instead.
+  bool isLossless() const { return m_lossless; }
+
+private:
+  FileFormat m_format;
+  QChar m_highSurrogate;
+  bool m_lossless = true;
+};
+
+} // namespace WolfEdit
@@ -0,0 +1,185 @@
+// Tests for reading and writing files in their own encoding and line
+// endings (src/textcodec.h).
+
+#include <QtTest>
+
+#include "src/textcodec.h"
+
+using namespace WolfEdit;
+
+namespace {
+
+// Decodes a file the way FileLoader does, in a first piece of firstSize bytes
+// and then pieces of size bytes. A piece that is all held back is grown.
+QString decode(const QByteArray &bytes, const FileFormat &format,
+               qint64 firstSize, qint64 size) {
+  TextDecoder decoder(format);
+  QString text;
+  qint64 offset = format.bomSize();
+  qint64 length = firstSize;
+  while (offset < bytes.size()) {
+    const qint64 end = qMin<qint64>(bytes.size(), offset + length);
+    const qint64 used = decoder.decode(bytes.constData() + offset,
+                                       end - offset, end == bytes.size(),
+                                       &text);
+    offset += used;
+    length = used ? size : length + 1;
+  }
+  return text;
+}
+
+// Detects the format and decodes the file in one call, which is the only way
+// the SSE2 paths see long runs. Fails the test if decoding it split at an
+// odd offset within a 16 byte block, or in pieces small enough to split CR LF
+// and multibyte sequences, gives a different text.
+QString decode(const QByteArray &bytes, FileFormat *format) {
+  *format = FileFormat::detect(bytes.constData(), bytes.size());
+  const QString text = decode(bytes, *format, bytes.size(), bytes.size());
+  if (decode(bytes, *format, 16 + 7, bytes.size()) != text ||
+      decode(bytes, *format, 3, 3) != text) {
+    QTest::qFail("The text depends on how the file is split", __FILE__,
+                 __LINE__);
+  }
+  return text;
+}
+
+QByteArray encode(const QString &text, const FileFormat &format) {
+  TextEncoder encoder(format);
+  QByteArray bytes;
+  encoder.encode(text.constData(), text.size(), &bytes);
+  QByteArray rest;
+  encoder.finish(&rest);
+  return format.byteOrderMark() + bytes + rest;
+}
+
+QByteArray toUtf16(const QByteArray &latin1, bool bigEndian) {
+  QByteArray bytes = bigEndian ? QByteArray("\xfe\xff") : QByteArray("\xff\xfe");
+  for (const char c : latin1) {
+    bytes.append(bigEndian ? '\0' : c);
+    bytes.append(bigEndian ? c : '\0');
+  }
+  return bytes;
+}
+
+} // namespace
+
+class TextCodecTest : public QObject {
+  Q_OBJECT
+
+private slots:
+  void lineEndings_data() {
+    QTest::addColumn<QByteArray>("file");
+    QTest::addColumn<bool>("crlf");
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("unix") << QByteArray("a\nb\n") << false
+                          << QStringLiteral("a\nb\n");
+    QTest::newRow("dos") << QByteArray("a\r\nb\r\n") << true
+                         << QStringLiteral("a\nb\n");
+    QTest::newRow("dos without last line break")
+        << QByteArray("a\r\nb") << true << QStringLiteral("a\nb");
+    // Like Vim with 'fileformats' "unix,dos": CR LF only if every line ends
+    // with it, otherwise the CRs are part of the text.
+    const QString cr(QChar(CARRIAGE_RETURN));
+    QTest::newRow("dos first line") << QByteArray("a\r\nb\nc\r\n") << false
+                                    << "a" + cr + "\nb\nc" + cr + "\n";
+    QTest::newRow("unix first line") << QByteArray("a\nb\r\n") << false
+                                     << "a\nb" + cr + "\n";
+    QTest::newRow("CR in dos") << QByteArray("a\rb\r\n\r\r\n") << true
+                               << "a" + cr + "b\n" + cr + "\n";
+    QTest::newRow("CR only") << QByteArray("a\rb\r") << false
+                             << "a" + cr + "b" + cr;
+
+    // Long enough for the SSE2 paths, with the line breaks at every offset
+    // of a 16 byte block.
+    QByteArray crlfLines;
+    QByteArray lfLines;
+    QString lines;
+    QString crLines;
+    for (int i = 0; i < 40; ++i) {
+      crlfLines += QByteArray(i, 'x') + "\r\n";
+      lfLines += QByteArray(i, 'x') + "\n";
+      lines += QString(i, QLatin1Char('x')) + "\n";
+      crLines += QString(i, QLatin1Char('x')) + cr + "\n";
+    }
+    QTest::newRow("long dos") << crlfLines << true << lines;
+    QTest::newRow("long unix") << lfLines << false << lines;
+    QTest::newRow("long dos last line unix")
+        << crlfLines + "x\n" << false << crLines + "x\n";
+  }
+
+  void lineEndings() {
+    QFETCH(QByteArray, file);
+    QFETCH(bool, crlf);
+    QFETCH(QString, text);
+
+    FileFormat format;
+    QCOMPARE(decode(file, &format), text);
+    QCOMPARE(format.crlf, crlf);
+    QCOMPARE(encode(text, format), file);
+  }
+
+  void mixedLineEndingsRoundTrip_data() {
+    QTest::addColumn<QByteArray>("file");
+
+    const QByteArray mixed("first\r\nsecond\nthird\r\n\r\n\nx\ry\r\nlast\r");
+    QTest::newRow("utf-8") << mixed;
+    QTest::newRow("utf-8 multibyte")
+        << QByteArray("caf\xc3\xa9\r\n\xe2\x82\xac\n\xf0\x9f\x98\x80\r\n");
+    QTest::newRow("latin-1") << QByteArray("caf\xe9\r\nna\xefve\n");
+    QTest::newRow("utf-16le") << toUtf16(mixed, false);
+    QTest::newRow("utf-16be") << toUtf16(mixed, true);
+
+    // Long enough for the SSE2 paths, with the line endings at every offset
+    // of a 16 byte block.
+    QByteArray longLines;
+    for (int i = 0; i < 64; ++i) {
+      longLines += QByteArray(i, 'x') + (i % 3 ? "\r\n" : "\n");
+    }
+    QTest::newRow("long lines") << longLines;
+    QTest::newRow("long lines utf-16") << toUtf16(longLines, false);
+  }
+
+  void mixedLineEndingsRoundTrip() {
+    QFETCH(QByteArray, file);
+
+    FileFormat format;
+    const QString text = decode(file, &format);
+    QVERIFY(!format.crlf);
+    QVERIFY(!text.contains(QLatin1Char('\r')));
+    QCOMPARE(encode(text, format), file);
+  }
+
+  void noncharacterRoundTrip_data() {
+    QTest::addColumn<QByteArray>("file");
+    QTest::addColumn<ushort>("carriageReturn");
+
+    QTest::newRow("U+FDD0") << QByteArray("a\xef\xb7\x90" "b\rc\n")
+                            << ushort(0xfdd1);
+    QTest::newRow("U+FDD0 and U+FDD1")
+        << QByteArray("\xef\xb7\x91\r\xef\xb7\x90\n") << ushort(0xfdd2);
+    QTest::newRow("U+FDD0 without CR") << QByteArray("\xef\xb7\x90\n")
+                                       << ushort(0xfdd1);
+    QTest::newRow("U+FDD0 utf-16le")
+        << QByteArray("\xff\xfe" "a\0\xd0\xfd\r\0b\0\n\0", 12)
+        << ushort(0xfdd1);
+    QTest::newRow("latin-1") << QByteArray("\xef\xb7\x90\r\xff\n")
+                             << CARRIAGE_RETURN;
+  }
+
+  // A noncharacter in the file is not taken for a CR when it is written.
+  void noncharacterRoundTrip() {
+    QFETCH(QByteArray, file);
+    QFETCH(ushort, carriageReturn);
+
+    FileFormat format;
+    const QString text = decode(file, &format);
+    QCOMPARE(format.carriageReturn, carriageReturn);
+    QCOMPARE(text.count(QChar(carriageReturn)), file.count('\r'));
+    QCOMPARE(encode(text, format), file);
+  }
+};
+
+QTEST_APPLESS_MAIN(TextCodecTest)
+
+#include "textcodec_test.moc"
@@ -92,6 +92,10 @@ FakeVimSettings::FakeVimSettings()
                                   "IsKeyword",      "isk", tr("Keyword characters:"));
     setup(&clipboard,      {},    "Clipboard",      "cb",  tr(""));
     setup(&formatOptions,  {},    "formatoptions",  "fo",  tr(""));
+    setup(&undoFile,       false, "UndoFile",       "udf", tr("Keep undo history in a file"));
+    setup(&undoDir,        {},    "UndoDir",        "udir", tr("Directory for undo files:"));
+    setup(&swapFile,       true,  "SwapFile",       "swf", tr("Keep unsaved changes in a swap file"));
+    setup(&directory,      {},    "Directory",      "dir", tr("Directory for swap files:"));
 
     // Emulated plugins
     setup(&emulateVimCommentary, false, "commentary", {}, "vim-commentary");
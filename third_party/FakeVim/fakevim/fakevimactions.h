@@ -129,6 +129,14 @@ public:
     FvBoolAspect relativeNumber;
     FvStringAspect formatOptions;
 
+    // Persistent undo history (requires FakeVimHandler::setUndoJournal()).
+    FvBoolAspect undoFile;
+    FvStringAspect undoDir;
+
+    // Swap file with unsaved changes (written by the application).
+    FvBoolAspect swapFile;
+    FvStringAspect directory;
+
     // Plugin emulation
     FvBoolAspect emulateVimCommentary;
     FvBoolAspect emulateReplaceWithRegister;
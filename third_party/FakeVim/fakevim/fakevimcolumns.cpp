@@ -0,0 +1,78 @@
+// Copyright (C) 2026 Argos Open Tech
+// SPDX-License-Identifier: GPL-3.0+ OR GPL-3.0 WITH Qt-GPL-exception-1.0
+
+#include "fakevimcolumns.h"
+
+#include <algorithm>
+
+namespace FakeVim {
+namespace Internal {
+
+void ColumnIndex::reset(const QString &text, int tabStop)
+{
+    m_tabStop = qMax(1, tabStop);
+    m_size = text.size();
+    m_tabs.clear();
+    for (int i = text.indexOf('\t'); i != -1; i = text.indexOf('\t', i + 1))
+        m_tabs.append(i);
+    updateColumns(0);
+}
+
+void ColumnIndex::replace(int physical, int removed, const QString &inserted)
+{
+    const auto first = std::lower_bound(m_tabs.begin(), m_tabs.end(), physical);
+    const auto last = std::lower_bound(first, m_tabs.end(), physical + removed);
+    const int fromTab = first - m_tabs.begin();
+    const int delta = inserted.size() - removed;
+    for (auto it = last; it != m_tabs.end(); ++it)
+        *it += delta;
+    m_tabs.erase(first, last);
+
+    QVector<int> tabs;
+    for (int i = inserted.indexOf('\t'); i != -1; i = inserted.indexOf('\t', i + 1))
+        tabs.append(physical + i);
+    m_tabs.insert(fromTab, tabs.size(), 0);
+    std::copy(tabs.cbegin(), tabs.cend(), m_tabs.begin() + fromTab);
+
+    m_size += delta;
+    updateColumns(fromTab);
+}
+
+int ColumnIndex::toLogical(int physical) const
+{
+    // Last tab in front of the column.
+    const int tab = int(std::lower_bound(m_tabs.cbegin(), m_tabs.cend(), physical)
+                        - m_tabs.cbegin()) - 1;
+    if (tab < 0)
+        return physical;
+    return m_columns.at(tab) + physical - m_tabs.at(tab) - 1;
+}
+
+int ColumnIndex::toPhysical(int logical) const
+{
+    if (logical <= 0)
+        return 0;
+    // First tab that ends at or after the column.
+    const int tab = int(std::lower_bound(m_columns.cbegin(), m_columns.cend(), logical)
+                        - m_columns.cbegin());
+    const int start = tab == 0 ? 0 : m_tabs.at(tab - 1) + 1;
+    const int startColumn = tab == 0 ? 0 : m_columns.at(tab - 1);
+    int physical = start + logical - startColumn;
+    if (tab < m_tabs.size() && physical > m_tabs.at(tab))
+        physical = m_tabs.at(tab) + 1;
+    return qMin(physical, m_size);
+}
+
+// Computes the logical columns after the tabs starting with fromTab.
+void ColumnIndex::updateColumns(int fromTab)
+{
+    m_columns.resize(m_tabs.size());
+    for (int i = fromTab; i < m_tabs.size(); ++i) {
+        const int column = i == 0
+                ? m_tabs.at(i) : m_columns.at(i - 1) + m_tabs.at(i) - m_tabs.at(i - 1) - 1;
+        m_columns[i] = column + m_tabStop - column % m_tabStop;
+    }
+}
+
+} // namespace Internal
+} // namespace FakeVim
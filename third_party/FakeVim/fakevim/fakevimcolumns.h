@@ -0,0 +1,45 @@
+// Copyright (C) 2026 Argos Open Tech
+// SPDX-License-Identifier: GPL-3.0+ OR GPL-3.0 WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+namespace FakeVim {
+namespace Internal {
+
+// Physical (in the data) and logical (on screen) columns of a line.
+//
+// Only the positions of the tabs and the logical columns after them are
+// stored, so converting a column is a binary search over the tabs instead of
+// a walk over the line from its start. A change inside the line only reads
+// the inserted text and moves the tabs behind it, so editing a long line
+// (e.g. minified JSON) costs the same as editing a short one.
+class ColumnIndex
+{
+public:
+    // Indexes the text of a line.
+    void reset(const QString &text, int tabStop);
+    // Replaces 'removed' characters at 'physical' by text without line breaks.
+    void replace(int physical, int removed, const QString &inserted);
+
+    int tabStop() const { return m_tabStop; }
+    // Number of characters of the line.
+    int size() const { return m_size; }
+
+    int toLogical(int physical) const;
+    // First physical column at or after the logical column (at most size()).
+    int toPhysical(int logical) const;
+
+private:
+    void updateColumns(int fromTab);
+
+    int m_tabStop = 8;
+    int m_size = 0;
+    QVector<int> m_tabs; // Physical columns of tabs.
+    QVector<int> m_columns; // Logical columns after the tabs.
+};
+
+} // namespace Internal
+} // namespace FakeVim
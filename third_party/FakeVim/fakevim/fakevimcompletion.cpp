@@ -0,0 +1,214 @@
+// Copyright (C) 2026 Argos Open Tech
+// SPDX-License-Identifier: GPL-3.0+ OR GPL-3.0 WITH Qt-GPL-exception-1.0
+
+#include "fakevimcompletion.h"
+
+#include <QTextCursor>
+#include <QTextDocument>
+
+#include <cstring>
+
+namespace FakeVim {
+namespace Internal {
+
+namespace {
+
+QString documentText(QTextDocument *document, int position, int count)
+{
+    if (count <= 0)
+        return QString();
+    QTextCursor tc(document);
+    tc.setPosition(position);
+    tc.setPosition(position + count, QTextCursor::KeepAnchor);
+    QString text = tc.selectedText();
+    text.replace(QChar::ParagraphSeparator, '\n');
+    return text;
+}
+
+int documentLength(QTextDocument *document)
+{
+    return qMax(0, document->characterCount() - 1);
+}
+
+} // namespace
+
+KeywordIndex::KeywordIndex(QObject *parent)
+    : QObject(parent)
+{
+    // Default 'iskeyword': letters, digits, '_' and Latin-1 letters.
+    for (int i = 0; i < 256; ++i) {
+        const QChar c = QLatin1Char(char(i));
+        m_charClasses[i] = (c.isLetterOrNumber() || c == '_') ? 2 : c.isSpace() ? 0 : 1;
+    }
+}
+
+KeywordIndex::~KeywordIndex() = default;
+
+void KeywordIndex::setCharClasses(const signed char charClasses[256])
+{
+    if (std::memcmp(m_charClasses, charClasses, sizeof(m_charClasses)) == 0)
+        return;
+    std::memcpy(m_charClasses, charClasses, sizeof(m_charClasses));
+
+    m_keywords.clear();
+    for (auto it = m_documents.begin(); it != m_documents.end(); ++it) {
+        it->clear();
+        count(&it.value(), it.key()->toPlainText(), 1);
+    }
+}
+
+void KeywordIndex::addDocument(QTextDocument *document)
+{
+    if (m_documents.contains(document))
+        return;
+    count(&m_documents[document], document->toPlainText(), 1);
+    connect(document, &QObject::destroyed, this, [this, document] {
+        removeDocument(document);
+    });
+}
+
+void KeywordIndex::trackDocument(QTextDocument *document)
+{
+    if (m_shadows.contains(document))
+        return;
+    addDocument(document);
+    m_shadows[document] = documentText(document, 0, documentLength(document));
+    connect(document, &QTextDocument::contentsChange, this,
+            [this, document](int position, int charsRemoved, int charsAdded) {
+        onContentsChange(document, position, charsRemoved, charsAdded);
+    });
+}
+
+void KeywordIndex::removeDocument(QTextDocument *document)
+{
+    const auto it = m_documents.find(document);
+    if (it == m_documents.end())
+        return;
+    uncount(it.value());
+    m_documents.erase(it);
+    m_shadows.remove(document);
+    disconnect(document, nullptr, this, nullptr);
+}
+
+bool KeywordIndex::hasDocument(QTextDocument *document) const
+{
+    return m_documents.contains(document);
+}
+
+void KeywordIndex::resetDocument(QTextDocument *document)
+{
+    const auto it = m_documents.find(document);
+    if (it == m_documents.end())
+        return;
+    uncount(it.value());
+    it->clear();
+    count(&it.value(), document->toPlainText(), 1);
+    if (m_shadows.contains(document))
+        m_shadows[document] = documentText(document, 0, documentLength(document));
+}
+
+void KeywordIndex::record(QTextDocument *document, int position, const QString &removed,
+                          const QString &inserted)
+{
+    const auto it = m_documents.find(document);
+    if (it == m_documents.end())
+        return;
+
+    // Keywords touching the change were counted with their unchanged parts, so
+    // count the text around the change as it was and as it is now. Only those
+    // parts are read from the document, not the blocks around them.
+    int from = position;
+    while (from > 0 && isKeywordChar(document->characterAt(from - 1)))
+        --from;
+
+    const int begin = position + inserted.size();
+    int end = begin;
+    while (isKeywordChar(document->characterAt(end)))
+        ++end;
+
+    QString left;
+    for (int i = from; i < position; ++i)
+        left.append(document->characterAt(i));
+    QString right;
+    for (int i = begin; i < end; ++i)
+        right.append(document->characterAt(i));
+    if (!removed.isEmpty() || !left.isEmpty() || !right.isEmpty())
+        count(&it.value(), left + removed + right, -1);
+    count(&it.value(), left + inserted + right, 1);
+}
+
+QStringList KeywordIndex::complete(const QString &prefix, int maxCount) const
+{
+    QStringList result;
+    for (auto it = m_keywords.lowerBound(prefix);
+         it != m_keywords.cend() && result.size() < maxCount && it.key().startsWith(prefix);
+         ++it) {
+        if (it.key().size() != prefix.size())
+            result.append(it.key());
+    }
+    return result;
+}
+
+bool KeywordIndex::isKeywordChar(QChar c) const
+{
+    if (c.unicode() < 256)
+        return m_charClasses[c.unicode()] == 2;
+    return c.isLetterOrNumber() || c == '_';
+}
+
+// Adds delta to the counts of the keywords in the text.
+void KeywordIndex::count(Counts *counts, const QString &text, int delta)
+{
+    const int size = text.size();
+    int i = 0;
+    while (i < size) {
+        if (!isKeywordChar(text.at(i))) {
+            ++i;
+            continue;
+        }
+        const int start = i;
+        while (i < size && isKeywordChar(text.at(i)))
+            ++i;
+        const QString word = text.mid(start, i - start);
+
+        auto own = counts->find(word);
+        if (own == counts->end())
+            own = counts->insert(word, 0);
+        if ((*own += delta) <= 0)
+            counts->erase(own);
+
+        auto total = m_keywords.find(word);
+        if (total == m_keywords.end())
+            total = m_keywords.insert(word, 0);
+        if ((*total += delta) <= 0)
+            m_keywords.erase(total);
+    }
+}
+
+// Removes the keywords of a document from the totals.
+void KeywordIndex::uncount(const Counts &counts)
+{
+    for (auto word = counts.cbegin(); word != counts.cend(); ++word) {
+        const auto total = m_keywords.find(word.key());
+        if (total != m_keywords.end() && (*total -= word.value()) <= 0)
+            m_keywords.erase(total);
+    }
+}
+
+void KeywordIndex::onContentsChange(QTextDocument *document, int position, int charsRemoved,
+                                    int charsAdded)
+{
+    QString &shadow = m_shadows[document];
+    // Counts may include the implicit paragraph separator at the end of the
+    // document.
+    const int removed = qBound(0, charsRemoved, shadow.size() - position);
+    const int added = qBound(0, charsAdded, documentLength(document) - position);
+    const QString oldText = shadow.mid(position, removed);
+    const QString newText = documentText(document, position, added);
+    shadow.replace(position, removed, newText);
+    if (oldText != newText)
+        record(document, position, oldText, newText);
+}
+
+} // namespace Internal
+} // namespace FakeVim
@@ -0,0 +1,86 @@
+// Copyright (C) 2026 Argos Open Tech
+// SPDX-License-Identifier: GPL-3.0+ OR GPL-3.0 WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#define FAKEVIM_STANDALONE
+
+#ifdef FAKEVIM_STANDALONE
+#   include "private/fakevim_export.h"
+#endif
+
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+QT_BEGIN_NAMESPACE
+class QTextDocument;
+QT_END_NAMESPACE
+
+namespace FakeVim {
+namespace Internal {
+
+// Keywords of a set of documents for completion in insert mode (<C-N>,
+// <C-P>, see FakeVimHandler::setKeywordIndex()).
+//
+// Keywords are counted per document and in total, in a sorted map so that a
+// prefix query is a single lookup followed by a walk over the matches. The
+// index is updated from the replaced and inserted text of each change; only
+// the keywords touching the change are counted again, so the cost of an edit
+// doesn't depend on the size of the documents. One index can be shared by
+// the editors of all open documents.
+class FAKEVIM_EXPORT KeywordIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit KeywordIndex(QObject *parent = nullptr);
+    ~KeywordIndex() override;
+
+    // Sets the character classes built from 'iskeyword' (class 2 are keyword
+    // characters; above 255 letters, digits and '_' are). Documents are indexed
+    // again if the keyword characters changed.
+    void setCharClasses(const signed char charClasses[256]);
+
+    // Indexes the text of the document. Later changes are passed to record().
+    // The document is removed from the index when it is destroyed.
+    void addDocument(QTextDocument *document);
+    // Like addDocument() but records changes by observing the document (keeps
+    // a copy of the text).
+    void trackDocument(QTextDocument *document);
+    void removeDocument(QTextDocument *document);
+    bool hasDocument(QTextDocument *document) const;
+    // Indexes the document again, e.g. after it was reloaded.
+    void resetDocument(QTextDocument *document);
+
+    // Records a change of the document (text with '\n' line breaks) after it
+    // was applied to the document.
+    void record(QTextDocument *document, int position, const QString &removed,
+                const QString &inserted);
+
+    // Keywords other than prefix that start with it, in alphabetical order.
+    QStringList complete(const QString &prefix, int maxCount) const;
+
+    bool contains(const QString &keyword) const { return m_keywords.contains(keyword); }
+    int keywordCount() const { return m_keywords.size(); }
+
+private:
+    using Counts = QHash<QString, int>;
+
+    bool isKeywordChar(QChar c) const;
+    void count(Counts *counts, const QString &text, int delta);
+    void uncount(const Counts &counts);
+    void onContentsChange(QTextDocument *document, int position, int charsRemoved,
+                          int charsAdded);
+
+    signed char m_charClasses[256];
+    QMap<QString, int> m_keywords;
+    QHash<QTextDocument *, Counts> m_documents;
+    // Text of tracked documents.
+    QHash<QTextDocument *, QString> m_shadows;
+};
+
+} // namespace Internal
+} // namespace FakeVim
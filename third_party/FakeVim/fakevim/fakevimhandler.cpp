@@ -34,17 +34,30 @@
 #include "fakevimhandler.h"
 
 #include "fakevimactions.h"
+#include "fakevimcolumns.h"
+#include "fakevimcompletion.h"
+#include "fakevimperf.h"
 #include "fakevimtr.h"
+#include "fakevimundo.h"
 
+#include <QDateTime>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QFileInfo>
 #include <QObject>
 #include <QProcess>
 #include <QPointer>
+#include <QRunnable>
 #include <QRegularExpression>
+#include <QSaveFile>
+#include <QSemaphore>
 #include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 #include <QStack>
+#include <QStringMatcher>
 
 #include <QApplication>
 #include <QClipboard>
@@ -63,10 +76,17 @@
 
 #include <algorithm>
 #include <climits>
+#include <limits>
 #include <ctype.h>
 #include <functional>
+#include <memory>
+#include <numeric>
 #include <optional>
 
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
 //#define DEBUG_KEY  1
 #if DEBUG_KEY
 #   define KEY_DEBUG(s) qDebug() << s
@@ -340,6 +360,30 @@ QDebug operator<<(QDebug ts, const Column &col)
     return ts << "(p: " << col.physical << ", l: " << col.logical << ")";
 }
 
+// Text in front of the cursor on its line, recorded in insert mode. Of a long
+// line only the first and the last characters are kept, so that typing
+// doesn't copy the whole line on each key press.
+struct TextBeforeCursor
+{
+    enum { KeptSize = 256 };
+
+    bool isPrefixOf(const QString &text) const
+    {
+        if (tail.isEmpty())
+            return text.startsWith(head);
+        return text.size() >= size && text.startsWith(head)
+                && QStringView(text).mid(size - tail.size(), tail.size()) == tail;
+    }
+
+    // Last n characters (at most KeptSize of a long line).
+    QString right(int n) const { return tail.isEmpty() ? head.right(n) : tail.right(n); }
+
+    int size = 0;
+    int indentation = 0; // Number of leading spaces.
+    QString head; // Whole text or its first KeptSize characters.
+    QString tail; // Last KeptSize characters of a longer text.
+};
+
 struct Register
 {
     Register() = default;
@@ -376,7 +420,66 @@ static bool eatString(const QString &prefix, QString *str)
     return true;
 }
 
-static QRegularExpression vimPatternToQtPattern(const QString &needle)
+// Vim pattern translated to a QRegularExpression, see vimPatternToQtPattern().
+struct SearchPattern
+{
+    SearchPattern() = default;
+    explicit SearchPattern(const QRegularExpression &regExp) : regExp(regExp) {}
+
+    // Returns false only if text certainly does not contain a match.
+    bool mayMatch(const QString &text) const
+    {
+        return literalPrefix.isEmpty() || prefixMatcher.indexIn(text) != -1;
+    }
+
+    QRegularExpression regExp;
+    // Literal text every match starts with (empty if there is none). Searching
+    // for it is much cheaper than running the regular expression, so it is
+    // used to skip lines that cannot match.
+    QString literalPrefix;
+    QStringMatcher prefixMatcher;
+};
+
+static bool containsUpperCase(const QString &needle)
+{
+    return std::any_of(needle.begin(), needle.end(),
+                       [](QChar c) { return c >= 'A' && c <= 'Z'; });
+}
+
+// Returns the literal text a match of a Vim pattern must start with.
+static QString literalPrefix(const QString &needle)
+{
+    if (needle.contains("\\|"))
+        return QString();
+
+    QString prefix;
+    int i = 0;
+    // Skip leading case modifiers and start of line anchor.
+    while (i < needle.size()) {
+        if (needle.mid(i, 2) == "\\c" || needle.mid(i, 2) == "\\C")
+            i += 2;
+        else if (i == 0 && needle.at(i) == '^')
+            ++i;
+        else
+            break;
+    }
+
+    for (; i < needle.size(); ++i) {
+        const QChar c = needle.at(i);
+        if (QString("\\[.*^$").indexOf(c) != -1)
+            break;
+        // The last character is optional if it is followed by a quantifier.
+        const QChar next = i + 1 < needle.size() ? needle.at(i + 1) : QChar();
+        const QChar next2 = i + 2 < needle.size() ? needle.at(i + 2) : QChar();
+        if (next == '*' || (next == '\\' && QString("=?+{").indexOf(next2) != -1))
+            break;
+        prefix.append(c);
+    }
+    return prefix;
+}
+
+static SearchPattern compileVimPattern(const QString &needle,
+                                       bool ignoreCaseOption, bool smartCaseOption)
 {
     /* Transformations (Vim regexp -> QRegularExpression):
      *   \a -> [A-Za-z]
@@ -408,11 +511,8 @@ static QRegularExpression vimPatternToQtPattern(const QString &needle)
      *   \C - set noignorecase for rest
      */
 
-    // FIXME: Option smartcase should be used only if search was typed by user.
-    const bool ignoreCaseOption = fakeVimSettings()->ignoreCase.value();
-    const bool smartCaseOption = fakeVimSettings()->smartCase.value();
     const bool initialIgnoreCase = ignoreCaseOption
-        && !(smartCaseOption && needle.contains(QRegularExpression("[A-Z]")));
+        && !(smartCaseOption && containsUpperCase(needle));
 
     bool ignorecase = initialIgnoreCase;
 
@@ -525,8 +625,232 @@ static QRegularExpression vimPatternToQtPattern(const QString &needle)
     else if (brace)
         pattern.append('[');
 
-    return QRegularExpression(pattern, initialIgnoreCase ? QRegularExpression::CaseInsensitiveOption
-                                                         : QRegularExpression::NoPatternOption);
+    SearchPattern result(QRegularExpression(
+        pattern, initialIgnoreCase ? QRegularExpression::CaseInsensitiveOption
+                                   : QRegularExpression::NoPatternOption));
+    // Compile (and JIT compile if available) once, before the first match.
+    result.regExp.optimize();
+
+    result.literalPrefix = literalPrefix(needle);
+    if (!result.literalPrefix.isEmpty()) {
+        const bool prefixIgnoresCase = initialIgnoreCase || needle.contains("\\c");
+        result.prefixMatcher = QStringMatcher(
+            result.literalPrefix, prefixIgnoresCase ? Qt::CaseInsensitive : Qt::CaseSensitive);
+    }
+    return result;
+}
+
+// Translates a Vim pattern using the current case settings.
+//
+// Recently used patterns are cached so that repeating a search (e.g. with "n")
+// or reusing the pattern in :s or :g does not compile it again.
+static SearchPattern vimPatternToQtPattern(const QString &needle)
+{
+    static const int MaxCachedPatterns = 32;
+
+    struct CachedPattern
+    {
+        QString needle;
+        bool ignoreCase;
+        bool smartCase;
+        SearchPattern pattern;
+    };
+    // Most recently used first.
+    static QList<CachedPattern> cache;
+
+    // FIXME: Option smartcase should be used only if search was typed by user.
+    const bool ignoreCase = fakeVimSettings()->ignoreCase.value();
+    const bool smartCase = fakeVimSettings()->smartCase.value();
+
+    for (int i = 0; i < cache.size(); ++i) {
+        const CachedPattern &cached = cache.at(i);
+        if (cached.needle == needle && cached.ignoreCase == ignoreCase
+                && cached.smartCase == smartCase) {
+            cache.move(i, 0);
+            return cache.first().pattern;
+        }
+    }
+
+    cache.prepend({needle, ignoreCase, smartCase,
+                   compileVimPattern(needle, ignoreCase, smartCase)});
+    if (cache.size() > MaxCachedPatterns)
+        cache.removeLast();
+    return cache.first().pattern;
+}
+
+SearchExpression vimPatternToSearchExpression(const QString &pattern)
+{
+    const SearchPattern compiled = vimPatternToQtPattern(pattern);
+    SearchExpression expression;
+    expression.regExp = compiled.regExp;
+    expression.literalPrefix = compiled.literalPrefix;
+    expression.prefixCaseSensitivity = compiled.prefixMatcher.caseSensitivity();
+    return expression;
+}
+
+// Splits [0, size) into ranges of at least minRangeSize items and calls
+// function(begin, end) for each of them, using the global thread pool.
+// Returns after all ranges have been processed.
+static void parallelFor(int size, int minRangeSize, const std::function<void(int, int)> &function)
+{
+    class RangeTask : public QRunnable
+    {
+    public:
+        explicit RangeTask(const std::function<void()> &task) : m_task(task) {}
+        void run() override { m_task(); }
+
+    private:
+        std::function<void()> m_task;
+    };
+
+    const int maxRanges = 4 * qMax(1, QThread::idealThreadCount());
+    const int ranges = qBound(1, size / qMax(1, minRangeSize), maxRanges);
+    const int rangeSize = (size + ranges - 1) / ranges;
+
+    QSemaphore done;
+    int tasks = 0;
+    for (int begin = rangeSize; begin < size; begin += rangeSize) {
+        const int end = qMin(size, begin + rangeSize);
+        QThreadPool::globalInstance()->start(new RangeTask([&, begin, end] {
+            function(begin, end);
+            done.release();
+        }));
+        ++tasks;
+    }
+
+    // The first range is processed by the calling thread.
+    if (size > 0)
+        function(0, qMin(size, rangeSize));
+    done.acquire(tasks);
+}
+
+// Sorts items using std::stable_sort() on parts of the vector in parallel and
+// merging the sorted parts. Equal items keep their order.
+template <typename T, typename LessThan>
+static void parallelStableSort(QVector<T> *items, LessThan lessThan)
+{
+    const int size = items->size();
+    const int parts = qBound(1, size / 8192, qMax(1, QThread::idealThreadCount()));
+
+    QVector<int> bounds;
+    for (int i = 0; i <= parts; ++i)
+        bounds.append(int(qint64(size) * i / parts));
+
+    T *data = items->data();
+    parallelFor(parts, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+            std::stable_sort(data + bounds[i], data + bounds[i + 1], lessThan);
+    });
+
+    if (parts == 1)
+        return;
+
+    QVector<T> buffer(size);
+    T *from = data;
+    T *to = buffer.data();
+    for (int width = 1; width < parts; width *= 2) {
+        const int merges = (parts + 2 * width - 1) / (2 * width);
+        parallelFor(merges, 1, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                const int lo = bounds[qMin(parts, 2 * i * width)];
+                const int mid = bounds[qMin(parts, (2 * i + 1) * width)];
+                const int hi = bounds[qMin(parts, (2 * i + 2) * width)];
+                std::merge(from + lo, from + mid, from + mid, from + hi, to + lo, lessThan);
+            }
+        });
+        std::swap(from, to);
+    }
+
+    if (from != data)
+        std::copy(from, from + size, data);
+}
+
+// Returns value of the first number in text for ":sort n", ":sort x" etc.
+// Returns the lowest possible value if there is no number so that such lines
+// are sorted first.
+static qint64 firstNumber(QStringView text, int base)
+{
+    const auto digitValue = [base](QChar c) {
+        const ushort u = c.unicode();
+        int value = -1;
+        if (u >= '0' && u <= '9')
+            value = u - '0';
+        else if (u >= 'a' && u <= 'f')
+            value = u - 'a' + 10;
+        else if (u >= 'A' && u <= 'F')
+            value = u - 'A' + 10;
+        return value < base ? value : -1;
+    };
+
+    int i = 0;
+    while (i < text.size() && digitValue(text[i]) == -1)
+        ++i;
+    if (i == text.size())
+        return std::numeric_limits<qint64>::min();
+
+    const bool negative = i > 0 && text[i - 1] == '-';
+
+    // Skip "0x" and "0b" prefix.
+    if ((base == 16 || base == 2) && text[i] == '0' && i + 2 < text.size()
+            && text[i + 1].toLower() == (base == 16 ? 'x' : 'b')
+            && digitValue(text[i + 2]) != -1) {
+        i += 2;
+    }
+
+    const qint64 max = std::numeric_limits<qint64>::max();
+    qint64 value = 0;
+    for (; i < text.size(); ++i) {
+        const int digit = digitValue(text[i]);
+        if (digit == -1)
+            break;
+        value = value > (max - digit) / base ? max : value * base + digit;
+    }
+
+    return negative ? -value : value;
+}
+
+// Returns value of the first floating point number in text for ":sort f".
+static double firstFloat(QStringView text)
+{
+    const auto isDigit = [&text](int i) {
+        return i < text.size() && text[i].unicode() >= '0' && text[i].unicode() <= '9';
+    };
+
+    int start = 0;
+    for (; start < text.size(); ++start) {
+        const QChar c = text[start];
+        if (isDigit(start)
+                || (c == '.' && isDigit(start + 1))
+                || (c == '-' && (isDigit(start + 1) || (text.mid(start + 1).startsWith('.')
+                                                         && isDigit(start + 2))))) {
+            break;
+        }
+    }
+    if (start == text.size())
+        return std::numeric_limits<double>::lowest();
+
+    int end = start;
+    if (text[end] == '-')
+        ++end;
+    while (isDigit(end))
+        ++end;
+    if (end < text.size() && text[end] == '.') {
+        ++end;
+        while (isDigit(end))
+            ++end;
+    }
+    if (end < text.size() && text[end].toLower() == 'e') {
+        int exponent = end + 1;
+        if (exponent < text.size() && (text[exponent] == '-' || text[exponent] == '+'))
+            ++exponent;
+        if (isDigit(exponent)) {
+            end = exponent;
+            while (isDigit(end))
+                ++end;
+        }
+    }
+
+    return QString::fromRawData(text.data() + start, end - start).toDouble();
 }
 
 static bool afterEndOfLine(const QTextDocument *doc, int position)
@@ -535,26 +859,46 @@ static bool afterEndOfLine(const QTextDocument *doc, int position)
         && doc->findBlock(position).length() > 1;
 }
 
-static void searchForward(QTextCursor *tc, const QRegularExpression &needleExp, int *repeat)
+// Same as QTextDocument::find() but skips lines that cannot match.
+static QTextCursor findForward(const QTextDocument *doc, const SearchPattern &pattern,
+                               const QTextCursor &from)
+{
+    const int pos = from.isNull() ? 0 : from.selectionEnd();
+    QTextBlock block = doc->findBlock(pos);
+    int offset = pos - block.position();
+    for (; block.isValid(); block = block.next(), offset = 0) {
+        QString text = block.text();
+        if (!pattern.mayMatch(text))
+            continue;
+        text.replace(QChar::Nbsp, ' ');
+        QRegularExpressionMatch match;
+        const int i = text.indexOf(pattern.regExp, offset, &match);
+        if (i != -1) {
+            QTextCursor tc(block);
+            tc.setPosition(block.position() + i);
+            tc.setPosition(tc.position() + match.capturedLength(), KeepAnchor);
+            return tc;
+        }
+    }
+    return QTextCursor();
+}
+
+static void searchForward(QTextCursor *tc, const SearchPattern &pattern, int *repeat)
 {
     const QTextDocument *doc = tc->document();
     const int startPos = tc->position();
 
-    QTextDocument::FindFlags flags = {};
-    if (!(needleExp.patternOptions() & QRegularExpression::CaseInsensitiveOption))
-        flags |= QTextDocument::FindCaseSensitively;
-
     // Search from beginning of line so that matched text is the same.
     tc->movePosition(StartOfLine);
 
     // forward to current position
-    *tc = doc->find(needleExp, *tc, flags);
+    *tc = findForward(doc, pattern, *tc);
     while (!tc->isNull() && tc->anchor() < startPos) {
         if (!tc->hasSelection())
             tc->movePosition(Right);
         if (tc->atBlockEnd())
             tc->movePosition(NextBlock);
-        *tc = doc->find(needleExp, *tc, flags);
+        *tc = findForward(doc, pattern, *tc);
     }
 
     if (tc->isNull())
@@ -567,7 +911,7 @@ static void searchForward(QTextCursor *tc, const QRegularExpression &needleExp,
             tc->movePosition(Right);
         if (tc->atBlockEnd())
             tc->movePosition(NextBlock);
-        *tc = doc->find(needleExp, *tc, flags);
+        *tc = findForward(doc, pattern, *tc);
         if (tc->isNull())
             return;
         --*repeat;
@@ -577,8 +921,10 @@ static void searchForward(QTextCursor *tc, const QRegularExpression &needleExp,
         tc->movePosition(Left);
 }
 
-static void searchBackward(QTextCursor *tc, const QRegularExpression &needleExp, int *repeat)
+static void searchBackward(QTextCursor *tc, const SearchPattern &pattern, int *repeat)
 {
+    const QRegularExpression &needleExp = pattern.regExp;
+
     // Search from beginning of line so that matched text is the same.
     QTextBlock block = tc->block();
     QString line = block.text();
@@ -601,6 +947,8 @@ static void searchBackward(QTextCursor *tc, const QRegularExpression &needleExp,
         if (!block.isValid())
             break;
         line = block.text();
+        if (!pattern.mayMatch(line))
+            continue;
         i = line.indexOf(needleExp, 0, &match);
         while (i != -1) {
             --*repeat;
@@ -629,10 +977,10 @@ static void searchBackward(QTextCursor *tc, const QRegularExpression &needleExp,
 // Commands [[, []
 static void bracketSearchBackward(QTextCursor *tc, const QString &needleExp, int repeat)
 {
-    const QRegularExpression re(needleExp);
+    const SearchPattern pattern{QRegularExpression(needleExp)};
     QTextCursor tc2 = *tc;
     tc2.setPosition(tc2.position() - 1);
-    searchBackward(&tc2, re, &repeat);
+    searchBackward(&tc2, pattern, &repeat);
     if (repeat <= 1)
         tc->setPosition(tc2.isNull() ? 0 : tc2.position(), KeepAnchor);
 }
@@ -642,10 +990,11 @@ static void bracketSearchBackward(QTextCursor *tc, const QString &needleExp, int
 static void bracketSearchForward(QTextCursor *tc, const QString &needleExp, int repeat,
                                  bool searchWithCommand)
 {
-    QRegularExpression re(searchWithCommand ? QString("^\\}|^\\{") : needleExp);
+    const SearchPattern pattern{
+        QRegularExpression(searchWithCommand ? QString("^\\}|^\\{") : needleExp)};
     QTextCursor tc2 = *tc;
     tc2.setPosition(tc2.position() + 1);
-    searchForward(&tc2, re, &repeat);
+    searchForward(&tc2, pattern, &repeat);
     if (repeat <= 1) {
         if (tc2.isNull()) {
             tc->setPosition(tc->document()->characterCount() - 1, KeepAnchor);
@@ -713,12 +1062,13 @@ static QChar applyReplacementLetterCases(QChar repl,
         return repl;
 }
 
-static bool substituteText(QString *text,
-                           const QRegularExpression &pattern,
-                           const QString &replacement,
-                           bool global)
+// Returns the number of substitutions made.
+static int substituteText(QString *text,
+                          const QRegularExpression &pattern,
+                          const QString &replacement,
+                          bool global)
 {
-    bool substituted = false;
+    int substituted = 0;
     int pos = 0;
     int right = -1;
     while (true) {
@@ -738,7 +1088,7 @@ static bool substituteText(QString *text,
 
         right = text->size() - pos;
 
-        substituted = true;
+        ++substituted;
         QString matched = text->mid(pos, match.captured(0).size());
         QString repl;
         bool escape = false;
@@ -850,25 +1200,15 @@ static QString fromLocalEncoding(const QByteArray &data)
 #endif
 }
 
-static QString getProcessOutput(const QString &command, const QString &input)
+static void startProcess(QProcess *proc, const QString &command)
 {
-    QProcess proc;
 #if QT_VERSION >= QT_VERSION_CHECK(5,15,0)
     QStringList arguments = QProcess::splitCommand(command);
-    QString executable = arguments.takeFirst();
-    proc.start(executable, arguments);
+    const QString executable = arguments.isEmpty() ? QString() : arguments.takeFirst();
+    proc->start(executable, arguments);
 #else
-    proc.start(command);
+    proc->start(command);
 #endif
-    proc.waitForStarted();
-    proc.write(toLocalEncoding(input));
-    proc.closeWriteChannel();
-
-    // FIXME: Process should be interruptable by user.
-    //        Solution is to create a QObject for each process and emit finished state.
-    proc.waitForFinished();
-
-    return fromLocalEncoding(proc.readAllStandardOutput());
 }
 
 static const QMap<QString, int> &vimKeyNames()
@@ -1752,17 +2092,22 @@ private:
 // state of current mapping
 struct MappingState {
     MappingState() = default;
-    MappingState(bool noremap, bool silent, bool editBlock)
-        : noremap(noremap), silent(silent), editBlock(editBlock) {}
+    MappingState(bool noremap, bool silent, bool editBlock, bool batch)
+        : noremap(noremap), silent(silent), editBlock(editBlock), batch(batch) {}
     bool noremap = false;
     bool silent = false;
     bool editBlock = false;
+    bool batch = false;
+    // Inputs queued again each time the mapping ends, while repeat > 1.
+    Inputs inputs;
+    int repeat = 1;
 };
 
 class FakeVimHandler::Private : public QObject
 {
 public:
     Private(FakeVimHandler *parent, QWidget *widget);
+    ~Private() override;
 
     EventResult handleEvent(QKeyEvent *ev);
     bool wantsOverride(QKeyEvent *ev);
@@ -1799,7 +2144,7 @@ public:
     bool handleCommandBufferPaste(const Input &input);
     EventResult handleCurrentMapAsDefault();
     void prependInputs(const QVector<Input> &inputs); // Handle inputs.
-    void prependMapping(const Inputs &inputs); // Handle inputs as mapping.
+    void prependMapping(const Inputs &inputs, bool batch = false, int repeat = 1); // Handle inputs as mapping.
     bool expandCompleteMapping(); // Return false if current mapping is not complete.
     bool extendMapping(const Input &input); // Return false if no suitable mappig found.
     void endMapping();
@@ -1891,6 +2236,7 @@ public:
     int lineForPosition(int pos) const;  // 1 based line, 0 based pos
     QString lineContents(int line) const; // 1 based line
     QString textAt(int from, int to) const;
+    TextBeforeCursor textBeforeCursor(int pos) const;
     void setLineContents(int line, const QString &contents); // 1 based line
     int blockBoundary(const QString &left, const QString &right,
         bool end, int count) const; // end or start position of current code block
@@ -1911,8 +2257,10 @@ public:
     int cursorBlockNumber() const; // "." address
     int physicalCursorColumn() const; // as stored in the data
     int logicalCursorColumn() const; // as visible on screen
-    int physicalToLogicalColumn(int physical, const QString &text) const;
-    int logicalToPhysicalColumn(int logical, const QString &text) const;
+    int physicalToLogicalColumn(int physical, const QTextBlock &block) const;
+    int logicalToPhysicalColumn(int logical, const QTextBlock &block) const;
+    const ColumnIndex &columnIndex(const QTextBlock &block) const;
+    void updateColumnIndex(int position, int charsRemoved, int charsAdded);
     int windowScrollOffset() const; // return scrolloffset but max half the current window height
     Column cursorColumn() const; // as visible on screen
     void updateFirstVisibleLine();
@@ -2037,6 +2385,9 @@ public:
 
     // Values to save when starting FakeVim processing.
     int m_firstVisibleLine;
+    // Columns of the block at m_columnIndexBlock (-1 if none is indexed).
+    mutable ColumnIndex m_columnIndex;
+    mutable int m_columnIndexBlock;
     QTextCursor m_cursor;
     bool m_cursorNeedsUpdate;
 
@@ -2072,6 +2423,13 @@ public:
     void endEditBlock();
     void breakEditBlock() { m_buffer->breakEditBlock = true; }
 
+    // Commands that were not typed (macros, repeated commands, :normal) run
+    // as a batch: scrolling to the cursor, the status line and highlighted
+    // matches are updated once at the end instead of after every key.
+    void beginBatch() { ++m_batchLevel; }
+    void endBatch();
+    bool isBatching() const { return m_batchLevel > 0; }
+
     bool canModifyBufferData() const { return m_buffer->currentHandler.data() == this; }
 
     void onContentsChanged(int position, int charsRemoved, int charsAdded);
@@ -2130,7 +2488,7 @@ public:
     bool startRecording(const Input &input);
     void record(const Input &input);
     void stopRecording();
-    bool executeRegister(int reg);
+    bool executeRegister(int reg, int repeat = 1);
 
     // Handle current command as synonym
     void handleAs(const QString &command);
@@ -2151,6 +2509,35 @@ public:
 
     QString m_currentFileName;
 
+    // Command started by :[range]!{cmd}, running in the background.
+    struct FilterJob {
+        QProcess *process = nullptr;
+        QString command;
+        bool replaceText = false;
+        QTextCursor range; // filtered text, follows edits made meanwhile
+        int lines = 0;
+        QByteArray input;
+        qint64 written = 0;
+        QByteArray output;
+        QElapsedTimer progressTimer;
+    };
+    std::unique_ptr<FilterJob> m_filter;
+
+    // File written by :w on a background thread. The files are written one at
+    // a time in the order they were requested.
+    struct FileWrite {
+        QString fileName;
+        QString contents;
+        QThread *thread = nullptr;
+        bool exists = false;
+        bool ok = false;
+        QString error;
+        qint64 bytes = 0;
+    };
+    std::shared_ptr<FileWrite> m_write;
+    // Writes waiting for m_write; only the latest one for each file is kept.
+    QList<FileWrite> m_pendingWrites;
+
     int m_findStartPosition;
 
     int anchor() const { return m_cursor.anchor(); }
@@ -2199,7 +2586,19 @@ public:
     bool passEventToEditor(QEvent &event, QTextCursor &tc); // Pass event to editor widget without filtering. Returns true if event was processed.
 
     // undo handling
-    int revision() const { return document()->availableUndoSteps(); }
+    int revision() const
+    {
+        return m_buffer->journal ? m_buffer->journal->revision()
+                                 : document()->availableUndoSteps();
+    }
+    bool isUndoAvailable() const
+    {
+        return m_buffer->journal ? m_buffer->journal->canUndo() : document()->isUndoAvailable();
+    }
+    bool isRedoAvailable() const
+    {
+        return m_buffer->journal ? m_buffer->journal->canRedo() : document()->isRedoAvailable();
+    }
     void undoRedo(bool undo);
     void undo();
     void redo();
@@ -2255,6 +2654,11 @@ public:
     bool handleExCommandHelper(ExCommand &cmd); // Returns success.
     bool handleExPluginCommand(const ExCommand &cmd); // Handled by plugin?
     bool handleExBangCommand(const ExCommand &cmd);
+    void writeFilterInput();
+    void showFilterProgress();
+    void finishFilter();
+    void cancelFilter();
+    void waitForFilter();
     bool handleExYankDeleteCommand(const ExCommand &cmd);
     bool handleExChangeCommand(const ExCommand &cmd);
     bool handleExMoveCommand(const ExCommand &cmd);
@@ -2264,19 +2668,29 @@ public:
     bool handleExRegisterCommand(const ExCommand &cmd);
     bool handleExMapCommand(const ExCommand &cmd);
     bool handleExMultiRepeatCommand(const ExCommand &cmd);
+    bool handleExMultiRepeatBatched(const QString &innerCmd, const QVector<QTextBlock> &blocks,
+                                    const QString &needle);
     bool handleExNohlsearchCommand(const ExCommand &cmd);
     bool handleExNormalCommand(const ExCommand &cmd);
     bool handleExReadCommand(const ExCommand &cmd);
     bool handleExUndoRedoCommand(const ExCommand &cmd);
+    bool handleExUndoFileCommand(const ExCommand &cmd);
     bool handleExSetCommand(const ExCommand &cmd);
     bool handleExSortCommand(const ExCommand &cmd);
     bool handleExShiftCommand(const ExCommand &cmd);
     bool handleExSourceCommand(const ExCommand &cmd);
+    const QStringList *readSourceFile(const QString &fileName, bool *changed);
     bool handleExSubstituteCommand(const ExCommand &cmd);
+    bool substituteInBlocks(const ExCommand &cmd, const QVector<QTextBlock> &blocks,
+                            const QString &defaultNeedle = QString());
     bool handleExTabNextCommand(const ExCommand &cmd);
     bool handleExTabPreviousCommand(const ExCommand &cmd);
     bool handleExWriteCommand(const ExCommand &cmd);
+    void writeFileInBackground(const QString &fileName, const QString &contents);
+    void startNextWrite();
+    void finishWrite(bool report);
     bool handleExEchoCommand(const ExCommand &cmd);
+    bool handleExPerfStatsCommand(const ExCommand &cmd);
 
     void setTabSize(int tabSize);
     void setupCharClass();
@@ -2287,6 +2701,20 @@ public:
     int m_ctrlVLength;
     int m_ctrlVBase;
 
+    int m_batchLevel;
+
+    // Keyword completion in insert mode (<C-N>, <C-P>).
+    struct KeywordCompletion
+    {
+        int start = -1; // Position of the completed keyword.
+        int end = -1; // Cursor position after the last completion.
+        QString prefix;
+        QStringList matches;
+        int current = -1; // Index in matches or -1 for the prefix.
+    };
+    KeywordCompletion m_completion;
+    void completeKeyword(bool forward);
+
     QTimer m_fixCursorTimer;
     QTimer m_inputTimer;
 
@@ -2299,6 +2727,8 @@ public:
         QStack<State> redo;
         State undoState;
         int lastRevision = 0;
+        QPointer<UndoJournal> journal;
+        QPointer<KeywordIndex> keywordIndex;
 
         int editBlockLevel = 0; // current level of edit blocks
         bool breakEditBlock = false; // if true, joinPreviousEditBlock() starts new edit block
@@ -2319,7 +2749,7 @@ public:
             int deletes;
             QSet<int> spaces;
             bool insertingSpaces;
-            QString textBeforeCursor;
+            TextBeforeCursor textBeforeCursor;
             bool newLineBefore;
             bool newLineAfter;
         } insertState;
@@ -2419,6 +2849,16 @@ public:
 
         bool surroundUpperCaseS; // True for yS and cS, false otherwise
         QString surroundFunction; // Used for storing the function name provided to ys{motion}f
+
+        // Command lines of sourced files (without comments, functions and with
+        // continuation lines joined), re-read only if the file changes.
+        struct SourcedFile
+        {
+            QDateTime lastModified;
+            qint64 size = -1;
+            QStringList commandLines;
+        };
+        QHash<QString, SourcedFile> sourcedFiles;
     } g;
 
     FakeVimSettings &s = *fakeVimSettings();
@@ -2464,9 +2904,11 @@ void FakeVimHandler::Private::init()
     m_searchStartPosition = 0;
     m_searchFromScreenLine = 0;
     m_firstVisibleLine = 0;
+    m_columnIndexBlock = -1;
     m_ctrlVAccumulator = 0;
     m_ctrlVLength = 0;
     m_ctrlVBase = 0;
+    m_batchLevel = 0;
 
     initSingleShotTimer(&m_fixCursorTimer, 0, this, &FakeVimHandler::Private::onFixCursorTimeout);
     initSingleShotTimer(&m_inputTimer, 1000, this, &FakeVimHandler::Private::onInputTimeout);
@@ -2634,6 +3076,9 @@ bool FakeVimHandler::Private::wantsOverride(QKeyEvent *ev)
 
 EventResult FakeVimHandler::Private::handleEvent(QKeyEvent *ev)
 {
+    FAKEVIM_PERF_SCOPE("handleEvent");
+    Perf::markInput();
+
     const int key = ev->key();
     const Qt::KeyboardModifiers mods = ev->modifiers();
 
@@ -2770,7 +3215,7 @@ void FakeVimHandler::Private::invalidateInsertState()
     insertState.deletes = 0;
     insertState.spaces.clear();
     insertState.insertingSpaces = false;
-    insertState.textBeforeCursor = textAt(block().position(), position());
+    insertState.textBeforeCursor = textBeforeCursor(position());
     insertState.newLineBefore = false;
     insertState.newLineAfter = false;
 }
@@ -2856,10 +3301,16 @@ void FakeVimHandler::Private::restoreWidget(int tabSize)
 
 EventResult FakeVimHandler::Private::handleKey(const Input &input)
 {
+    FAKEVIM_PERF_SCOPE("handleKey");
     KEY_DEBUG("HANDLE INPUT: " << input);
 
     bool hasInput = input.isValid();
 
+    if (m_filter && input.isControl('c')) {
+        cancelFilter();
+        return EventHandled;
+    }
+
     // Waiting on input to complete mapping?
     EventResult r = stopWaitForMapping(hasInput);
 
@@ -2977,7 +3428,7 @@ void FakeVimHandler::Private::prependInputs(const QVector<Input> &inputs)
         g.pendingInput.prepend(inputs[i]);
 }
 
-void FakeVimHandler::Private::prependMapping(const Inputs &inputs)
+void FakeVimHandler::Private::prependMapping(const Inputs &inputs, bool batch, int repeat)
 {
     // FIXME: Implement Vim option maxmapdepth (default value is 1000).
     if (g.mapDepth >= 1000) {
@@ -2998,7 +3449,13 @@ void FakeVimHandler::Private::prependMapping(const Inputs &inputs)
     bool editBlock = m_buffer->editBlockLevel == 0 && !(isInsertMode() && isInsertStateValid());
     if (editBlock)
         beginLargeEditBlock();
-    g.mapStates << MappingState(inputs.noremap(), inputs.silent(), editBlock);
+    if (batch)
+        beginBatch();
+    g.mapStates << MappingState(inputs.noremap(), inputs.silent(), editBlock, batch);
+    if (repeat > 1) {
+        g.mapStates.last().inputs = inputs;
+        g.mapStates.last().repeat = repeat;
+    }
 }
 
 bool FakeVimHandler::Private::expandCompleteMapping()
@@ -3024,10 +3481,21 @@ bool FakeVimHandler::Private::extendMapping(const Input &input)
 
 void FakeVimHandler::Private::endMapping()
 {
+    // Queue the next repeat in place of the one that ended.
+    if (!g.mapStates.isEmpty() && g.mapStates.last().repeat > 1) {
+        MappingState &state = g.mapStates.last();
+        --state.repeat;
+        g.pendingInput.prepend(Input());
+        prependInputs(state.inputs);
+        return;
+    }
+
     if (!g.currentMap.canExtend())
         --g.mapDepth;
     if (g.mapStates.isEmpty())
         return;
+    if (g.mapStates.last().batch)
+        endBatch();
     if (g.mapStates.last().editBlock)
         endEditBlock();
     g.mapStates.pop_back();
@@ -3174,7 +3642,8 @@ bool FakeVimHandler::Private::atWordEnd(bool simple, const QTextCursor &tc) cons
 
 bool FakeVimHandler::Private::isFirstNonBlankOnLine(int pos)
 {
-    for (int i = blockAt(pos).position(); i < pos; ++i) {
+    // Look back from pos, the text in front of it can be a long line.
+    for (int i = pos - 1, begin = blockAt(pos).position(); i >= begin; --i) {
         if (!document()->characterAt(i).isSpace())
             return false;
     }
@@ -3791,6 +4260,11 @@ void FakeVimHandler::Private::updateSelection()
 
 void FakeVimHandler::Private::updateHighlights()
 {
+    FAKEVIM_PERF_SCOPE("updateHighlights");
+
+    if (isBatching())
+        return;
+
     if (s.useCoreSearch.value() || !s.hlSearch.value() || g.highlightsCleared) {
         if (m_highlighted.isEmpty())
             return;
@@ -3806,8 +4280,12 @@ void FakeVimHandler::Private::updateHighlights()
 
 void FakeVimHandler::Private::updateMiniBuffer()
 {
+    FAKEVIM_PERF_SCOPE("updateMiniBuffer");
+
     if (!m_textedit && !m_plaintextedit)
         return;
+    if (isBatching())
+        return;
 
     QString msg;
     int cursorPos = -1;
@@ -5160,12 +5638,7 @@ bool FakeVimHandler::Private::handleMacroExecuteSubMode(const Input &input)
 {
     g.submode = NoSubMode;
 
-    bool result = true;
-    int repeat = count();
-    while (result && --repeat >= 0)
-        result = executeRegister(input.asChar().unicode());
-
-    return result;
+    return executeRegister(input.asChar().unicode(), count());
 }
 
 EventResult FakeVimHandler::Private::handleInsertOrReplaceMode(const Input &input)
@@ -5444,7 +5917,10 @@ void FakeVimHandler::Private::handleInsertMode(const Input &input)
                     || s.backspace.value().contains("2")) {
                 const int line = cursorLine() + 1;
                 const Column col = cursorColumn();
-                QString data = lineContents(line);
+                // Read the line only if the cursor can be in its indentation.
+                const QChar previous = characterAt(position() - 1);
+                const QString data = col.logical && (previous == ' ' || previous == '\t')
+                        ? lineContents(line) : QString();
                 const Column ind = indentation(data);
                 if (col.logical <= ind.logical && col.logical
                         && startsWithWhitespace(data, col.physical)) {
@@ -5500,6 +5976,8 @@ void FakeVimHandler::Private::handleInsertMode(const Input &input)
                 break;
         }
         removeText(Range(pos, pos+i));
+    } else if ((input.isControl('p') || input.isControl('n')) && m_buffer->keywordIndex) {
+        completeKeyword(input.isControl('n'));
     } else if (input.isControl('p') || input.isControl('n')) {
         QTextCursor tc = m_cursor;
         moveToNextWordStart(1, false, false);
@@ -5524,6 +6002,61 @@ void FakeVimHandler::Private::handleInsertMode(const Input &input)
     }
 }
 
+// Like in Vim, the keyword in front of the cursor is replaced by the next
+// (or previous) match and finally by the original text again.
+void FakeVimHandler::Private::completeKeyword(bool forward)
+{
+    static const int MaxMatches = 1000;
+    KeywordCompletion &c = m_completion;
+    const int pos = position();
+
+    const bool continues = c.start != -1 && c.end == pos
+            && selectText(Range(c.start, pos))
+                == (c.current == -1 ? c.prefix : c.matches.value(c.current));
+    if (!continues) {
+        const QString text = block().text();
+        const int column = pos - block().position();
+        int start = column;
+        while (start > 0 && charClass(text.at(start - 1), false) == 2)
+            --start;
+        c.start = pos - (column - start);
+        c.prefix = text.mid(start, column - start);
+        c.matches = m_buffer->keywordIndex->complete(c.prefix, MaxMatches);
+        c.current = -1;
+        c.end = pos;
+    }
+
+    if (c.matches.isEmpty()) {
+        c.start = -1;
+        showMessage(MessageError, Tr::tr("Pattern not found"));
+        return;
+    }
+
+    c.current += forward ? 1 : -1;
+    if (c.current >= c.matches.size())
+        c.current = -1;
+    else if (c.current < -1)
+        c.current = c.matches.size() - 1;
+    const QString keyword = c.current == -1 ? c.prefix : c.matches.at(c.current);
+
+    joinPreviousEditBlock();
+    const int from = c.start + c.prefix.size();
+    if (pos > from)
+        removeText(Range(from, pos));
+    if (keyword.size() > c.prefix.size())
+        insertText(keyword.mid(c.prefix.size()));
+    setTargetColumn();
+    endEditBlock();
+    c.end = position();
+
+    if (c.current == -1) {
+        showMessage(MessageInfo, Tr::tr("Back at original"));
+    } else {
+        showMessage(MessageInfo, Tr::tr("match %1 of %2")
+                    .arg(c.current + 1).arg(c.matches.size()));
+    }
+}
+
 void FakeVimHandler::Private::insertInInsertMode(const QString &text)
 {
     joinPreviousEditBlock();
@@ -5585,7 +6118,7 @@ void FakeVimHandler::Private::handleAs(const QString &command)
     endEditBlock();
 }
 
-bool FakeVimHandler::Private::executeRegister(int reg)
+bool FakeVimHandler::Private::executeRegister(int reg, int repeat)
 {
     QChar regChar(reg);
 
@@ -5601,7 +6134,11 @@ bool FakeVimHandler::Private::executeRegister(int reg)
     //        One solution may be to call QApplication::processEvents() and check if <C-c> was
     //        used when a mapping is active.
     // According to Vim, register is executed like mapping.
-    prependMapping(Inputs(registerContents(reg), false, false));
+    // Repeats are executed as one mapping, which queues the register again
+    // each time it ends, so that a count isn't limited by the mapping depth
+    // and the inputs aren't copied count times.
+    const Inputs inputs(registerContents(reg), false, false);
+    prependMapping(inputs, true, inputs.isEmpty() ? 1 : repeat);
 
     return true;
 }
@@ -5907,6 +6444,23 @@ bool FakeVimHandler::Private::handleExSubstituteCommand(const ExCommand &cmd)
         return false;
     }
 
+    QVector<QTextBlock> blocks;
+    const QTextBlock rangeEnd = blockAt(cmd.range.endPos);
+    for (QTextBlock block = blockAt(cmd.range.beginPos); block.isValid(); block = block.next()) {
+        blocks.append(block);
+        if (block == rangeEnd)
+            break;
+    }
+
+    return substituteInBlocks(cmd, blocks);
+}
+
+// Substitutes in given lines (sorted by position) using arguments of :s command.
+// Pattern defaultNeedle is used if the pattern in the command is empty.
+bool FakeVimHandler::Private::substituteInBlocks(const ExCommand &cmd,
+                                                 const QVector<QTextBlock> &blocks,
+                                                 const QString &defaultNeedle)
+{
     int count = 1;
     QString line = cmd.args;
     const QRegularExpressionMatch match = QRegularExpression("\\d+$").match(line);
@@ -5944,37 +6498,66 @@ bool FakeVimHandler::Private::handleExSubstituteCommand(const ExCommand &cmd)
 
     count = qMax(1, count);
     QString needle = g.lastSubstitutePattern;
+    if (needle.isEmpty())
+        needle = defaultNeedle;
 
     if (g.lastSubstituteFlags.contains('i'))
         needle.prepend("\\c");
 
-    const QRegularExpression pattern = vimPatternToQtPattern(needle);
+    const SearchPattern pattern = vimPatternToQtPattern(needle);
+    const QString replacement = g.lastSubstituteReplacement;
+    const bool global = g.lastSubstituteFlags.contains('g');
 
+    QVector<QString> lines;
+    lines.reserve(blocks.size());
+    for (const QTextBlock &block : blocks)
+        lines.append(block.text());
+
+    // Substitute in copies of the lines in parallel. Only the lines that
+    // changed are written back to the document afterwards.
+    QVector<int> substitutions(lines.size(), 0);
+    QString *texts = lines.data();
+    int *counts = substitutions.data();
+    parallelFor(lines.size(), 1024, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            if (!pattern.mayMatch(texts[i]))
+                continue;
+            for (int a = 0; a != count; ++a)
+                counts[i] += substituteText(&texts[i], pattern.regExp, replacement, global);
+        }
+    });
+
+    // Apply all changes as single edit, from the last line so that positions
+    // of the preceding lines don't change.
     QTextBlock lastBlock;
     QTextBlock firstBlock;
-    const bool global = g.lastSubstituteFlags.contains('g');
-    for (int a = 0; a != count; ++a) {
-        for (QTextBlock block = blockAt(cmd.range.endPos);
-            block.isValid() && block.position() + block.length() > cmd.range.beginPos;
-            block = block.previous()) {
-            QString text = block.text();
-            if (substituteText(&text, pattern, g.lastSubstituteReplacement, global)) {
-                firstBlock = block;
-                if (!lastBlock.isValid()) {
-                    lastBlock = block;
-                    beginEditBlock();
-                }
-                QTextCursor tc = m_cursor;
-                const int pos = block.position();
-                const int anchor = pos + block.length() - 1;
-                tc.setPosition(anchor);
-                tc.setPosition(pos, KeepAnchor);
-                tc.insertText(text);
-            }
+    int substitutionCount = 0;
+    int lineCount = 0;
+    QTextCursor tc = m_cursor;
+    for (int i = lines.size() - 1; i >= 0; --i) {
+        if (counts[i] == 0)
+            continue;
+
+        const QTextBlock &block = blocks[i];
+        firstBlock = block;
+        if (!lastBlock.isValid()) {
+            lastBlock = block;
+            beginEditBlock();
+            tc.beginEditBlock();
         }
+        const int pos = block.position();
+        const int anchor = pos + block.length() - 1;
+        tc.setPosition(anchor);
+        tc.setPosition(pos, KeepAnchor);
+        tc.insertText(texts[i]);
+
+        substitutionCount += counts[i];
+        ++lineCount;
     }
 
     if (lastBlock.isValid()) {
+        tc.endEditBlock();
+
         m_buffer->undoState.position = CursorPosition(firstBlock.blockNumber(), 0);
 
         leaveVisualMode();
@@ -5983,6 +6566,12 @@ bool FakeVimHandler::Private::handleExSubstituteCommand(const ExCommand &cmd)
         moveToFirstNonBlankOnLine();
 
         endEditBlock();
+
+        // Like Vim with default 'report' option.
+        if (substitutionCount > 2) {
+            showMessage(MessageInfo, Tr::tr("%n substitutions", nullptr, substitutionCount)
+                        + Tr::tr(" on %n lines", nullptr, lineCount));
+        }
     }
 
     return true;
@@ -6199,11 +6788,30 @@ bool FakeVimHandler::Private::handleExSetCommand(const ExCommand &cmd)
 
 bool FakeVimHandler::Private::handleExNormalCommand(const ExCommand &cmd)
 {
-    // :norm[al]
+    // :[range]norm[al] {commands}
     if (!cmd.matches("norm", "normal"))
         return false;
     //qDebug() << "REPLAY NORMAL: " << quoteUnprintable(reNormal.cap(3));
-    replay(cmd.args);
+
+    const int beginLine = blockAt(cmd.range.beginPos).blockNumber();
+    const int endLine = blockAt(cmd.range.endPos).blockNumber();
+    if (beginLine == endLine && beginLine == cursorBlockNumber()) {
+        replay(cmd.args);
+        return true;
+    }
+
+    // As in Vim, the commands are executed from the start of each line number
+    // in the range even if previous commands added or removed lines.
+    beginLargeEditBlock();
+    beginBatch();
+    for (int line = beginLine; line <= endLine && line < document()->blockCount(); ++line) {
+        enterCommandMode(g.returnToMode);
+        setPosition(document()->findBlockByNumber(line).position());
+        replay(cmd.args);
+        leaveCurrentMode();
+    }
+    endBatch();
+    endEditBlock();
     return true;
 }
 
@@ -6367,44 +6975,98 @@ bool FakeVimHandler::Private::handleExWriteCommand(const ExCommand &cmd)
     QString fileName = replaceTildeWithHome(cmd.args);
     if (fileName.isEmpty())
         fileName = m_currentFileName;
-    QFile file1(fileName);
-    const bool exists = file1.exists();
+    const bool exists = QFile::exists(fileName);
     if (exists && !forced && !noArgs) {
         showMessage(MessageError, Tr::tr
             ("File \"%1\" exists (add ! to override)").arg(fileName));
-    } else if (file1.open(QIODevice::ReadWrite)) {
+    } else if (fileName.isEmpty()) {
+        showMessage(MessageError, Tr::tr("No file name"));
+    } else {
         // Nobody cared, so act ourselves.
-        file1.close();
         Range range(firstPositionInLine(beginLine),
             firstPositionInLine(endLine), RangeLineMode);
-        QString contents = selectText(range);
-        QFile::remove(fileName);
-        QFile file2(fileName);
-        if (file2.open(QIODevice::ReadWrite)) {
-            QTextStream ts(&file2);
-            ts << contents;
-        } else {
-            showMessage(MessageError, Tr::tr
-               ("Cannot open file \"%1\" for writing").arg(fileName));
-        }
-        // Check result by reading back.
-        QFile file3(fileName);
-        file3.open(QIODevice::ReadOnly);
-        QByteArray ba = file3.readAll();
-        showMessage(MessageInfo, Tr::tr("\"%1\" %2 %3L, %4C written.")
-            .arg(fileName).arg(exists ? QString(" ") : Tr::tr(" [New] "))
-            .arg(ba.count('\n')).arg(ba.size()));
+        writeFileInBackground(fileName, selectText(range));
         //if (quitAll)
         //    passUnknownExCommand(forced ? "qa!" : "qa");
         //else if (quit)
         //    passUnknownExCommand(forced ? "q!" : "q");
-    } else {
-        showMessage(MessageError, Tr::tr
-            ("Cannot open file \"%1\" for reading").arg(fileName));
     }
     return true;
 }
 
+void FakeVimHandler::Private::writeFileInBackground(const QString &fileName,
+    const QString &contents)
+{
+    for (FileWrite &write : m_pendingWrites) {
+        if (write.fileName == fileName) {
+            write.contents = contents;
+            return;
+        }
+    }
+    FileWrite write;
+    write.fileName = fileName;
+    write.contents = contents;
+    m_pendingWrites.append(write);
+    if (!m_write)
+        startNextWrite();
+}
+
+void FakeVimHandler::Private::startNextWrite()
+{
+    if (m_pendingWrites.isEmpty())
+        return;
+    const auto write = std::make_shared<FileWrite>(m_pendingWrites.takeFirst());
+    m_write = write;
+
+    // Write to a temporary file, sync it and rename it over the target so that
+    // the file is never left truncated. Counts are taken from the written data
+    // instead of reading the file back.
+    FileWrite *data = write.get();
+    write->thread = QThread::create([data] {
+        const QByteArray bytes = data->contents.toLocal8Bit();
+        data->exists = QFile::exists(data->fileName);
+        QSaveFile file(data->fileName);
+        bool ok = file.open(QIODevice::WriteOnly)
+            && file.write(bytes) == bytes.size()
+            && file.flush();
+#ifdef Q_OS_UNIX
+        ok = ok && ::fsync(file.handle()) == 0;
+#endif
+        if (ok) {
+            ok = file.commit();
+        } else {
+            file.cancelWriting();
+        }
+        data->ok = ok;
+        data->error = file.errorString();
+        data->bytes = bytes.size();
+    });
+    connect(write->thread, &QThread::finished, this, [this, write] {
+        if (m_write == write)
+            finishWrite(true);
+    });
+    write->thread->start();
+}
+
+void FakeVimHandler::Private::finishWrite(bool report)
+{
+    const std::shared_ptr<FileWrite> write = std::move(m_write);
+    write->thread->wait();
+    delete write->thread;
+
+    if (report && write->ok) {
+        q->showMessage(MessageInfo, Tr::tr("\"%1\" %2 %3L, %4C written.")
+            .arg(write->fileName)
+            .arg(write->exists ? QString(" ") : Tr::tr(" [New] "))
+            .arg(write->contents.count('\n')).arg(write->bytes));
+    } else if (report) {
+        q->showMessage(MessageError, Tr::tr
+           ("Cannot open file \"%1\" for writing").arg(write->fileName)
+           + ": " + write->error);
+    }
+    startNextWrite();
+}
+
 bool FakeVimHandler::Private::handleExReadCommand(const ExCommand &cmd)
 {
     // :r[ead]
@@ -6439,31 +7101,179 @@ bool FakeVimHandler::Private::handleExBangCommand(const ExCommand &cmd) // :!
     if (!cmd.cmd.isEmpty() || !cmd.hasBang)
         return false;
 
-    bool replaceText = cmd.range.isValid();
     const QString command = QString(cmd.cmd.mid(1) + ' ' + cmd.args).trimmed();
-    const QString input = replaceText ? selectText(cmd.range) : QString();
 
-    const QString result = getProcessOutput(command, input);
+    if (m_filter) {
+        showMessage(MessageError, Tr::tr("Command \"%1\" is still running (Ctrl-C cancels it)")
+            .arg(m_filter->command));
+        return true;
+    }
 
-    if (replaceText) {
-        setCurrentRange(cmd.range);
-        int targetPosition = firstPositionInLine(lineForPosition(cmd.range.beginPos));
-        beginEditBlock();
-        removeText(currentRange());
-        insertText(result);
-        setPosition(targetPosition);
-        endEditBlock();
+    // The command runs asynchronously. Input is written in chunks as the
+    // process consumes it, output is collected as it arrives and the filtered
+    // lines are replaced in a single edit once the process finishes. Editing
+    // can continue in the meantime; the range is tracked by a text cursor.
+    m_filter.reset(new FilterJob);
+    FilterJob *job = m_filter.get();
+    job->command = command;
+    job->replaceText = cmd.range.isValid();
+    if (job->replaceText) {
+        QTextCursor tc = m_cursor;
+        transformText(cmd.range, tc, [&tc, job] { job->range = tc; });
+        const QString input = job->range.selection().toPlainText();
+        job->lines = input.count('\n');
+        job->input = toLocalEncoding(input);
         leaveVisualMode();
-        //qDebug() << "FILTER: " << command;
-        showMessage(MessageInfo, Tr::tr("%n lines filtered.", nullptr,
-            input.count('\n')));
-    } else if (!result.isEmpty()) {
-        q->extraInformationChanged(result);
     }
 
+    job->process = new QProcess(this);
+    connect(job->process, &QProcess::started, this, &Private::writeFilterInput);
+    connect(job->process, &QProcess::bytesWritten, this, &Private::writeFilterInput);
+    connect(job->process, &QProcess::readyReadStandardOutput, this, [this] {
+        m_filter->output.append(m_filter->process->readAllStandardOutput());
+        showFilterProgress();
+    });
+    connect(job->process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, &Private::finishFilter);
+    connect(job->process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart)
+            return;
+        const QString message = Tr::tr("Cannot run command \"%1\": %2")
+            .arg(m_filter->command, m_filter->process->errorString());
+        m_filter->process->disconnect(this);
+        m_filter->process->deleteLater();
+        m_filter.reset();
+        q->showMessage(MessageError, message);
+    });
+
+    job->progressTimer.start();
+    startProcess(job->process, command);
+    showMessage(MessageInfo, Tr::tr("Running \"%1\" (Ctrl-C cancels it)").arg(command));
+
     return true;
 }
 
+void FakeVimHandler::Private::writeFilterInput()
+{
+    // Keep at most one chunk queued so the whole input is never duplicated in
+    // the process write buffer.
+    const qint64 chunkSize = 64 * 1024;
+    QProcess *process = m_filter->process;
+    if (process->bytesToWrite() > 0)
+        return;
+
+    if (m_filter->written < m_filter->input.size()) {
+        const qint64 size = qMin(chunkSize, m_filter->input.size() - m_filter->written);
+        process->write(m_filter->input.constData() + m_filter->written, size);
+        m_filter->written += size;
+        showFilterProgress();
+    } else if (process->state() == QProcess::Running) {
+        m_filter->input.clear();
+        process->closeWriteChannel();
+    }
+}
+
+void FakeVimHandler::Private::showFilterProgress()
+{
+    if (m_filter->progressTimer.elapsed() < 100)
+        return;
+    m_filter->progressTimer.restart();
+
+    const qint64 kib = 1024;
+    if (m_filter->replaceText) {
+        q->showMessage(MessageInfo, Tr::tr("Filtering through \"%1\": %2/%3 KiB sent,"
+                                           " %4 KiB received (Ctrl-C cancels it)")
+            .arg(m_filter->command)
+            .arg(m_filter->written / kib).arg(m_filter->input.size() / kib)
+            .arg(m_filter->output.size() / kib));
+    } else {
+        q->showMessage(MessageInfo, Tr::tr("Running \"%1\": %2 KiB received"
+                                           " (Ctrl-C cancels it)")
+            .arg(m_filter->command).arg(m_filter->output.size() / kib));
+    }
+}
+
+void FakeVimHandler::Private::finishFilter()
+{
+    const std::unique_ptr<FilterJob> job = std::move(m_filter);
+    job->process->disconnect(this);
+    job->process->deleteLater();
+    job->output.append(job->process->readAllStandardOutput());
+
+    // Like Vim, the output is used even if the command fails: grep without a
+    // match or diff with a difference exit with 1 by design.
+    QString error;
+    if (job->process->exitStatus() != QProcess::NormalExit || job->process->exitCode() != 0) {
+        const QString errorOutput = fromLocalEncoding(job->process->readAllStandardError()).trimmed();
+        error = Tr::tr("Command \"%1\" returned %2")
+            .arg(job->command).arg(job->process->exitCode())
+            + (errorOutput.isEmpty() ? QString() : ": " + errorOutput.section('\n', 0, 0));
+    }
+
+    const QString result = fromLocalEncoding(job->output);
+    if (!job->replaceText) {
+        if (!result.isEmpty())
+            q->extraInformationChanged(result);
+        if (!error.isEmpty())
+            q->showMessage(MessageError, error);
+        return;
+    }
+
+    // The filter finishes from the event loop; a key press may be in progress
+    // only if something processes events recursively.
+    const bool wasInFakeVim = m_inFakeVim;
+    if (!wasInFakeVim)
+        enterFakeVim();
+
+    QTextCursor tc = job->range;
+    const int start = tc.selectionStart();
+    beginEditBlock();
+    tc.insertText(result);
+    // If the whole document end was filtered, the range starts with the
+    // preceding line break.
+    QTextBlock block = document()->findBlock(start);
+    if (block.position() != start && block.next().isValid())
+        block = block.next();
+    setPosition(block.position());
+    endEditBlock();
+
+    if (error.isEmpty())
+        showMessage(MessageInfo, Tr::tr("%n lines filtered.", nullptr, job->lines));
+    else
+        showMessage(MessageError, error);
+
+    if (!wasInFakeVim)
+        leaveFakeVim();
+}
+
+void FakeVimHandler::Private::cancelFilter()
+{
+    const std::unique_ptr<FilterJob> job = std::move(m_filter);
+    job->process->disconnect(this);
+    job->process->kill();
+    job->process->deleteLater();
+    showMessage(MessageInfo, Tr::tr("Command \"%1\" interrupted").arg(job->command));
+}
+
+FakeVimHandler::Private::~Private()
+{
+    // Never abandon a :w half way. The handler is going away, so nothing is
+    // reported.
+    while (m_write)
+        finishWrite(false);
+}
+
+void FakeVimHandler::Private::waitForFilter()
+{
+    // QProcess emits its signals from the blocking wait too, so the input is
+    // written and the output applied by the same slots as from the event loop.
+    while (m_filter) {
+        QProcess *process = m_filter->process;
+        if (!process->waitForFinished(-1) && m_filter && m_filter->process == process)
+            cancelFilter();
+    }
+}
+
 bool FakeVimHandler::Private::handleExShiftCommand(const ExCommand &cmd)
 {
     // :[range]{<|>}* [count]
@@ -6508,6 +7318,11 @@ bool FakeVimHandler::Private::handleExMultiRepeatCommand(const ExCommand &cmd)
     if (!hasG && !hasV)
         return false;
 
+    if (cmd.args.isEmpty()) {
+        showMessage(MessageError, Tr::tr("Regular expression missing from :global"));
+        return true;
+    }
+
     // Force operation on full lines, and full document if only
     // one line (the current one...) is specified
     int beginLine = lineForPosition(cmd.range.beginPos);
@@ -6520,46 +7335,261 @@ bool FakeVimHandler::Private::handleExMultiRepeatCommand(const ExCommand &cmd)
     const bool negates = hasV || cmd.hasBang;
 
     const QChar delim = cmd.args.front();
-    const QString pattern = cmd.args.section(delim, 1, 1);
-    const QRegularExpression re(pattern);
+    const QString needle = cmd.args.section(delim, 1, 1);
+    const SearchPattern pattern = vimPatternToQtPattern(needle);
+    if (!pattern.regExp.isValid()) {
+        showMessage(MessageError,
+                    Tr::tr("Invalid regular expression: %1").arg(pattern.regExp.errorString()));
+        return true;
+    }
 
-    QString innerCmd = cmd.args.section(delim, 2, 2);
+    // The command can contain the delimiter too (e.g. "s//x/").
+    QString innerCmd = cmd.args.section(delim, 2);
     if (innerCmd.isEmpty())
         innerCmd = "p";
 
-    QList<QTextCursor> matches;
+    // Match copies of the lines in parallel.
+    QVector<QTextBlock> blocks;
+    QVector<QString> lines;
+    const QTextBlock lastBlock = document()->findBlockByNumber(endLine - 1);
+    for (QTextBlock block = document()->findBlockByNumber(qMax(0, beginLine - 1));
+         block.isValid(); block = block.next()) {
+        blocks.append(block);
+        lines.append(block.text());
+        if (block == lastBlock)
+            break;
+    }
 
-    for (int line = beginLine; line <= endLine; ++line) {
-        const int pos = firstPositionInLine(line);
-        const Range range(pos, pos, RangeLineMode);
-        const QString lineContents = selectText(range);
-        const QRegularExpressionMatch match = re.match(lineContents);
-        if (match.hasMatch() ^ negates) {
-            QTextCursor tc(document());
-            tc.setPosition(pos);
-            matches.append(tc);
+    QVector<char> matched(lines.size(), false);
+    const QString *texts = lines.constData();
+    char *flags = matched.data();
+    parallelFor(lines.size(), 1024, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const bool found = pattern.mayMatch(texts[i])
+                && pattern.regExp.match(texts[i]).hasMatch();
+            flags[i] = found != negates;
         }
+    });
+
+    QVector<QTextBlock> matches;
+    for (int i = 0; i < blocks.size(); ++i) {
+        if (flags[i])
+            matches.append(blocks[i]);
+    }
+
+    if (matches.isEmpty()) {
+        showMessage(MessageInfo, Tr::tr("Pattern not found: %1").arg(needle));
+        return true;
     }
 
+    // Don't repaint the editor for each line.
+    QWidget *widget = editor();
+    const bool updatesEnabled = widget->updatesEnabled();
+    widget->setUpdatesEnabled(false);
+
     beginEditBlock();
 
-    for (const QTextCursor &tc : qAsConst(matches)) {
-        setPosition(tc.position());
-        handleExCommand(innerCmd);
+    if (!handleExMultiRepeatBatched(innerCmd, matches, needle)) {
+        QList<QTextCursor> cursors;
+        for (const QTextBlock &block : qAsConst(matches))
+            cursors.append(QTextCursor(block));
+
+        for (const QTextCursor &tc : qAsConst(cursors)) {
+            setPosition(tc.position());
+            handleExCommand(innerCmd);
+        }
     }
 
     endEditBlock();
 
+    widget->setUpdatesEnabled(updatesEnabled);
+
     return true;
 }
 
+// Runs commonly used commands for all lines matched by :g at once.
+// Returns false if the command cannot be handled this way.
+bool FakeVimHandler::Private::handleExMultiRepeatBatched(const QString &innerCmd,
+                                                         const QVector<QTextBlock> &blocks,
+                                                         const QString &needle)
+{
+    // Ranges and multiple commands are handled line by line.
+    QString line = innerCmd.trimmed();
+    ExCommand cmd;
+    if (line.isEmpty() || !line.at(0).isLetter() || !parseExCommand(&line, &cmd)
+            || !line.isEmpty()) {
+        return false;
+    }
+
+    // Positions of lines before the edited one don't change when editing from
+    // the last line.
+    QVector<int> positions;
+    positions.reserve(blocks.size());
+    for (const QTextBlock &block : blocks)
+        positions.append(block.position());
+
+    if (cmd.matches("d", "delete") && cmd.args.isEmpty()) {
+        // :g/{pattern}/d
+        const int lastPos = positions.last();
+        yankText(Range(lastPos, lastPos, RangeLineMode), m_register);
+        const int cursorLine = blocks.last().blockNumber() - blocks.size() + 1;
+
+        setPosition(positions.first());
+        pushUndoState();
+
+        QTextCursor tc(document());
+        tc.beginEditBlock();
+        for (int i = positions.size() - 1; i >= 0; --i) {
+            const QTextBlock block = document()->findBlock(positions[i]);
+            if (block.next().isValid()) {
+                tc.setPosition(block.position());
+                tc.setPosition(block.next().position(), KeepAnchor);
+            } else {
+                // Remove last line with the preceding line break.
+                tc.setPosition(block.position() + block.length() - 1);
+                tc.setPosition(qMax(0, block.position() - 1), KeepAnchor);
+            }
+            tc.removeSelectedText();
+        }
+        tc.endEditBlock();
+
+        setPosition(document()->findBlockByNumber(
+            qMin(cursorLine, document()->blockCount() - 1)).position());
+        moveToFirstNonBlankOnLine();
+
+        if (blocks.size() > 2)
+            showMessage(MessageInfo, Tr::tr("%n fewer lines", nullptr, blocks.size()));
+        return true;
+    }
+
+    if (cmd.matches("m", "move") && cmd.args == "0") {
+        // :g/{pattern}/m0 - matched lines in reverse order at the top
+        QStringList moved;
+        QStringList others;
+        const QTextBlock lastBlock = blocks.last();
+        int next = 0;
+        for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+            if (next < blocks.size() && block == blocks[next]) {
+                moved.prepend(block.text());
+                ++next;
+            } else {
+                others.append(block.text());
+            }
+            if (block == lastBlock)
+                break;
+        }
+
+        setPosition(positions.first());
+        pushUndoState();
+
+        QTextCursor tc(document());
+        tc.setPosition(lastBlock.position() + lastBlock.length() - 1, KeepAnchor);
+        tc.insertText((moved + others).join('\n'));
+
+        setPosition(0);
+        moveToFirstNonBlankOnLine();
+        return true;
+    }
+
+    if ((cmd.cmd == "t" || cmd.matches("co", "copy")) && cmd.args == "$") {
+        // :g/{pattern}/t$ - copy matched lines to the end of the document
+        QStringList copied;
+        for (const QTextBlock &block : blocks)
+            copied.append(block.text());
+
+        setPosition(positions.first());
+        pushUndoState();
+
+        QTextCursor tc(document());
+        tc.movePosition(EndOfDocument);
+        tc.insertText('\n' + copied.join('\n'));
+
+        setPosition(document()->lastBlock().position());
+        moveToFirstNonBlankOnLine();
+        return true;
+    }
+
+    if (cmd.matches("s", "substitute")) {
+        // :g/{pattern}/s//{string}/ - empty pattern is the pattern of :g
+        substituteInBlocks(cmd, blocks, needle);
+        return true;
+    }
+
+    if (cmd.matches("norm", "normal")) {
+        QList<QTextCursor> cursors;
+        for (const QTextBlock &block : blocks)
+            cursors.append(QTextCursor(block));
+
+        for (const QTextCursor &tc : qAsConst(cursors)) {
+            enterCommandMode(g.returnToMode);
+            setPosition(tc.position());
+            replay(cmd.args);
+            leaveCurrentMode();
+        }
+        return true;
+    }
+
+    return false;
+}
+
 bool FakeVimHandler::Private::handleExSortCommand(const ExCommand &cmd)
 {
     // :[range]sor[t][!] [b][f][i][n][o][r][u][x] [/{pattern}/]
-    // FIXME: Only the ! for reverse is implemented.
     if (!cmd.matches("sor", "sort"))
         return false;
 
+    enum NumberType { NoNumber, Decimal, Float, Hex, Octal, Binary };
+    NumberType numberType = NoNumber;
+    bool ignoreCase = false;
+    bool sortOnMatch = false;
+    bool unique = false;
+    bool hasPattern = false;
+    QString needle;
+
+    const QString &args = cmd.args;
+    for (int i = 0; i < args.size(); ++i) {
+        const QChar c = args.at(i);
+        const int numberFlag = QString("nfxob").indexOf(c);
+        if (c.isSpace()) {
+            continue;
+        } else if (c == 'i') {
+            ignoreCase = true;
+        } else if (c == 'r') {
+            sortOnMatch = true;
+        } else if (c == 'u') {
+            unique = true;
+        } else if (numberFlag != -1 && numberType == NoNumber) {
+            numberType = NumberType(Decimal + numberFlag);
+        } else if (c == '"') {
+            break;
+        } else if (!c.isLetter() && !hasPattern) {
+            const int patternEnd = findUnescaped(c, args, i + 1);
+            if (patternEnd == -1) {
+                showMessage(MessageError, Tr::tr("Missing delimiter after search pattern: %1")
+                            .arg(args.mid(i)));
+                return true;
+            }
+            needle = args.mid(i + 1, patternEnd - i - 1);
+            if (needle.isEmpty())
+                needle = g.lastSearch;
+            hasPattern = true;
+            i = patternEnd;
+        } else {
+            showMessage(MessageError, Tr::tr("Invalid argument:") + ' ' + args.mid(i));
+            return true;
+        }
+    }
+
+    SearchPattern pattern;
+    if (hasPattern) {
+        pattern = vimPatternToQtPattern(needle);
+        if (!pattern.regExp.isValid()) {
+            showMessage(MessageError, Tr::tr("Invalid regular expression: %1")
+                        .arg(pattern.regExp.errorString()));
+            return true;
+        }
+    }
+
     // Force operation on full lines, and full document if only
     // one line (the current one...) is specified
     int beginLine = lineForPosition(cmd.range.beginPos);
@@ -6568,20 +7598,118 @@ bool FakeVimHandler::Private::handleExSortCommand(const ExCommand &cmd)
         beginLine = 0;
         endLine = lineForPosition(lastPositionInDocument());
     }
-    Range range(firstPositionInLine(beginLine),
-                firstPositionInLine(endLine), RangeLineMode);
 
-    QString input = selectText(range);
-    if (input.endsWith('\n')) // It should always...
-        input.chop(1);
+    const QTextBlock firstBlock = document()->findBlockByNumber(qMax(0, beginLine - 1));
+    const QTextBlock lastBlock = document()->findBlockByNumber(endLine - 1);
+    if (!firstBlock.isValid() || !lastBlock.isValid())
+        return true;
+
+    // Lines are only referenced by their position in this copy of the range.
+    QTextCursor tc = m_cursor;
+    tc.setPosition(firstBlock.position());
+    tc.setPosition(lastBlock.position() + lastBlock.length() - 1, KeepAnchor);
+    QString text = tc.selectedText();
+    text.replace(ParagraphSeparator, '\n');
+    const QChar *data = text.constData();
+
+    QVector<int> lineStarts;
+    QVector<int> lineLengths;
+    for (int start = 0;;) {
+        const int end = text.indexOf('\n', start);
+        lineStarts.append(start);
+        lineLengths.append((end == -1 ? text.size() : end) - start);
+        if (end == -1)
+            break;
+        start = end + 1;
+    }
+    const int lineCount = lineStarts.size();
+
+    // Find the part of each line to sort on and convert it to number if needed.
+    QVector<int> keyStarts(lineStarts);
+    QVector<int> keyLengths(lineLengths);
+    QVector<qint64> integers(numberType != NoNumber && numberType != Float ? lineCount : 0);
+    QVector<double> reals(numberType == Float ? lineCount : 0);
+    int *keyStartData = keyStarts.data();
+    int *keyLengthData = keyLengths.data();
+    qint64 *integerData = integers.data();
+    double *realData = reals.data();
+    parallelFor(lineCount, 4096, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            if (hasPattern) {
+                const QString line = QString::fromRawData(data + lineStarts[i], lineLengths[i]);
+                const QRegularExpressionMatch match = pattern.mayMatch(line)
+                    ? pattern.regExp.match(line) : QRegularExpressionMatch();
+                if (!match.hasMatch()) {
+                    keyLengthData[i] = 0;
+                } else if (sortOnMatch) {
+                    keyStartData[i] += match.capturedStart();
+                    keyLengthData[i] = match.capturedLength();
+                } else {
+                    keyStartData[i] += match.capturedEnd();
+                    keyLengthData[i] -= match.capturedEnd();
+                }
+            }
 
-    QStringList lines = input.split('\n');
-    lines.sort();
+            const QStringView key(data + keyStartData[i], keyLengthData[i]);
+            switch (numberType) {
+            case NoNumber: break;
+            case Decimal: integerData[i] = firstNumber(key, 10); break;
+            case Float: realData[i] = firstFloat(key); break;
+            case Hex: integerData[i] = firstNumber(key, 16); break;
+            case Octal: integerData[i] = firstNumber(key, 8); break;
+            case Binary: integerData[i] = firstNumber(key, 2); break;
+            }
+        }
+    });
+
+    const Qt::CaseSensitivity cs = ignoreCase ? Qt::CaseInsensitive : Qt::CaseSensitive;
+    const auto compareKeys = [&](int a, int b) {
+        if (numberType == Float)
+            return realData[a] < realData[b] ? -1 : realData[a] > realData[b] ? 1 : 0;
+        if (numberType != NoNumber)
+            return integerData[a] < integerData[b] ? -1 : integerData[a] > integerData[b] ? 1 : 0;
+        return QStringView(data + keyStartData[a], keyLengthData[a])
+            .compare(QStringView(data + keyStartData[b], keyLengthData[b]), cs);
+    };
+
+    QVector<int> order(lineCount);
+    std::iota(order.begin(), order.end(), 0);
+    // Equal lines keep their order even if sorted in reverse.
     if (cmd.hasBang)
-        std::reverse(lines.begin(), lines.end());
-    QString res = lines.join('\n') + '\n';
+        parallelStableSort(&order, [&](int a, int b) { return compareKeys(b, a) < 0; });
+    else
+        parallelStableSort(&order, [&](int a, int b) { return compareKeys(a, b) < 0; });
+
+    QString result;
+    result.reserve(text.size() + 1);
+    int previous = -1;
+    int removedLines = 0;
+    for (int i : qAsConst(order)) {
+        const QStringView line(data + lineStarts[i], lineLengths[i]);
+        if (unique && previous != -1) {
+            const bool duplicate = numberType == NoNumber
+                ? line.compare(QStringView(data + lineStarts[previous], lineLengths[previous]),
+                               cs) == 0
+                : compareKeys(previous, i) == 0;
+            if (duplicate) {
+                ++removedLines;
+                continue;
+            }
+        }
+        if (previous != -1)
+            result.append('\n');
+        result.append(line.data(), line.size());
+        previous = i;
+    }
+
+    beginEditBlock();
+    tc.insertText(result);
+    setPosition(firstBlock.position());
+    moveToFirstNonBlankOnLine();
+    endEditBlock();
 
-    replaceText(range, res);
+    if (removedLines > 2)
+        showMessage(MessageInfo, Tr::tr("%n fewer lines", nullptr, removedLines));
 
     return true;
 }
@@ -6610,6 +7738,45 @@ bool FakeVimHandler::Private::handleExUndoRedoCommand(const ExCommand &cmd)
     return true;
 }
 
+bool FakeVimHandler::Private::handleExUndoFileCommand(const ExCommand &cmd)
+{
+    // :wu[ndo] {file}
+    // :rund[o] {file}
+    const bool write = cmd.matches("wu", "wundo");
+    if (!write && !cmd.matches("rund", "rundo"))
+        return false;
+
+    UndoJournal *journal = m_buffer->journal;
+    if (!journal) {
+        showMessage(MessageError, Tr::tr("Undo history is not persistent for this buffer"));
+        return true;
+    }
+
+    const QString fileName = replaceTildeWithHome(cmd.args.trimmed());
+    if (fileName.isEmpty()) {
+        showMessage(MessageError, Tr::tr("Argument required"));
+        return true;
+    }
+
+    QString error;
+    if (write) {
+        if (journal->save(fileName, &error))
+            showMessage(MessageInfo, Tr::tr("Undo history written to \"%1\"").arg(fileName));
+        else
+            showMessage(MessageError, Tr::tr("Cannot write undo file \"%1\": %2").arg(fileName, error));
+    } else {
+        if (journal->load(fileName, &error)) {
+            // Cursor positions stored with the old history don't apply.
+            m_buffer->undo.clear();
+            m_buffer->redo.clear();
+            showMessage(MessageInfo, Tr::tr("Undo history read from \"%1\"").arg(fileName));
+        } else {
+            showMessage(MessageError, Tr::tr("Cannot read undo file \"%1\": %2").arg(fileName, error));
+        }
+    }
+    return true;
+}
+
 bool FakeVimHandler::Private::handleExGotoCommand(const ExCommand &cmd)
 {
     // :{address}
@@ -6629,12 +7796,48 @@ bool FakeVimHandler::Private::handleExSourceCommand(const ExCommand &cmd)
         return false;
 
     QString fileName = replaceTildeWithHome(cmd.args);
-    QFile file(fileName);
-    if (!file.open(QIODevice::ReadOnly)) {
+    const QStringList *commandLines = readSourceFile(fileName, nullptr);
+    if (!commandLines) {
         showMessage(MessageError, Tr::tr("Cannot open file %1").arg(fileName));
         return true;
     }
 
+    for (const QString &line : *commandLines) {
+        //qDebug() << "EXECUTING: " << line;
+        ExCommand cmd;
+        QString commandLine = line;
+        while (parseExCommand(&commandLine, &cmd)) {
+            if (!handleExCommandHelper(cmd))
+                break;
+        }
+    }
+    return true;
+}
+
+// Returns command lines of a file to source or nullptr if it cannot be read.
+// Sets *changed if the file was read (for the first time or after it changed).
+const QStringList *FakeVimHandler::Private::readSourceFile(const QString &fileName, bool *changed)
+{
+    const QFileInfo info(fileName);
+    const QString key = info.absoluteFilePath();
+    auto it = g.sourcedFiles.find(key);
+    if (it != g.sourcedFiles.end()) {
+        if (info.exists() && it->lastModified == info.lastModified() && it->size == info.size()) {
+            if (changed)
+                *changed = false;
+            return &it->commandLines;
+        }
+        g.sourcedFiles.erase(it);
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return nullptr;
+
+    GlobalData::SourcedFile sourced;
+    sourced.lastModified = info.lastModified();
+    sourced.size = info.size();
+
     bool inFunction = false;
     QByteArray line;
     while (!file.atEnd() || !line.isEmpty()) {
@@ -6658,19 +7861,15 @@ bool FakeVimHandler::Private::handleExSourceCommand(const ExCommand &cmd)
         } else if (inFunction && line.startsWith("endfunction")) {
             inFunction = false;
         } else if (!line.isEmpty() && !inFunction) {
-            //qDebug() << "EXECUTING: " << line;
-            ExCommand cmd;
-            QString commandLine = QString::fromLocal8Bit(line);
-            while (parseExCommand(&commandLine, &cmd)) {
-                if (!handleExCommandHelper(cmd))
-                    break;
-            }
+            sourced.commandLines.append(QString::fromLocal8Bit(line));
         }
 
         line = nextline;
     }
-    file.close();
-    return true;
+
+    if (changed)
+        *changed = true;
+    return &g.sourcedFiles.insert(key, sourced)->commandLines;
 }
 
 bool FakeVimHandler::Private::handleExEchoCommand(const ExCommand &cmd)
@@ -6682,6 +7881,34 @@ bool FakeVimHandler::Private::handleExEchoCommand(const ExCommand &cmd)
     return true;
 }
 
+bool FakeVimHandler::Private::handleExPerfStatsCommand(const ExCommand &cmd)
+{
+    // :perfs[tats]
+    // :perfs[tats] reset
+    // :perfs[tats] trace {file}
+    if (!cmd.matches("perfs", "perfstats"))
+        return false;
+
+    const QString action = cmd.args.section(' ', 0, 0, QString::SectionSkipEmpty);
+    const QString fileName = replaceTildeWithHome(
+                cmd.args.section(' ', 1, -1, QString::SectionSkipEmpty));
+    if (action.isEmpty()) {
+        q->extraInformationChanged(Perf::report());
+    } else if (action == "reset") {
+        Perf::reset();
+        showMessage(MessageInfo, Tr::tr("Performance statistics cleared"));
+    } else if (action == "trace" && !fileName.isEmpty()) {
+        QString error;
+        if (Perf::writeChromeTrace(fileName, &error))
+            showMessage(MessageInfo, Tr::tr("Trace written to \"%1\"").arg(fileName));
+        else
+            showMessage(MessageError, Tr::tr("Cannot write trace \"%1\": %2").arg(fileName, error));
+    } else {
+        showMessage(MessageError, Tr::tr("Invalid argument: %1").arg(cmd.args));
+    }
+    return true;
+}
+
 void FakeVimHandler::Private::handleExCommand(const QString &line0)
 {
     QString line = line0; // Make sure we have a copy to prevent aliasing.
@@ -6735,8 +7962,10 @@ bool FakeVimHandler::Private::handleExCommandHelper(ExCommand &cmd)
         || handleExMultiRepeatCommand(cmd)
         || handleExNohlsearchCommand(cmd)
         || handleExNormalCommand(cmd)
+        || handleExPerfStatsCommand(cmd)
         || handleExReadCommand(cmd)
         || handleExUndoRedoCommand(cmd)
+        || handleExUndoFileCommand(cmd)
         || handleExSetCommand(cmd)
         || handleExShiftCommand(cmd)
         || handleExSortCommand(cmd)
@@ -6796,7 +8025,8 @@ void FakeVimHandler::Private::searchBalanced(bool forward, QChar needle, QChar o
 QTextCursor FakeVimHandler::Private::search(const SearchData &sd, int startPos, int count,
     bool showMessages)
 {
-    const QRegularExpression needleExp = vimPatternToQtPattern(sd.needle);
+    const SearchPattern pattern = vimPatternToQtPattern(sd.needle);
+    const QRegularExpression &needleExp = pattern.regExp;
 
     if (!needleExp.isValid()) {
         if (showMessages) {
@@ -6820,9 +8050,9 @@ QTextCursor FakeVimHandler::Private::search(const SearchData &sd, int startPos,
 
         if (!tc.isNull()) {
             if (sd.forward)
-                searchForward(&tc, needleExp, &repeat);
+                searchForward(&tc, pattern, &repeat);
             else
-                searchBackward(&tc, needleExp, &repeat);
+                searchBackward(&tc, pattern, &repeat);
         }
     }
 
@@ -6831,9 +8061,9 @@ QTextCursor FakeVimHandler::Private::search(const SearchData &sd, int startPos,
             tc = QTextCursor(document());
             tc.movePosition(sd.forward ? StartOfDocument : EndOfDocument);
             if (sd.forward)
-                searchForward(&tc, needleExp, &repeat);
+                searchForward(&tc, pattern, &repeat);
             else
-                searchBackward(&tc, needleExp, &repeat);
+                searchBackward(&tc, pattern, &repeat);
             if (tc.isNull()) {
                 if (showMessages) {
                     showMessage(MessageError,
@@ -7031,7 +8261,7 @@ void FakeVimHandler::Private::moveToTargetColumn()
         setPosition(pos);
         return;
     }
-    const int physical = bl.position() + logicalToPhysicalColumn(m_targetColumn, bl.text());
+    const int physical = bl.position() + logicalToPhysicalColumn(m_targetColumn, bl);
     //qDebug() << "CORRECTING COLUMN FROM: " << logical << "TO" << m_targetColumn;
     setPosition(qMin(pos, physical));
 }
@@ -7150,6 +8380,8 @@ void FakeVimHandler::Private::setupCharClass()
             m_charClass[qMin(255, someInt(part))] = 2;
         }
     }
+    if (m_buffer && m_buffer->keywordIndex)
+        m_buffer->keywordIndex->setCharClasses(m_charClass);
 }
 
 void FakeVimHandler::Private::moveToBoundary(bool simple, bool forward)
@@ -7326,39 +8558,50 @@ int FakeVimHandler::Private::physicalCursorColumn() const
 }
 
 int FakeVimHandler::Private::physicalToLogicalColumn
-    (const int physical, const QString &line) const
+    (const int physical, const QTextBlock &block) const
 {
-    const int ts = s.tabStop.value();
-    int p = 0;
-    int logical = 0;
-    while (p < physical) {
-        QChar c = line.at(p);
-        //if (c == ' ')
-        //    ++logical;
-        //else
-        if (c == '\t')
-            logical += ts - logical % ts;
-        else
-            ++logical;
-            //break;
-        ++p;
-    }
-    return logical;
+    return columnIndex(block).toLogical(physical);
 }
 
 int FakeVimHandler::Private::logicalToPhysicalColumn
-    (const int logical, const QString &line) const
+    (const int logical, const QTextBlock &block) const
+{
+    return columnIndex(block).toPhysical(logical);
+}
+
+// Index of tabs in the block; kept for the last block asked for and updated
+// on changes (see updateColumnIndex()), so moving the cursor on a long line
+// doesn't copy the line.
+const ColumnIndex &FakeVimHandler::Private::columnIndex(const QTextBlock &block) const
 {
     const int ts = s.tabStop.value();
-    int physical = 0;
-    for (int l = 0; l < logical && physical < line.size(); ++physical) {
-        QChar c = line.at(physical);
-        if (c == '\t')
-            l += ts - l % ts;
-        else
-            ++l;
+    if (block.position() != m_columnIndexBlock || block.length() - 1 != m_columnIndex.size()
+            || qMax(1, ts) != m_columnIndex.tabStop()) {
+        m_columnIndex.reset(block.text(), ts);
+        m_columnIndexBlock = block.position();
     }
-    return physical;
+    return m_columnIndex;
+}
+
+void FakeVimHandler::Private::updateColumnIndex(int position, int charsRemoved, int charsAdded)
+{
+    const int start = m_columnIndexBlock;
+    const int end = start + m_columnIndex.size();
+    if (position + charsRemoved < start) {
+        m_columnIndexBlock += charsAdded - charsRemoved;
+        return;
+    }
+    if (position > end)
+        return;
+
+    m_columnIndexBlock = -1;
+    if (position < start || position + charsRemoved > end)
+        return;
+    const QString inserted = textAt(position, position + charsAdded);
+    if (inserted.contains('\n'))
+        return;
+    m_columnIndex.replace(position - start, charsRemoved, inserted);
+    m_columnIndexBlock = start;
 }
 
 int FakeVimHandler::Private::windowScrollOffset() const
@@ -7368,9 +8611,7 @@ int FakeVimHandler::Private::windowScrollOffset() const
 
 int FakeVimHandler::Private::logicalCursorColumn() const
 {
-    const int physical = physicalCursorColumn();
-    const QString line = block().text();
-    return physicalToLogicalColumn(physical, line);
+    return physicalToLogicalColumn(physicalCursorColumn(), block());
 }
 
 Column FakeVimHandler::Private::cursorColumn() const
@@ -7392,6 +8633,15 @@ void FakeVimHandler::Private::scrollToLine(int line)
     if (line == m_firstVisibleLine)
         return;
 
+    // The vertical scroll bar of QPlainTextEdit counts lines like
+    // findBlockByLineNumber(), so scrolling only lays out the lines that
+    // become visible.
+    if (m_plaintextedit) {
+        m_plaintextedit->verticalScrollBar()->setValue(line);
+        m_firstVisibleLine = line;
+        return;
+    }
+
     const QTextCursor tc = m_cursor;
 
     QTextCursor tc2 = tc;
@@ -7422,6 +8672,10 @@ void FakeVimHandler::Private::scrollToLine(int line)
 
 void FakeVimHandler::Private::updateFirstVisibleLine()
 {
+    if (m_plaintextedit) {
+        m_firstVisibleLine = m_plaintextedit->verticalScrollBar()->value();
+        return;
+    }
     const QTextCursor tc = EDITOR(cursorForPosition(QPoint(0,0)));
     m_firstVisibleLine = lineForPosition(tc.position()) - 1;
 }
@@ -7460,6 +8714,8 @@ void FakeVimHandler::Private::scrollUp(int count)
 
 void FakeVimHandler::Private::updateScrollOffset()
 {
+    if (isBatching())
+        return;
     const int line = cursorLine();
     if (line < lineOnTop())
         scrollToLine(qMax(0, line - windowScrollOffset()));
@@ -8048,6 +9304,22 @@ QString FakeVimHandler::Private::textAt(int from, int to) const
     return tc.selectedText().replace(ParagraphSeparator, '\n');
 }
 
+TextBeforeCursor FakeVimHandler::Private::textBeforeCursor(int pos) const
+{
+    const int begin = blockAt(pos).position();
+    TextBeforeCursor text;
+    text.size = pos - begin;
+    if (text.size <= 2 * TextBeforeCursor::KeptSize) {
+        text.head = textAt(begin, pos);
+    } else {
+        text.head = textAt(begin, begin + TextBeforeCursor::KeptSize);
+        text.tail = textAt(pos - TextBeforeCursor::KeptSize, pos);
+    }
+    while (text.indentation < text.size && characterAt(begin + text.indentation) == ' ')
+        ++text.indentation;
+    return text;
+}
+
 void FakeVimHandler::Private::setLineContents(int line, const QString &contents)
 {
     QTextBlock block = document()->findBlockByLineNumber(line - 1);
@@ -8260,6 +9532,11 @@ void FakeVimHandler::Private::joinPreviousEditBlock()
     UNDO_DEBUG("JOIN");
     if (m_buffer->breakEditBlock) {
         beginEditBlock();
+        if (m_buffer->journal) {
+            // The journal keeps undo points so there is no undo command to break.
+            m_buffer->breakEditBlock = false;
+            return;
+        }
         QTextCursor tc(m_cursor);
         tc.setPosition(tc.position());
         tc.beginEditBlock();
@@ -8293,6 +9570,8 @@ void FakeVimHandler::Private::endEditBlock()
     }
     --m_buffer->editBlockLevel;
     if (m_buffer->editBlockLevel == 0 && m_buffer->undoState.isValid()) {
+        if (m_buffer->journal)
+            m_buffer->journal->addUndoPoint(m_buffer->undoState.revision);
         m_buffer->undo.push(m_buffer->undoState);
         m_buffer->undoState = State();
     }
@@ -8300,8 +9579,30 @@ void FakeVimHandler::Private::endEditBlock()
         m_buffer->breakEditBlock = false;
 }
 
+void FakeVimHandler::Private::endBatch()
+{
+    if (m_batchLevel <= 0) {
+        qWarning("beginBatch() not called before endBatch()!");
+        return;
+    }
+    if (--m_batchLevel > 0)
+        return;
+
+    const QString highlighted = m_highlighted;
+    updateHighlights();
+    // Matches may have changed with the text.
+    if (!m_highlighted.isEmpty() && m_highlighted == highlighted)
+        q->highlightMatches(m_highlighted);
+    updateScrollOffset();
+}
+
 void FakeVimHandler::Private::onContentsChanged(int position, int charsRemoved, int charsAdded)
 {
+    FAKEVIM_PERF_SCOPE("onContentsChanged");
+
+    if (m_columnIndexBlock != -1)
+        updateColumnIndex(position, charsRemoved, charsAdded);
+
     // Record inserted and deleted text in insert mode.
     if (isInsertMode() && (charsAdded > 0 || charsRemoved > 0) && canModifyBufferData()) {
         BufferData::InsertState &insertState = m_buffer->insertState;
@@ -8333,7 +9634,7 @@ void FakeVimHandler::Private::onContentsChanged(int position, int charsRemoved,
                     const int backspaceCount = insertState.pos1 - position;
                     const QString inserted = textAt(position, position + charsAdded);
                     const QString unified = inserted.startsWith('\n') ? inserted.mid(1) : inserted;
-                    changedAtEnd = unified.startsWith(insertState.textBeforeCursor);
+                    changedAtEnd = insertState.textBeforeCursor.isPrefixOf(unified);
 
                     int indentNew = 0;
                     for (int i = 0, end = unified.size(); i < end; ++i) {
@@ -8341,13 +9642,7 @@ void FakeVimHandler::Private::onContentsChanged(int position, int charsRemoved,
                             break;
                         ++indentNew;
                     }
-                    int indentOld = 0;
-                    for (int i = 0, end = insertState.textBeforeCursor.size(); i < end; ++i) {
-                        if (insertState.textBeforeCursor.at(i) != ' ')
-                            break;
-                        --indentOld;
-                    }
-                    indentation = indentNew + indentOld;
+                    indentation = indentNew - insertState.textBeforeCursor.indentation;
 
                     if ((backspaceCount != charsRemoved && indentation == 0 && !changedAtEnd)
                             || (oldPosition == charsRemoved && wholeDocumentChanged)) {
@@ -8384,11 +9679,11 @@ void FakeVimHandler::Private::onContentsChanged(int position, int charsRemoved,
             const int newPosition = position + charsAdded;
             if (indentation == 0 && !changedAtEnd) // (un)indented has pos2 set correctly already
                 insertState.pos2 = qMax(insertState.pos2 + charsAdded - charsRemoved, newPosition);
-            insertState.textBeforeCursor = textAt(block().position(), newPosition);
+            insertState.textBeforeCursor = textBeforeCursor(newPosition);
         }
     }
 
-    if (!m_highlighted.isEmpty())
+    if (!m_highlighted.isEmpty() && !isBatching())
         q->highlightMatches(m_highlighted);
 }
 
@@ -8471,7 +9766,7 @@ void FakeVimHandler::Private::undoRedo(bool undo)
                                         : !stack.empty() ? stack.pop() : State();
 
     CursorPosition lastPos(m_cursor);
-    if (undo ? !document()->isUndoAvailable() : !document()->isRedoAvailable()) {
+    if (undo ? !isUndoAvailable() : !isRedoAvailable()) {
         const QString msg = undo ? Tr::tr("Already at oldest change.")
             : Tr::tr("Already at newest change.");
         showMessage(MessageInfo, msg);
@@ -8484,7 +9779,18 @@ void FakeVimHandler::Private::undoRedo(bool undo)
 
     // Do undo/redo [count] times to reach previous revision.
     const int previousRevision = revision();
-    if (undo) {
+    int changePosition = -1;
+    if (UndoJournal *journal = m_buffer->journal) {
+        // Jump to the revision directly.
+        if (undo) {
+            changePosition = journal->setRevision(
+                        state.revision >= 0 && state.revision < revision()
+                        ? state.revision : journal->previousUndoPoint());
+        } else {
+            changePosition = journal->setRevision(
+                        state.revision > revision() ? state.revision : journal->nextUndoPoint());
+        }
+    } else if (undo) {
         do {
             EDITOR(undo());
         } while (document()->isUndoAvailable() && state.revision >= 0 && state.revision < revision());
@@ -8508,6 +9814,9 @@ void FakeVimHandler::Private::undoRedo(bool undo)
         setCursorPosition(state.position);
         setAnchor();
         state.revision = previousRevision;
+    } else if (changePosition >= 0) {
+        setPosition(qMin(changePosition, lastPositionInDocument()));
+        setAnchor();
     } else {
         updateFirstVisibleLine();
         pullCursor();
@@ -8773,12 +10082,16 @@ void FakeVimHandler::Private::replay(const QString &command, int repeat)
     //qDebug() << "REPLAY: " << quoteUnprintable(command);
     clearCurrentMode();
     const Inputs inputs(command);
-    for (int i = 0; i < repeat; ++i) {
+    beginBatch();
+    bool handled = true;
+    for (int i = 0; handled && i < repeat; ++i) {
         for (const Input &in : inputs) {
-            if (handleDefaultKey(in) != EventHandled)
-                return;
+            handled = handleDefaultKey(in) == EventHandled;
+            if (!handled)
+                break;
         }
     }
+    endBatch();
 }
 
 QString FakeVimHandler::Private::visualDotCommand() const
@@ -9481,6 +10794,25 @@ void FakeVimHandler::handleCommand(const QString &cmd)
     d->leaveFakeVim();
 }
 
+bool FakeVimHandler::loadConfig(const QString &fileName)
+{
+    bool changed = false;
+    if (!d->readSourceFile(fileName, &changed))
+        return false;
+
+    // Options and mappings are shared by all editors so an unchanged file only
+    // needs to be applied to this editor.
+    if (changed) {
+        handleCommand(QString("source ") + fileName);
+    } else {
+        d->enterFakeVim();
+        d->updateEditor();
+        d->updateHighlights();
+        d->leaveFakeVim();
+    }
+    return true;
+}
+
 void FakeVimHandler::handleReplay(const QString &keys)
 {
     d->enterFakeVim();
@@ -9502,6 +10834,11 @@ void FakeVimHandler::enterCommandMode()
     d->enterCommandMode();
 }
 
+void FakeVimHandler::waitForFilter()
+{
+    d->waitForFilter();
+}
+
 void FakeVimHandler::setCurrentFileName(const QString &fileName)
 {
     d->m_currentFileName = fileName;
@@ -9515,6 +10852,9 @@ QString FakeVimHandler::currentFileName() const
 void FakeVimHandler::showMessage(MessageLevel level, const QString &msg)
 {
     d->showMessage(level, msg);
+    // Messages from asynchronous operations have to be shown right away.
+    if (!d->m_inFakeVim)
+        d->updateMiniBuffer();
 }
 
 QWidget *FakeVimHandler::widget()
@@ -9573,6 +10913,28 @@ bool FakeVimHandler::jumpToLocalMark(QChar mark, bool backTickMode)
     return d->jumpToMark(mark, backTickMode);
 }
 
+void FakeVimHandler::setUndoJournal(UndoJournal *journal)
+{
+    if (d->m_buffer->journal)
+        d->m_buffer->journal->disconnect(d);
+    d->m_buffer->journal = journal;
+    if (journal) {
+        journal->document()->setUndoRedoEnabled(false);
+        connect(journal, &UndoJournal::changeRecorded,
+                d, &FakeVimHandler::Private::onUndoCommandAdded);
+    }
+    d->m_buffer->lastRevision = d->revision();
+}
+
+void FakeVimHandler::setKeywordIndex(KeywordIndex *index)
+{
+    d->m_buffer->keywordIndex = index;
+    if (index) {
+        index->setCharClasses(d->m_charClass);
+        index->addDocument(d->document());
+    }
+}
+
 } // namespace Internal
 } // namespace FakeVim
 
@@ -10,6 +10,7 @@
 #endif
 
 #include <QObject>
+#include <QRegularExpression>
 #include <QTextEdit>
 
 #include <functional>
@@ -18,6 +19,9 @@
 namespace FakeVim {
 namespace Internal {
 
+class KeywordIndex;
+class UndoJournal;
+
 enum RangeMode
 {
     // Reordering first three enum items here will break
@@ -56,6 +60,18 @@ struct FAKEVIM_EXPORT ExCommand
     int count = 1;
 };
 
+// Vim pattern translated with the current 'ignorecase' and 'smartcase'
+// options, for searching text outside of an editor (e.g. files for :vimgrep).
+struct FAKEVIM_EXPORT SearchExpression
+{
+    QRegularExpression regExp;
+    // Literal text every match starts with (empty if there is none).
+    QString literalPrefix;
+    Qt::CaseSensitivity prefixCaseSensitivity = Qt::CaseSensitive;
+};
+
+FAKEVIM_EXPORT SearchExpression vimPatternToSearchExpression(const QString &pattern);
+
 // message levels sorted by severity
 enum MessageLevel
 {
@@ -110,9 +126,16 @@ public:
     // This executes an "ex" style command taking context
     // information from the current widget.
     void handleCommand(const QString &cmd);
+
+    // Sources a configuration file (e.g. vimrc) unless it was already sourced
+    // and hasn't changed since. Returns false if the file cannot be read.
+    bool loadConfig(const QString &fileName);
     void handleReplay(const QString &keys);
     void handleInput(const QString &keys);
     void enterCommandMode();
+    // Runs a command started by :[range]!{cmd} to the end without the event
+    // loop (e.g. in batch mode) and applies its output.
+    void waitForFilter();
 
     void installEventFilter();
 
@@ -135,6 +158,15 @@ public:
 
     bool jumpToLocalMark(QChar mark, bool backTickMode);
 
+    // Keep undo history of the document in the journal instead of the undo
+    // stack of QTextDocument (which gets disabled).
+    void setUndoJournal(UndoJournal *journal);
+
+    // Complete keywords in insert mode (<C-N>, <C-P>) from the index, which
+    // can be shared by the editors of all documents. The document is added to
+    // the index; changes have to be passed to KeywordIndex::record().
+    void setKeywordIndex(KeywordIndex *index);
+
     bool eventFilter(QObject *ob, QEvent *ev) override;
 
     Signal<void(const QString &msg, int cursorPos, int anchorPos, int messageLevel)> commandBufferChanged;
@@ -0,0 +1,306 @@
+// Copyright (C) 2026 Argos Open Tech
+// SPDX-License-Identifier: GPL-3.0+ OR GPL-3.0 WITH Qt-GPL-exception-1.0
+
+#include "fakevimperf.h"
+
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <QtAlgorithms>
+
+#include <atomic>
+#include <cstring>
+#include <numeric>
+
+namespace FakeVim {
+namespace Internal {
+namespace Perf {
+
+namespace {
+
+const int MaxStages = 64;
+
+// Histogram buckets are exact below 8ns; above that each power of two is
+// split into 8 buckets (at most 12.5% error). Values over a few days fall
+// into the last bucket.
+const int SubBucketBits = 3;
+const int SubBuckets = 1 << SubBucketBits;
+const int BucketCount = 48 * SubBuckets;
+
+const int TraceCapacity = 8192;
+
+int bucketIndex(quint64 ns)
+{
+    if (ns < SubBuckets)
+        return int(ns);
+    const int msb = 63 - qCountLeadingZeroBits(ns);
+    const int index = ((msb - SubBucketBits + 1) << SubBucketBits)
+            | int((ns >> (msb - SubBucketBits)) & (SubBuckets - 1));
+    return qMin(index, BucketCount - 1);
+}
+
+// Middle of the range of values counted in a bucket.
+double bucketValue(int index)
+{
+    if (index < SubBuckets)
+        return index;
+    const int shift = (index >> SubBucketBits) - 1;
+    const quint64 low = quint64(SubBuckets | (index & (SubBuckets - 1))) << shift;
+    return low + (quint64(1) << shift) / 2.0;
+}
+
+struct StageData
+{
+    std::atomic<quint64> count;
+    std::atomic<quint64> max;
+    std::atomic<quint32> buckets[BucketCount];
+};
+
+struct TraceEvent
+{
+    std::atomic<qint64> start;
+    std::atomic<qint64> duration;
+    std::atomic<int> stage;
+};
+
+// Written only by the owning thread.
+struct ThreadData
+{
+    int id = 0;
+    QString name;
+    StageData stages[MaxStages];
+    TraceEvent trace[TraceCapacity];
+    std::atomic<quint64> traceCount;
+};
+
+struct Registry
+{
+    QMutex mutex;
+    const char *stageNames[MaxStages] = {};
+    std::atomic<int> stageCount{0};
+    // Data of finished threads is kept so their samples stay in the results.
+    QVector<ThreadData *> threads;
+    std::atomic<qint64> lastInput{0};
+};
+
+Registry &registry()
+{
+    static Registry r;
+    return r;
+}
+
+ThreadData *threadData()
+{
+    thread_local ThreadData *data = [] {
+        auto newData = new ThreadData();
+        QThread *thread = QThread::currentThread();
+        Registry &r = registry();
+        QMutexLocker lock(&r.mutex);
+        newData->id = r.threads.size();
+        if (thread && !thread->objectName().isEmpty())
+            newData->name = thread->objectName();
+        else if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread())
+            newData->name = "Main";
+        else
+            newData->name = QString("Thread %1").arg(newData->id);
+        r.threads.append(newData);
+        return newData;
+    }();
+    return data;
+}
+
+void increment(std::atomic<quint64> &value)
+{
+    value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+int stage(const char *name)
+{
+    Registry &r = registry();
+    QMutexLocker lock(&r.mutex);
+    const int count = r.stageCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; ++i) {
+        if (std::strcmp(r.stageNames[i], name) == 0)
+            return i;
+    }
+    if (count == MaxStages)
+        return -1;
+    r.stageNames[count] = name;
+    r.stageCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+void record(int stage, qint64 start, qint64 end)
+{
+    if (stage < 0)
+        return;
+
+    ThreadData *data = threadData();
+    const quint64 ns = quint64(qMax<qint64>(0, end - start));
+
+    StageData &s = data->stages[stage];
+    increment(s.count);
+    if (ns > s.max.load(std::memory_order_relaxed))
+        s.max.store(ns, std::memory_order_relaxed);
+    std::atomic<quint32> &bucket = s.buckets[bucketIndex(ns)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    const quint64 i = data->traceCount.load(std::memory_order_relaxed);
+    TraceEvent &event = data->trace[i % TraceCapacity];
+    event.start.store(start, std::memory_order_relaxed);
+    event.duration.store(qint64(ns), std::memory_order_relaxed);
+    event.stage.store(stage, std::memory_order_relaxed);
+    data->traceCount.store(i + 1, std::memory_order_release);
+}
+
+void markInput()
+{
+    qint64 expected = 0;
+    registry().lastInput.compare_exchange_strong(expected, now(), std::memory_order_relaxed);
+}
+
+void recordInputLatency()
+{
+    static const int inputToPaint = stage("inputToPaint");
+    const qint64 input = registry().lastInput.exchange(0, std::memory_order_relaxed);
+    if (input != 0)
+        record(inputToPaint, input, now());
+}
+
+QVector<StageStatistics> statistics()
+{
+    Registry &r = registry();
+    QMutexLocker lock(&r.mutex);
+
+    QVector<StageStatistics> result;
+    const int stageCount = r.stageCount.load(std::memory_order_acquire);
+    QVector<quint64> buckets(BucketCount);
+    for (int stage = 0; stage < stageCount; ++stage) {
+        StageStatistics stats;
+        stats.name = QString::fromLatin1(r.stageNames[stage]);
+        quint64 max = 0;
+        buckets.fill(0);
+        for (const ThreadData *data : qAsConst(r.threads)) {
+            const StageData &s = data->stages[stage];
+            stats.count += s.count.load(std::memory_order_relaxed);
+            max = qMax(max, s.max.load(std::memory_order_relaxed));
+            for (int i = 0; i < BucketCount; ++i)
+                buckets[i] += s.buckets[i].load(std::memory_order_relaxed);
+        }
+        if (stats.count == 0)
+            continue;
+
+        const quint64 total = std::accumulate(buckets.begin(), buckets.end(), quint64(0));
+        const auto percentile = [&](double p) {
+            const quint64 rank = qMax<quint64>(1, quint64(p * total + 0.5));
+            quint64 seen = 0;
+            for (int i = 0; i < BucketCount; ++i) {
+                seen += buckets[i];
+                if (seen >= rank)
+                    return qMin(bucketValue(i), double(max));
+            }
+            return double(max);
+        };
+        stats.p50 = percentile(0.50) / 1e6;
+        stats.p99 = percentile(0.99) / 1e6;
+        stats.max = max / 1e6;
+        result.append(stats);
+    }
+    return result;
+}
+
+QString report()
+{
+    const QVector<StageStatistics> stats = statistics();
+    if (stats.isEmpty())
+        return QString("No samples recorded.");
+
+    QString text = QString("%1 %2 %3 %4 %5\n")
+            .arg("Stage", -20).arg("Count", 10)
+            .arg("p50 ms", 10).arg("p99 ms", 10).arg("max ms", 10);
+    for (const StageStatistics &s : stats) {
+        text += QString("%1 %2 %3 %4 %5\n")
+                .arg(s.name, -20).arg(s.count, 10)
+                .arg(s.p50, 10, 'f', 3).arg(s.p99, 10, 'f', 3).arg(s.max, 10, 'f', 3);
+    }
+    return text;
+}
+
+void reset()
+{
+    Registry &r = registry();
+    QMutexLocker lock(&r.mutex);
+    for (ThreadData *data : qAsConst(r.threads)) {
+        for (StageData &s : data->stages) {
+            s.count.store(0, std::memory_order_relaxed);
+            s.max.store(0, std::memory_order_relaxed);
+            for (std::atomic<quint32> &bucket : s.buckets)
+                bucket.store(0, std::memory_order_relaxed);
+        }
+        data->traceCount.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool writeChromeTrace(const QString &fileName, QString *error)
+{
+    Registry &r = registry();
+    const qint64 pid = QCoreApplication::applicationPid();
+
+    QJsonArray events;
+    {
+        QMutexLocker lock(&r.mutex);
+        for (const ThreadData *data : qAsConst(r.threads)) {
+            events.append(QJsonObject{
+                {"name", "thread_name"},
+                {"ph", "M"},
+                {"pid", pid},
+                {"tid", data->id},
+                {"args", QJsonObject{{"name", data->name}}},
+            });
+
+            // Events may be overwritten while reading; the trace is a
+            // diagnostic aid so the rare torn entry is acceptable.
+            const quint64 count = data->traceCount.load(std::memory_order_acquire);
+            const quint64 first = count > quint64(TraceCapacity) ? count - TraceCapacity : 0;
+            for (quint64 i = first; i < count; ++i) {
+                const TraceEvent &event = data->trace[i % TraceCapacity];
+                const int stage = event.stage.load(std::memory_order_relaxed);
+                events.append(QJsonObject{
+                    {"name", QString::fromLatin1(r.stageNames[stage])},
+                    {"cat", "fakevim"},
+                    {"ph", "X"},
+                    {"ts", event.start.load(std::memory_order_relaxed) / 1e3},
+                    {"dur", event.duration.load(std::memory_order_relaxed) / 1e3},
+                    {"pid", pid},
+                    {"tid", data->id},
+                });
+            }
+        }
+    }
+
+    const QJsonObject trace{
+        {"traceEvents", events},
+        {"displayTimeUnit", "ms"},
+    };
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)
+            || file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact)) < 0
+            || !file.commit()) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+} // namespace Perf
+} // namespace Internal
+} // namespace FakeVim
@@ -0,0 +1,87 @@
+// Copyright (C) 2026 Argos Open Tech
+// SPDX-License-Identifier: GPL-3.0+ OR GPL-3.0 WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#define FAKEVIM_STANDALONE
+
+#ifdef FAKEVIM_STANDALONE
+#   include "private/fakevim_export.h"
+#endif
+
+#include <QString>
+#include <QVector>
+
+#include <chrono>
+
+namespace FakeVim {
+namespace Internal {
+namespace Perf {
+
+// Latency instrumentation for code running on every key press.
+//
+// Each thread records into its own histograms and trace buffer, so timing a
+// scope costs two clock reads and a few relaxed atomic stores. Readers merge
+// the per-thread data without stopping the writers.
+
+inline qint64 now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns identifier of a named stage, registering it on first use.
+// Returns -1 if too many stages are registered.
+FAKEVIM_EXPORT int stage(const char *name);
+
+// Records time spent in a stage (timestamps are from now()).
+FAKEVIM_EXPORT void record(int stage, qint64 start, qint64 end);
+
+// Remembers time of the last user input. The next recordInputLatency() call
+// records the time from the input to that point as "inputToPaint".
+FAKEVIM_EXPORT void markInput();
+FAKEVIM_EXPORT void recordInputLatency();
+
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(int stage) : m_stage(stage), m_start(now()) {}
+    ~ScopedTimer() { record(m_stage, m_start, now()); }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    int m_stage;
+    qint64 m_start;
+};
+
+struct StageStatistics
+{
+    QString name;
+    quint64 count = 0;
+    // Times in milliseconds.
+    double p50 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+FAKEVIM_EXPORT QVector<StageStatistics> statistics();
+
+// Table with statistics of all stages that recorded something.
+FAKEVIM_EXPORT QString report();
+
+FAKEVIM_EXPORT void reset();
+
+// Writes recently recorded scopes in Chrome trace format
+// (chrome://tracing, Perfetto).
+FAKEVIM_EXPORT bool writeChromeTrace(const QString &fileName, QString *error);
+
+} // namespace Perf
+} // namespace Internal
+} // namespace FakeVim
+
+// Times the rest of the enclosing scope.
+#define FAKEVIM_PERF_SCOPE(name) \
+    static const int fakeVimPerfStage = ::FakeVim::Internal::Perf::stage(name); \
+    const ::FakeVim::Internal::Perf::ScopedTimer fakeVimPerfTimer(fakeVimPerfStage)
@@ -0,0 +1,443 @@
+// Copyright (C) 2026 Argos Open Tech
+// SPDX-License-Identifier: GPL-3.0+ OR GPL-3.0 WITH Qt-GPL-exception-1.0
+
+#include "fakevimundo.h"
+#include "fakevimtr.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <QTextCursor>
+#include <QTextDocument>
+
+#include <algorithm>
+
+namespace FakeVim {
+namespace Internal {
+
+namespace {
+
+const quint32 UndoFileMagic = 0x46565544; // "FVUD"
+const quint32 UndoFileVersion = 2;
+
+// Changes since the last snapshot needed before taking another one (at least
+// twice the document size so snapshots don't dominate memory usage).
+const qint64 MinCheckpointDistance = 1024 * 1024;
+
+} // namespace
+
+UndoJournal::UndoJournal(QTextDocument *document, QObject *parent)
+    : QObject(parent)
+    , m_document(document)
+{
+}
+
+UndoJournal::~UndoJournal() = default;
+
+void UndoJournal::trackDocument()
+{
+    if (m_tracking)
+        return;
+    m_tracking = true;
+    m_shadow = documentText(0, documentLength());
+    connect(m_document, &QTextDocument::contentsChange, this, &UndoJournal::onContentsChange);
+}
+
+void UndoJournal::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    // Counts may include the implicit paragraph separator at the end of the
+    // document.
+    const int removed = qBound(0, charsRemoved, m_shadow.size() - position);
+    const int added = qBound(0, charsAdded, documentLength() - position);
+    const QString oldText = m_shadow.mid(position, removed);
+    const QString newText = documentText(position, added);
+    m_shadow.replace(position, removed, newText);
+    record(position, oldText, newText);
+}
+
+void UndoJournal::record(int position, const QString &removed, const QString &inserted)
+{
+    if (m_applying || !m_recording)
+        return;
+
+    // Store only the part that changed. Edit blocks (e.g. :s over a range)
+    // are reported as one change of the whole range.
+    const int maxLength = qMin(removed.size(), inserted.size());
+    int prefix = 0;
+    while (prefix < maxLength && removed[prefix] == inserted[prefix])
+        ++prefix;
+    if (prefix > 0 && removed[prefix - 1].isHighSurrogate())
+        --prefix;
+    int suffix = 0;
+    while (suffix < maxLength - prefix
+           && removed[removed.size() - 1 - suffix] == inserted[inserted.size() - 1 - suffix]) {
+        ++suffix;
+    }
+    if (suffix > 0 && removed[removed.size() - suffix].isLowSurrogate())
+        --suffix;
+
+    // Format changes are reported as replacing text with itself.
+    if (prefix + suffix == removed.size() && prefix + suffix == inserted.size())
+        return;
+
+    Entry entry;
+    entry.position = position + prefix;
+    entry.removedLength = removed.size() - prefix - suffix;
+    entry.insertedLength = inserted.size() - prefix - suffix;
+    entry.removed = removed.midRef(prefix, entry.removedLength).toUtf8();
+    entry.inserted = inserted.midRef(prefix, entry.insertedLength).toUtf8();
+
+    truncateRedo();
+    const qint64 size = entrySize(entry);
+    m_entries.append(entry);
+    ++m_revision;
+    m_memoryUsage += size;
+    m_sizeSinceCheckpoint += size;
+
+    maybeAddCheckpoint();
+    enforceMemoryLimit();
+
+    emit changeRecorded();
+}
+
+void UndoJournal::clear()
+{
+    m_entries.clear();
+    m_checkpoints.clear();
+    m_undoPoints.clear();
+    m_base = m_revision;
+    m_memoryUsage = 0;
+    m_sizeSinceCheckpoint = 0;
+    if (m_tracking)
+        m_shadow = documentText(0, documentLength());
+}
+
+void UndoJournal::setRecording(bool recording)
+{
+    if (recording && !m_recording)
+        clear();
+    m_recording = recording;
+}
+
+int UndoJournal::setRevision(int revision)
+{
+    const int target = qBound(m_base, revision, newestRevision());
+    if (target == m_revision)
+        return -1;
+
+    // Replay changes from the current revision or start from a snapshot if
+    // that means less text to apply.
+    const auto distance = [this](int from, int to) {
+        qint64 size = 0;
+        for (int i = qMin(from, to); i < qMax(from, to); ++i)
+            size += entrySize(m_entries[i - m_base]);
+        return size;
+    };
+    const Checkpoint *start = nullptr;
+    qint64 cost = distance(m_revision, target);
+    for (const Checkpoint &checkpoint : qAsConst(m_checkpoints)) {
+        const qint64 checkpointCost = checkpoint.text.size() + distance(checkpoint.revision, target);
+        if (checkpointCost < cost) {
+            cost = checkpointCost;
+            start = &checkpoint;
+        }
+    }
+
+    m_applying = true;
+    QTextCursor tc(m_document);
+    tc.beginEditBlock();
+    int position = -1;
+    int from = m_revision;
+    if (start) {
+        tc.select(QTextCursor::Document);
+        tc.insertText(QString::fromUtf8(start->text));
+        from = start->revision;
+        position = 0;
+    }
+    const int lastPosition = apply(&tc, from, target);
+    tc.endEditBlock();
+    m_applying = false;
+
+    if (lastPosition == -2) {
+        // The document was changed without recording the change.
+        qWarning("UndoJournal: document doesn't match undo history");
+        m_revision = target;
+        clear();
+        return -1;
+    }
+
+    m_revision = target;
+    return lastPosition >= 0 ? lastPosition : position;
+}
+
+int UndoJournal::apply(QTextCursor *tc, int from, int to)
+{
+    int position = -1;
+    const int length = documentLength();
+    int delta = 0;
+    if (to < from) {
+        for (int revision = from; revision > to; --revision) {
+            const Entry &entry = m_entries[revision - 1 - m_base];
+            if (entry.position + entry.insertedLength > length + delta)
+                return -2;
+            tc->setPosition(entry.position);
+            tc->setPosition(entry.position + entry.insertedLength, QTextCursor::KeepAnchor);
+            tc->insertText(QString::fromUtf8(entry.removed));
+            delta += entry.removedLength - entry.insertedLength;
+            position = entry.position;
+        }
+    } else {
+        for (int revision = from; revision < to; ++revision) {
+            const Entry &entry = m_entries[revision - m_base];
+            if (entry.position + entry.removedLength > length + delta)
+                return -2;
+            tc->setPosition(entry.position);
+            tc->setPosition(entry.position + entry.removedLength, QTextCursor::KeepAnchor);
+            tc->insertText(QString::fromUtf8(entry.inserted));
+            delta += entry.insertedLength - entry.removedLength;
+            position = entry.position;
+        }
+    }
+    return position;
+}
+
+void UndoJournal::addUndoPoint(int revision)
+{
+    if (revision < m_base || revision > newestRevision())
+        return;
+    const auto it = std::lower_bound(m_undoPoints.begin(), m_undoPoints.end(), revision);
+    if (it == m_undoPoints.end() || *it != revision)
+        m_undoPoints.insert(it, revision);
+}
+
+int UndoJournal::previousUndoPoint() const
+{
+    const auto it = std::lower_bound(m_undoPoints.begin(), m_undoPoints.end(), m_revision);
+    if (it != m_undoPoints.begin())
+        return qMax(m_base, *(it - 1));
+    return qMax(m_base, m_revision - 1);
+}
+
+int UndoJournal::nextUndoPoint() const
+{
+    const auto it = std::upper_bound(m_undoPoints.begin(), m_undoPoints.end(), m_revision);
+    if (it != m_undoPoints.end())
+        return qMin(newestRevision(), *it);
+    return newestRevision();
+}
+
+void UndoJournal::setMemoryLimit(qint64 bytes)
+{
+    m_memoryLimit = bytes;
+    enforceMemoryLimit();
+}
+
+bool UndoJournal::save(const QString &fileName, QString *error) const
+{
+    return save(fileName, history(), hashText(documentText(0, documentLength())), error);
+}
+
+UndoJournal::History UndoJournal::history() const
+{
+    History history;
+    history.entries = m_entries.mid(0, m_revision - m_base);
+    for (int point : m_undoPoints) {
+        if (point <= m_revision)
+            history.undoPoints.append(point - m_base);
+    }
+    return history;
+}
+
+bool UndoJournal::save(const QString &fileName, const History &history,
+                       const QByteArray &textHash, QString *error)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << UndoFileMagic << UndoFileVersion << textHash << qint32(history.entries.size());
+    for (const Entry &entry : history.entries) {
+        out << qint32(entry.position) << qint32(entry.removedLength)
+            << qint32(entry.insertedLength) << entry.removed << entry.inserted;
+    }
+    out << history.undoPoints;
+
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool UndoJournal::load(const QString &fileName, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_12);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray textHash;
+    qint32 count = 0;
+    in >> magic >> version;
+    if (magic != UndoFileMagic || version != UndoFileVersion) {
+        *error = Tr::tr("Not an undo file");
+        return false;
+    }
+    in >> textHash >> count;
+    if (textHash != hashText(documentText(0, documentLength()))) {
+        *error = Tr::tr("File contents changed, cannot use undo info");
+        return false;
+    }
+
+    QVector<Entry> entries;
+    entries.reserve(qMax(0, count));
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        Entry entry;
+        qint32 position, removedLength, insertedLength;
+        in >> position >> removedLength >> insertedLength >> entry.removed >> entry.inserted;
+        entry.position = position;
+        entry.removedLength = removedLength;
+        entry.insertedLength = insertedLength;
+        entries.append(entry);
+    }
+    QVector<qint32> points;
+    in >> points;
+    if (in.status() != QDataStream::Ok) {
+        *error = Tr::tr("Undo file is corrupted");
+        return false;
+    }
+
+    // Loaded history ends at the current revision.
+    m_checkpoints.clear();
+    m_entries = entries;
+    m_base = m_revision - entries.size();
+    m_undoPoints.clear();
+    for (qint32 point : qAsConst(points))
+        m_undoPoints.append(m_base + point);
+    m_memoryUsage = 0;
+    for (const Entry &entry : qAsConst(m_entries))
+        m_memoryUsage += entrySize(entry);
+    m_sizeSinceCheckpoint = 0;
+    enforceMemoryLimit();
+    return true;
+}
+
+QString UndoJournal::documentText(int position, int count) const
+{
+    if (count <= 0)
+        return QString();
+    QTextCursor tc(m_document);
+    tc.setPosition(position);
+    tc.setPosition(position + count, QTextCursor::KeepAnchor);
+    QString text = tc.selectedText();
+    text.replace(QChar::ParagraphSeparator, '\n');
+    return text;
+}
+
+int UndoJournal::documentLength() const
+{
+    return qMax(0, m_document->characterCount() - 1);
+}
+
+qint64 UndoJournal::entrySize(const Entry &entry)
+{
+    return qint64(sizeof(Entry)) + entry.removed.size() + entry.inserted.size();
+}
+
+void UndoJournal::truncateRedo()
+{
+    if (!canRedo())
+        return;
+    for (int i = m_revision - m_base; i < m_entries.size(); ++i)
+        m_memoryUsage -= entrySize(m_entries[i]);
+    m_entries.resize(m_revision - m_base);
+    while (!m_checkpoints.isEmpty() && m_checkpoints.last().revision > m_revision) {
+        m_memoryUsage -= m_checkpoints.last().text.size();
+        m_checkpoints.removeLast();
+    }
+    while (!m_undoPoints.isEmpty() && m_undoPoints.last() > m_revision)
+        m_undoPoints.removeLast();
+}
+
+void UndoJournal::maybeAddCheckpoint()
+{
+    const int length = documentLength();
+    if (m_sizeSinceCheckpoint < qMax(MinCheckpointDistance, 2 * qint64(length)))
+        return;
+    // A snapshot of a large document would push out most of the history.
+    if (4 * qint64(length) > m_memoryLimit)
+        return;
+
+    Checkpoint checkpoint;
+    checkpoint.revision = m_revision;
+    checkpoint.text = (m_tracking ? m_shadow : documentText(0, length)).toUtf8();
+    m_memoryUsage += checkpoint.text.size();
+    m_checkpoints.append(checkpoint);
+    m_sizeSinceCheckpoint = 0;
+}
+
+void UndoJournal::enforceMemoryLimit()
+{
+    if (m_memoryUsage <= m_memoryLimit)
+        return;
+
+    // Free a bit more than needed so that this doesn't run on every change.
+    const qint64 goal = m_memoryLimit - m_memoryLimit / 8;
+
+    // Oldest snapshots go first, then the oldest changes and, if the redo
+    // history alone is too large, the newest changes.
+    while (m_memoryUsage > goal && m_checkpoints.size() > 1) {
+        m_memoryUsage -= m_checkpoints.first().text.size();
+        m_checkpoints.removeFirst();
+    }
+    int dropFront = 0;
+    while (m_memoryUsage > goal && m_base + dropFront < m_revision) {
+        m_memoryUsage -= entrySize(m_entries[dropFront]);
+        ++dropFront;
+    }
+    m_entries.remove(0, dropFront);
+    m_base += dropFront;
+    while (m_memoryUsage > goal && canRedo()) {
+        m_memoryUsage -= entrySize(m_entries.last());
+        m_entries.removeLast();
+    }
+    while (m_memoryUsage > goal && !m_checkpoints.isEmpty()) {
+        m_memoryUsage -= m_checkpoints.first().text.size();
+        m_checkpoints.removeFirst();
+    }
+
+    while (!m_checkpoints.isEmpty() && m_checkpoints.first().revision < m_base) {
+        m_memoryUsage -= m_checkpoints.first().text.size();
+        m_checkpoints.removeFirst();
+    }
+    while (!m_checkpoints.isEmpty() && m_checkpoints.last().revision > newestRevision()) {
+        m_memoryUsage -= m_checkpoints.last().text.size();
+        m_checkpoints.removeLast();
+    }
+    m_undoPoints.erase(std::remove_if(m_undoPoints.begin(), m_undoPoints.end(),
+                                      [this](int point) {
+                                          return point < m_base || point > newestRevision();
+                                      }),
+                       m_undoPoints.end());
+}
+
+QByteArray UndoJournal::hashText(const QString &text)
+{
+    return QCryptographicHash::hash(
+        QByteArray::fromRawData(reinterpret_cast<const char *>(text.constData()),
+                                text.size() * int(sizeof(QChar))),
+        QCryptographicHash::Sha1);
+}
+
+} // namespace Internal
+} // namespace FakeVim
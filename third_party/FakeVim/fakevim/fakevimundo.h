@@ -0,0 +1,155 @@
+// Copyright (C) 2026 Argos Open Tech
+// SPDX-License-Identifier: GPL-3.0+ OR GPL-3.0 WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#define FAKEVIM_STANDALONE
+
+#ifdef FAKEVIM_STANDALONE
+#   include "private/fakevim_export.h"
+#endif
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QTextCursor;
+class QTextDocument;
+QT_END_NAMESPACE
+
+namespace FakeVim {
+namespace Internal {
+
+// Undo history of a document kept as compact edit deltas.
+//
+// Replaces the undo stack of QTextDocument (see
+// FakeVimHandler::setUndoJournal()), which keeps every intermediate command in
+// memory and can only move one step at a time. Each change is stored once as
+// the replaced and the inserted text (without common prefix and suffix,
+// UTF-8 encoded). Full snapshots are taken now and then so that far jumps in
+// history don't need to replay every change. The oldest changes are dropped
+// when the journal grows over the memory limit.
+//
+// Revisions are absolute: revision() increases with each recorded change and
+// doesn't change when old history is dropped.
+//
+// The journal needs the replaced text of each change, which QTextDocument
+// doesn't provide. Applications that keep a copy of the text pass changes to
+// record(); otherwise trackDocument() keeps a copy in the journal.
+class FAKEVIM_EXPORT UndoJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit UndoJournal(QTextDocument *document, QObject *parent = nullptr);
+    ~UndoJournal() override;
+
+    QTextDocument *document() const { return m_document; }
+
+    // Records changes by observing the document.
+    void trackDocument();
+
+    // Records a change of the document (text with '\n' line breaks).
+    void record(int position, const QString &removed, const QString &inserted);
+
+    // Forgets all history, e.g. after the document was reloaded.
+    void clear();
+
+    // Changes made while not recording (e.g. loading a file) are ignored and
+    // history is cleared when recording is resumed.
+    bool isRecording() const { return m_recording; }
+    void setRecording(bool recording);
+
+    int revision() const { return m_revision; }
+    int oldestRevision() const { return m_base; }
+    int newestRevision() const { return m_base + m_entries.size(); }
+    bool canUndo() const { return m_revision > m_base; }
+    bool canRedo() const { return m_revision < newestRevision(); }
+
+    // Undoes or redoes changes to reach the revision (clamped to the available
+    // history) in a single edit of the document. Returns position of the last
+    // change applied or -1 if nothing changed.
+    int setRevision(int revision);
+
+    // Revisions at which the editor started a change (i.e. steps of "u").
+    void addUndoPoint(int revision);
+    int previousUndoPoint() const;
+    int nextUndoPoint() const;
+
+    qint64 memoryLimit() const { return m_memoryLimit; }
+    void setMemoryLimit(qint64 bytes);
+    qint64 memoryUsage() const { return m_memoryUsage; }
+
+    // Undo file contains history up to the current revision and is only
+    // accepted for the same document text.
+    bool save(const QString &fileName, QString *error) const;
+    bool load(const QString &fileName, QString *error);
+
+    // History up to the current revision, to write an undo file on another
+    // thread. Taking it is cheap; the recorded changes are shared.
+    class History;
+    History history() const;
+    // Writes an undo file for the text with the hash (see hashText()).
+    static bool save(const QString &fileName, const History &history,
+                     const QByteArray &textHash, QString *error);
+    // Hash of the text an undo file belongs to: SHA-1 of its UTF-16 code
+    // units, so that it can also be computed from pieces of the text.
+    static QByteArray hashText(const QString &text);
+
+signals:
+    // Emitted after a change was recorded.
+    void changeRecorded();
+
+private:
+    struct Entry
+    {
+        int position = 0;
+        int removedLength = 0;
+        int insertedLength = 0;
+        QByteArray removed;
+        QByteArray inserted;
+    };
+
+    struct Checkpoint
+    {
+        int revision = 0;
+        QByteArray text;
+    };
+
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    QString documentText(int position, int count) const;
+    int documentLength() const;
+    static qint64 entrySize(const Entry &entry);
+    void truncateRedo();
+    void maybeAddCheckpoint();
+    void enforceMemoryLimit();
+    int apply(QTextCursor *tc, int from, int to);
+
+    QTextDocument *m_document;
+    QVector<Entry> m_entries; // m_entries[i] changes revision m_base + i to m_base + i + 1
+    QVector<Checkpoint> m_checkpoints;
+    QVector<int> m_undoPoints;
+    int m_base = 0;
+    int m_revision = 0;
+    qint64 m_memoryLimit = 256 * 1024 * 1024;
+    qint64 m_memoryUsage = 0;
+    qint64 m_sizeSinceCheckpoint = 0;
+    bool m_applying = false;
+    bool m_recording = true;
+
+    bool m_tracking = false;
+    QString m_shadow;
+};
+
+class UndoJournal::History
+{
+private:
+    friend class UndoJournal;
+    QVector<UndoJournal::Entry> entries;
+    QVector<qint32> undoPoints;
+};
+
+} // namespace Internal
+} // namespace FakeVim
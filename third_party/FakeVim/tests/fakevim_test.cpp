@@ -29,7 +29,9 @@
  */
 
 #include "fakevimplugin.h"
+#include "fakevimcompletion.h"
 #include "fakevimhandler.h"
+#include "fakevimundo.h"
 
 #include "../example/editor.h"
 
@@ -38,6 +40,10 @@
 #include <QTextEdit>
 #include <QTextDocument>
 #include <QTextBlock>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
 
 //TESTED_COMPONENT=src/plugins/fakevim
 
@@ -2189,6 +2195,13 @@ void FakeVimPlugin::test_vim_search()
     KEYS("N", X "abc" N "def" N "ghi");
     KEYS("2n2N", X "abc" N "def" N "ghi");
 
+    // optional characters, case modifiers and alternatives in pattern
+    data.setText("ac" N "abc" N "ABD" N "x");
+    KEYS("/ab*c<CR>", "ac" N X "abc" N "ABD" N "x");
+    KEYS("/\\cabd<CR>", "ac" N "abc" N X "ABD" N "x");
+    KEYS("/x\\|ac<CR>", "ac" N "abc" N "ABD" N X "x");
+    KEYS("?ab\\=c<CR>", "ac" N X "abc" N "ABD" N "x");
+
     // delete to match
     data.setText("abc" N "def" N "abc" N "ghi abc jkl" N "xyz");
     KEYS("2l" "d/ghi<CR>", "ab" X "ghi abc jkl" N "xyz");
@@ -2465,6 +2478,19 @@ void FakeVimPlugin::test_vim_current_column()
     KEYS("^jj", "  abc" N "  def 123" N "" N "  " X "ghi");
     KEYS("kk", "  abc" N "  " X "def 123" N "" N "  ghi");
 
+    // tabs, also after editing the line
+    data.doCommand("set tabstop=4");
+    data.setText("\tab" N "abcde" X "fgh" N "a\tb\tc");
+    KEYS("k", "\ta" X "b" N "abcdefgh" N "a\tb\tc");
+    KEYS("jj", "\tab" N "abcdefgh" N "a\tb" X "\tc");
+    KEYS("0x", "\tab" N "abcdefgh" N X "\tb\tc");
+    KEYS("fc", "\tab" N "abcdefgh" N "\tb\t" X "c");
+    KEYS("k", "\tab" N "abcdefg" X "h" N "\tb\tc");
+    KEYS("j", "\tab" N "abcdefgh" N "\tb\t" X "c");
+    KEYS("0ia\t<ESC>", "\tab" N "abcdefgh" N "a" X "\t\tb\tc");
+    KEYS("fckj", "\tab" N "abcdefgh" N "a\t\tb\t" X "c");
+    KEYS("hk", "\tab" N "abcdefg" X "h" N "a\t\tb\tc");
+
     // yiw, yaw
     data.setText("  abc" N "  def" N "  ghi");
     KEYS("e<down>", "  abc" N "  de" X "f" N "  ghi");
@@ -2681,6 +2707,111 @@ void FakeVimPlugin::test_vim_undo_redo()
     KEYS("u", "abc" N "  " X "def" N "ghi");
 }
 
+void FakeVimPlugin::test_vim_undo_journal()
+{
+    TestData data;
+    setup(&data);
+
+    data.setText("abc def" N "xyz" N "123");
+    auto journal = new UndoJournal(data.editor()->document(), data.edit);
+    journal->trackDocument();
+    data.handler->setUndoJournal(journal);
+    QVERIFY(!data.editor()->document()->isUndoRedoEnabled());
+
+    KEYS("ddu", X "abc def" N "xyz" N "123");
+    KEYS("<C-r>", X "xyz" N "123");
+    KEYS("dd", X "123");
+    KEYS("3x", X "");
+    KEYS("3u", X "abc def" N "xyz" N "123");
+    KEYS("2<C-r>", X "123");
+    KEYS("u", X "xyz" N "123");
+    KEYS("u", X "abc def" N "xyz" N "123");
+    KEYS("u", X "abc def" N "xyz" N "123");
+    QCOMPARE(journal->revision(), journal->oldestRevision());
+
+    KEYS("A xxx<ESC>", "abc def xx" X "x" N "xyz" N "123");
+    KEYS("A yyy<ESC>", "abc def xxx yy" X "y" N "xyz" N "123");
+    KEYS("u", "abc def xx" X "x" N "xyz" N "123");
+    KEYS("u", "abc de" X "f" N "xyz" N "123");
+    KEYS("<C-r>", "abc def" X " xxx" N "xyz" N "123");
+
+    // Undo file
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath("undo");
+    data.doCommand(QString("wundo ") + fileName);
+    QVERIFY(QFile::exists(fileName));
+    journal->clear();
+    QVERIFY(!journal->canUndo());
+    data.doCommand(QString("rundo ") + fileName);
+    QVERIFY(journal->canUndo());
+    // Without the cursor positions stored in FakeVim, the cursor moves to
+    // the last change.
+    KEYS("u", "abc de" X "f" N "xyz" N "123");
+    KEYS("<C-r>", "abc def xx" X "x" N "xyz" N "123");
+
+    // History and hash taken at a save are written later (on another thread)
+    // and still match the text that was saved.
+    {
+        const UndoJournal::History history = journal->history();
+        const QByteArray textHash = UndoJournal::hashText(data.editor()->toPlainText());
+        KEYS("x", "abc def x" X "x" N "xyz" N "123");
+        QString error;
+        const QString savedName = dir.filePath("saved");
+        QVERIFY(UndoJournal::save(savedName, history, textHash, &error));
+        KEYS("u", "abc def xx" X "x" N "xyz" N "123");
+        journal->clear();
+        data.doCommand(QString("rundo ") + savedName);
+        QVERIFY(journal->canUndo());
+        KEYS("u", "abc de" X "f" N "xyz" N "123");
+        KEYS("<C-r>", "abc def xx" X "x" N "xyz" N "123");
+    }
+
+    // Undo file is rejected if the text differs.
+    KEYS("x", "abc def x" X "x" N "xyz" N "123");
+    journal->clear();
+    data.doCommand(QString("rundo ") + fileName);
+    QVERIFY(!journal->canUndo());
+    QCOMPARE(data.text(), QByteArray("abc def xx" N "xyz" N "123"));
+
+    // Oldest changes are dropped over the memory limit.
+    KEYS("x", "abc def " X "x" N "xyz" N "123");
+    KEYS("x", "abc def" X " " N "xyz" N "123");
+    journal->setMemoryLimit(0);
+    QVERIFY(!journal->canUndo());
+    KEYS("u", "abc def" X " " N "xyz" N "123");
+}
+
+void FakeVimPlugin::test_vim_keyword_completion()
+{
+    TestData data;
+    setup(&data);
+
+    data.setText("alpha beta" N "alphabet");
+    auto index = new KeywordIndex(data.edit);
+    index->trackDocument(data.editor()->document());
+    data.handler->setKeywordIndex(index);
+    QTextDocument other(QString("alpine"));
+    index->addDocument(&other);
+
+    // Matches from all documents in alphabetical order, then the original text.
+    KEYS("Goal<C-n><ESC>", "alpha beta" N "alphabet" N "alph" X "a");
+    KEYS("oal<C-n><C-n><ESC>", "alpha beta" N "alphabet" N "alpha" N "alphabe" X "t");
+    KEYS("ddoal<C-n><C-n><C-n><C-n><ESC>", "alpha beta" N "alphabet" N "alpha" N "a" X "l");
+    KEYS("ddoal<C-p><ESC>", "alpha beta" N "alphabet" N "alpha" N "alpin" X "e");
+    KEYS("ddobet<C-n><ESC>", "alpha beta" N "alphabet" N "alpha" N "bet" X "a");
+    KEYS("ddozzz<C-n><ESC>", "alpha beta" N "alphabet" N "alpha" N "zz" X "z");
+
+    // Keywords are removed from the index with their last occurrence.
+    QVERIFY(index->contains("zzz"));
+    KEYS("dd", "alpha beta" N "alphabet" N X "alpha");
+    QVERIFY(!index->contains("zzz"));
+    QVERIFY(index->contains("beta"));
+    KEYS("ggwdw", "alpha" X " " N "alphabet" N "alpha");
+    QVERIFY(!index->contains("beta"));
+    QVERIFY(index->contains("alpha"));
+    QCOMPARE(index->complete("alp", 10), QStringList({"alpha", "alphabet", "alpine"}));
+}
+
 void FakeVimPlugin::test_vim_letter_case()
 {
     TestData data;
@@ -3066,6 +3197,193 @@ void FakeVimPlugin::test_vim_substitute()
     COMMAND("undo | s/\\(b...E\\)/\\U\\1/g", "aBC DEfGh");
     COMMAND("undo | s/\\(C..E\\)/\\l\\1/g",  "abc dEfGh");
     COMMAND("undo | s/\\(b...E\\)/\\L\\1/g", "abc defGh");
+
+    // large range is substituted in one step
+    QByteArray lines = "abc";
+    QByteArray substituted = "axc";
+    for (int i = 1; i < 5000; ++i) {
+        lines += N "abc";
+        substituted += N "axc";
+    }
+    data.setText(lines.constData());
+    COMMAND("%s/b/x/", substituted.left(substituted.size() - 3) + X "axc");
+    COMMAND("u", X + lines);
+}
+
+void FakeVimPlugin::test_vim_ex_global()
+{
+    TestData data;
+    setup(&data);
+
+    data.setText("a1" N "b" N "a2" N "c" N "a3");
+    COMMAND("g/a/d", "b" N X "c");
+    COMMAND("u", "a1" N "b" N "a2" N "c" N "a3");
+    COMMAND("v/a/d", "a1" N "a2" N "a3");
+    COMMAND("u", "a1" N "b" N "a2" N "c" N "a3");
+    COMMAND("g!/a/d", "a1" N "a2" N "a3");
+    COMMAND("u", "a1" N "b" N "a2" N "c" N "a3");
+
+    // pattern is translated like in search
+    COMMAND("g/\\<b\\>\\|c/d", "a1" N "a2" N X "a3");
+    COMMAND("u", "a1" N "b" N "a2" N "c" N "a3");
+
+    // move and copy
+    COMMAND("g/^/m0", X "a3" N "c" N "a2" N "b" N "a1");
+    COMMAND("u", "a1" N "b" N "a2" N "c" N "a3");
+    COMMAND("g/a/m0", X "a3" N "a2" N "a1" N "b" N "c");
+    COMMAND("u", "a1" N "b" N "a2" N "c" N "a3");
+    COMMAND("g/a/t$", "a1" N "b" N "a2" N "c" N "a3" N "a1" N "a2" N X "a3");
+    COMMAND("u", "a1" N "b" N "a2" N "c" N "a3");
+
+    // substitute (empty pattern is the pattern of :g)
+    COMMAND("g/a/s//x/", "x1" N "b" N "x2" N "c" N X "x3");
+    COMMAND("u", "a1" N "b" N "a2" N "c" N "a3");
+    COMMAND("g/a/s/\\d/-/", "a-" N "b" N "a-" N "c" N X "a-");
+    COMMAND("u", "a1" N "b" N "a2" N "c" N "a3");
+
+    // normal mode commands
+    COMMAND("g/\\d/normal Ax", "a1x" N "b" N "a2x" N "c" N "a3x");
+}
+
+void FakeVimPlugin::test_vim_ex_sort()
+{
+    TestData data;
+    setup(&data);
+
+    data.setText("b2" N "a10" N "c1" N "a10" N "B3");
+    COMMAND("sort", X "B3" N "a10" N "a10" N "b2" N "c1");
+    COMMAND("u", "b2" N "a10" N "c1" N "a10" N "B3");
+    COMMAND("sort u", X "B3" N "a10" N "b2" N "c1");
+    COMMAND("u", "b2" N "a10" N "c1" N "a10" N "B3");
+    COMMAND("sort i", X "a10" N "a10" N "b2" N "B3" N "c1");
+    COMMAND("u", "b2" N "a10" N "c1" N "a10" N "B3");
+    COMMAND("sort! i", X "c1" N "B3" N "b2" N "a10" N "a10");
+    COMMAND("u", "b2" N "a10" N "c1" N "a10" N "B3");
+
+    // numbers
+    COMMAND("sort n", X "c1" N "b2" N "B3" N "a10" N "a10");
+    COMMAND("u", "b2" N "a10" N "c1" N "a10" N "B3");
+    COMMAND("sort! n", X "a10" N "a10" N "B3" N "b2" N "c1");
+    COMMAND("u", "b2" N "a10" N "c1" N "a10" N "B3");
+    COMMAND("sort nu", X "c1" N "b2" N "B3" N "a10");
+    COMMAND("u", "b2" N "a10" N "c1" N "a10" N "B3");
+
+    // sort on text after match or on the match
+    COMMAND("sort /\\a/", X "c1" N "a10" N "a10" N "b2" N "B3");
+    COMMAND("u", "b2" N "a10" N "c1" N "a10" N "B3");
+    COMMAND("sort /\\d/ r", X "a10" N "c1" N "a10" N "b2" N "B3");
+    COMMAND("u", "b2" N "a10" N "c1" N "a10" N "B3");
+
+    data.setText("0x1F" N "0xA" N "3" N "x");
+    COMMAND("sort x", X "x" N "3" N "0xA" N "0x1F");
+
+    data.setText("1.5" N "-2" N "1e1" N "x");
+    COMMAND("sort f", X "x" N "-2" N "1.5" N "1e1");
+
+    data.setText("0b101" N "11" N "-1");
+    COMMAND("sort b", X "-1" N "11" N "0b101");
+}
+
+void FakeVimPlugin::test_vim_ex_filter()
+{
+#ifndef Q_OS_UNIX
+    QSKIP("Test uses Unix commands.");
+#endif
+    TestData data;
+    setup(&data);
+
+    // The command runs asynchronously; the buffer can be edited meanwhile.
+    data.setText("c" N "b" N "a" N "d");
+    data.doCommand("1,3!sort");
+    KEYS("Gix<ESC>", "c" N "b" N "a" N X "xd");
+    QTRY_COMPARE(data.text(), QByteArray("a" N "b" N "c" N "xd"));
+    KEYS("u", "c" N "b" N "a" N "xd");
+
+    // Like in Vim, the output replaces the text even if the command fails
+    // (grep without a match exits with 1).
+    data.doCommand("%!grep z");
+    QTRY_COMPARE(data.text(), QByteArray());
+    data.doKeys("u");
+    QCOMPARE(data.text(), QByteArray("c" N "b" N "a" N "xd"));
+
+    // Ctrl-C cancels the command.
+    data.doCommand("%!sleep 10");
+    data.doKeys("<C-C>");
+    QTest::qWait(200);
+    QCOMPARE(data.text(), QByteArray("c" N "b" N "a" N "xd"));
+
+    // Without an event loop (batch mode) the command is waited for.
+    data.doCommand("%!sort");
+    data.handler->waitForFilter();
+    QCOMPARE(data.text(), QByteArray("a" N "b" N "c" N "xd"));
+    data.doCommand("%!false");
+    data.handler->waitForFilter();
+    QCOMPARE(data.text(), QByteArray());
+    data.doKeys("u");
+    QCOMPARE(data.text(), QByteArray("a" N "b" N "c" N "xd"));
+    data.doCommand("2,3!sort -r");
+    data.handler->waitForFilter();
+    data.doCommand("1!tr a z");
+    data.handler->waitForFilter();
+    QCOMPARE(data.text(), QByteArray("z" N "c" N "b" N "xd"));
+}
+
+void FakeVimPlugin::test_vim_ex_perfstats()
+{
+    TestData data;
+    setup(&data);
+
+    data.setText("abc" N "def");
+    KEYS("jx", "abc" N X "ef");
+
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath("trace.json");
+    data.doCommand(QString("perfstats trace ") + fileName);
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QJsonObject trace = QJsonDocument::fromJson(file.readAll()).object();
+    bool hasKeys = false;
+    for (const QJsonValue &event : trace.value("traceEvents").toArray())
+        hasKeys = hasKeys || event.toObject().value("name").toString() == "handleKey";
+    QVERIFY(hasKeys);
+
+    data.doCommand("perfstats reset");
+    data.doCommand("perfstats invalid");
+    QCOMPARE(data.text(), QByteArray("abc" N "ef"));
+}
+
+void FakeVimPlugin::test_vim_ex_source()
+{
+    TestData data;
+    setup(&data);
+
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath("vimrc");
+    const auto writeConfig = [&](const char *text) {
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(text);
+    };
+
+    writeConfig("\" comment" N "nnoremap Q dd" N "set" N "\\ shiftwidth=3" N);
+    data.setText("abc" N "def");
+    data.doCommand(QString("source ") + fileName);
+    KEYS("Q", X "def");
+    KEYS(">>", "   " X "def");
+
+    // Unchanged file is not applied again.
+    data.doCommand("set shiftwidth=8");
+    QVERIFY(data.handler->loadConfig(fileName));
+    KEYS("u>>", "        " X "def");
+
+    // Changed file is read again.
+    writeConfig("set shiftwidth=2" N);
+    QVERIFY(data.handler->loadConfig(fileName));
+    KEYS("u>>", "  " X "def");
+
+    QVERIFY(!data.handler->loadConfig(dir.filePath("missing")));
+    data.doCommand("unmap Q");
 }
 
 void FakeVimPlugin::test_vim_ex_commandbuffer_paste()
@@ -4524,6 +4842,25 @@ void FakeVimPlugin::test_macros()
     KEYS("qq" ":<UP><CR>" "q", X "---" N "def");
     KEYS(":s/./!/g<CR>", X "!!!" N "def");
     KEYS("j@q", "!!!" N X "!!!");
+
+    // count isn't limited by the mapping depth, changes are undone at once
+    data.setText("0");
+    KEYS("qqA+<ESC>q", "0" X "+");
+    KEYS("1500@q", "0" + QByteArray(1500, '+') + X "+");
+    data.doKeys("u");
+    QCOMPARE(data.text(), QByteArray("0+"));
+
+    // repeats are queued one at a time, so any count works
+    data.setText("abc");
+    KEYS("qwq", X "abc");
+    KEYS("2147483647@w", X "abc");
+
+    // :normal for each line in range
+    data.setText("a" N "b" N "c" N "d");
+    COMMAND("2,3normal A;", "a" N "b;" N "c;" N "d");
+    COMMAND("%normal I-", "-a" N "-b;" N "-c;" N "-d");
+    COMMAND("u", "a" N "b;" N "c;" N "d");
+    COMMAND("%normal dd", "b;" N "d");
 }
 
 void FakeVimPlugin::test_vim_qtcreator()
@@ -80,11 +80,18 @@ private slots:
     void test_vim_current_column();
     void test_vim_copy_paste();
     void test_vim_undo_redo();
+    void test_vim_undo_journal();
+    void test_vim_keyword_completion();
     void test_vim_letter_case();
     void test_vim_code_autoindent();
     void test_vim_code_folding();
     void test_vim_code_completion();
     void test_vim_substitute();
+    void test_vim_ex_global();
+    void test_vim_ex_sort();
+    void test_vim_ex_filter();
+    void test_vim_ex_perfstats();
+    void test_vim_ex_source();
     void test_vim_ex_commandbuffer_paste();
     void test_vim_ex_yank();
     void test_vim_ex_delete();
@@ -1,13 +1,155 @@
-import subprocess
+import argparse
+import json
+import os
 import pathlib
+import queue
+import subprocess
+import sys
+import threading
 
 EXEC_PATH = pathlib.Path(__file__).parent.absolute() / "build" / "WolfEdit"
 
 
-def launch_wolfedit():
-    subprocess.Popen([EXEC_PATH])
+def launch_wolfedit(files=()):
+    subprocess.Popen([EXEC_PATH, *map(str, files)])
+
+
+class BatchWorker:
+    """Headless WolfEdit process (WolfEdit --batch) that edits one file at a
+    time and keeps running between files.
+
+    Requests and results are JSON objects, one per line on its stdin and
+    stdout (see src/batchserver.h)."""
+
+    def __init__(self):
+        self.process = subprocess.Popen(
+            [EXEC_PATH, "--batch"],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            encoding="utf-8",
+        )
+        self.next_id = 0
+
+    def edit(self, path, commands, output=None, write=True):
+        """Runs the Ex commands on the file and writes it if it changed.
+
+        Returns the result, e.g. {"file": "a.txt", "ok": True,
+        "modified": True, "errors": []}."""
+        self.next_id += 1
+        request = {
+            "id": self.next_id,
+            "file": str(path),
+            "commands": list(commands),
+            "write": write,
+        }
+        if output is not None:
+            request["output"] = str(output)
+        self.process.stdin.write(json.dumps(request) + "\n")
+        self.process.stdin.flush()
+        line = self.process.stdout.readline()
+        if not line:
+            raise RuntimeError("WolfEdit batch process exited")
+        return json.loads(line)
+
+    def close(self):
+        self.process.stdin.close()
+        self.process.wait()
+
+
+class BatchEditor:
+    """Runs the same Ex commands on many files with a pool of headless
+    WolfEdit processes, one per core by default.
+
+        with BatchEditor() as editor:
+            for result in editor.edit_files(paths, ["g/^#/d", "%s/a/b/g"]):
+                if not result["ok"]:
+                    print(result["file"], result.get("error"), result["errors"])
+    """
+
+    def __init__(self, jobs=None):
+        self.workers = [BatchWorker() for _ in range(jobs or os.cpu_count() or 1)]
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc_info):
+        self.close()
+
+    def close(self):
+        for worker in self.workers:
+            worker.close()
+
+    def edit_files(self, paths, commands, write=True):
+        """Yields the result of each file as soon as it is edited, which is
+        not necessarily in the order of paths."""
+        pending = queue.Queue()
+        for path in paths:
+            pending.put(path)
+        results = queue.Queue()
+
+        def work(worker):
+            try:
+                while True:
+                    try:
+                        path = pending.get_nowait()
+                    except queue.Empty:
+                        break
+                    results.put(worker.edit(path, commands, write=write))
+            except Exception as error:
+                results.put(error)
+            results.put(None)
+
+        threads = [
+            threading.Thread(target=work, args=(worker,), daemon=True)
+            for worker in self.workers
+        ]
+        for thread in threads:
+            thread.start()
+
+        running = len(threads)
+        while running:
+            result = results.get()
+            if result is None:
+                running -= 1
+            elif isinstance(result, Exception):
+                raise result
+            else:
+                yield result
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Launches WolfEdit, or with -c runs Ex commands on files "
+        "without opening a window."
+    )
+    parser.add_argument(
+        "-c",
+        dest="commands",
+        action="append",
+        metavar="COMMAND",
+        help="Ex command to run on each file (can be repeated)",
+    )
+    parser.add_argument(
+        "-j", "--jobs", type=int, help="number of processes (default: cores)"
+    )
+    parser.add_argument("files", nargs="*")
+    args = parser.parse_args()
+
+    if not args.commands:
+        launch_wolfedit(args.files)
+        return 0
+
+    failed = 0
+    with BatchEditor(args.jobs) as editor:
+        for result in editor.edit_files(args.files, args.commands):
+            if not result["ok"]:
+                failed += 1
+                messages = [result["error"]] if "error" in result else []
+                messages += result.get("errors", [])
+                print(f"{result['file']}: {'; '.join(messages)}", file=sys.stderr)
+    return 1 if failed else 0
 
 
 # Launches a WolfEdit subprocess from Python
 if __name__ == "__main__":
-    launch_wolfedit()
+    sys.exit(main())